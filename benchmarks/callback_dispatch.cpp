@@ -0,0 +1,132 @@
+/*
+ * benchmarks/callback_dispatch.cpp
+ *
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2014 Ivan Grynko
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/* Cost of delivering a chunk of data to a write handler
+ *
+ * Usage: callback_dispatch [chunks]
+ *
+ * cURL calls the write callback through a function pointer for every chunk of the body.
+ * The benchmark makes the same indirect call with 16 KiB chunks and compares:
+ *
+ *     std::function    Easy::onWrite_( SimplifiedDataHandler ), the handler is wrapped into
+ *                      a WriteHandler, so every chunk passes two std::function objects
+ *     templated        Easy::onWrite_( lambda ), InlineCallback calls the lambda directly
+ *
+ * The handler only touches the chunk, so the numbers show the dispatch overhead.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <curlite.hpp>
+
+namespace
+{
+    const size_t kChunkSize = 16 << 10;
+
+    struct Sink
+    {
+        size_t bytes = 0;
+        unsigned checksum = 0;
+
+        bool consume( char *data, size_t size )
+        {
+            bytes += size;
+            checksum += (unsigned char) data[0] + (unsigned char) data[size - 1];
+            return true;
+        }
+    };
+
+    // the same path as Easy::Pimpl::write() with the wrapper installed by Easy::onWrite_()
+    struct FunctionPath
+    {
+        curlite::WriteHandler handler;
+
+        static size_t write( char *data, size_t size, size_t n, void *userPtr )
+        {
+            return static_cast<FunctionPath*>( userPtr )->handler( data, size, n, nullptr );
+        }
+    };
+
+    template <class Callback>
+    double measure( Callback callback, void *userPtr, char *chunk, size_t chunks )
+    {
+        // cURL doesn't know the callback at compile time, neither should the compiler here
+        curl_write_callback volatile indirect = callback;
+
+        auto start = std::chrono::steady_clock::now();
+
+        for( size_t i = 0; i < chunks; ++i ) {
+            if( indirect( chunk, 1, kChunkSize, userPtr ) != kChunkSize ) {
+                std::cerr << "the handler has failed" << std::endl;
+                std::exit( 1 );
+            }
+        }
+
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / chunks;
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    size_t chunks = argc > 1 ? std::strtoul( argv[1], nullptr, 10 ) : 50000000;
+
+    std::vector<char> chunk( kChunkSize, 'x' );
+    Sink sink;
+
+    curlite::Easy::SimplifiedDataHandler simplified = [&sink] ( char *data, size_t size ) {
+        return sink.consume( data, size );
+    };
+
+    FunctionPath functionPath;
+    functionPath.handler = [simplified] ( char *data, size_t size, size_t n, void * ) -> size_t {
+        return simplified( data, size * n ) ? size * n : 0;
+    };
+
+    auto lambda = [&sink] ( char *data, size_t size ) {
+        return sink.consume( data, size );
+    };
+
+    curlite::CallbackSlot slot;
+    auto templated = slot.emplace( lambda );
+
+    double functionNs = measure( &FunctionPath::write, &functionPath, chunk.data(), chunks );
+    double templatedNs = measure( &curlite::InlineCallback<decltype( lambda )>::simplifiedWrite, templated, chunk.data(), chunks );
+
+    std::cout << std::setw( 16 ) << "path" << std::setw( 14 ) << "ns/chunk" << std::endl;
+
+    std::cout << std::fixed << std::setprecision( 2 );
+    std::cout << std::setw( 16 ) << "std::function" << std::setw( 14 ) << functionNs << std::endl;
+    std::cout << std::setw( 16 ) << "templated" << std::setw( 14 ) << templatedNs << std::endl;
+
+    // keeps the work of the handlers observable
+    std::cout << "checksum: " << sink.checksum << std::endl;
+
+    return 0;
+}
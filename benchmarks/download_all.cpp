@@ -0,0 +1,115 @@
+/*
+ * benchmarks/download_all.cpp
+ *
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2014 Ivan Grynko
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/* Throughput of curlite::downloadAll() depending on the number of threads
+ *
+ * Usage: download_all [count]
+ *
+ * count items are downloaded from the loopback server in the process with 1, 2, 4, ... threads
+ * up to the number of cores, in two workloads of the same total size:
+ *
+ *     uniform    every item is 65 KiB
+ *     skewed     every 16th item is 1 MiB, the others are 1 KiB
+ *
+ * The items are dealt to the threads in turn, so with up to 16 threads all the large items of
+ * the skewed workload land in the queue of the first one. Unless the idle threads steal them,
+ * the skewed workload runs as long as that thread alone. POSIX only.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <curlite.hpp>
+
+#include "../tools/loopback_server.hpp"
+
+namespace
+{
+    const size_t kSmall = 1 << 10;
+    const size_t kLarge = 1 << 20;
+    const size_t kEvery = 16;
+    const size_t kUniform = ( kLarge + ( kEvery - 1 ) * kSmall ) / kEvery;
+
+    void run( std::string const &workload, std::vector<curlite::DownloadItem> const &items, size_t threads )
+    {
+        curlite::DownloadOptions options;
+        options.threads = threads;
+
+        auto start = std::chrono::steady_clock::now();
+        auto results = curlite::downloadAll( items, options );
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        double bytes = 0;
+        size_t failed = 0;
+        for( auto it = results.begin(); it != results.end(); ++it ) {
+            bytes += double( it->size );
+            failed += it->error != CURLE_OK;
+        }
+
+        std::cout << std::setw( 8 ) << threads
+                  << std::setw( 10 ) << workload
+                  << std::setw( 14 ) << std::fixed << std::setprecision( 0 ) << items.size() / elapsed.count()
+                  << std::setw( 12 ) << std::setprecision( 1 ) << bytes / elapsed.count() / ( 1 << 20 )
+                  << std::setw( 10 ) << failed << std::endl;
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    size_t count = argc > 1 ? std::strtoul( argv[1], nullptr, 10 ) : 10000;
+
+    curlite::tools::LoopbackServer server;
+
+    std::vector<curlite::DownloadItem> uniform, skewed;
+    for( size_t i = 0; i < count; ++i )
+    {
+        uniform.push_back( curlite::DownloadItem { server.url( kUniform ), nullptr } );
+        skewed.push_back( curlite::DownloadItem { server.url( i % kEvery == 0 ? kLarge : kSmall ), nullptr } );
+    }
+
+    size_t cores = std::max( 1u, std::thread::hardware_concurrency() );
+
+    std::cout << std::setw( 8 ) << "threads"
+              << std::setw( 10 ) << "workload"
+              << std::setw( 14 ) << "requests/s"
+              << std::setw( 12 ) << "MiB/s"
+              << std::setw( 10 ) << "failed" << std::endl;
+
+    for( size_t threads = 1; ; threads = std::min( threads * 2, cores ) )
+    {
+        run( "uniform", uniform, threads );
+        run( "skewed", skewed, threads );
+
+        if( threads == cores ) {
+            break;
+        }
+    }
+
+    return 0;
+}
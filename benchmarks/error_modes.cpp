@@ -0,0 +1,128 @@
+/*
+ * benchmarks/error_modes.cpp
+ *
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2014 Ivan Grynko
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/* Cost of the error reporting modes of Easy when many transfers fail
+ *
+ * Usage: error_modes [transfers] [failure percentage]
+ *
+ * Transfers of file:///dev/null succeed and transfers with an unknown scheme fail,
+ * both without touching the network. Every mode reports the error with its description:
+ *
+ *     exceptions    perform() throws curlite::Exception
+ *     bool          perform() returns false, the description comes from errorString()
+ *     result        tryPerform() returns Result<void>
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <curlite.hpp>
+
+namespace
+{
+    enum class Mode { Exceptions, Bool, Result };
+
+    double measure( Mode mode, size_t transfers, size_t failurePercentage, size_t &failed )
+    {
+        curlite::Easy easy;
+        easy.setExceptionMode( mode == Mode::Exceptions );
+
+        size_t descriptionLength = 0;
+        failed = 0;
+
+        auto start = std::chrono::steady_clock::now();
+
+        for( size_t i = 0; i < transfers; ++i )
+        {
+            bool fail = i % 100 < failurePercentage;
+            easy.set( CURLOPT_URL, fail ? "unknown://localhost/" : "file:///dev/null" );
+
+            switch( mode )
+            {
+            case Mode::Exceptions:
+                try {
+                    easy.perform();
+                } catch( curlite::Exception &e ) {
+                    descriptionLength += std::strlen( e.what() );
+                    failed++;
+                }
+                break;
+
+            case Mode::Bool:
+                if( !easy.perform() ) {
+                    descriptionLength += easy.errorString().size();
+                    failed++;
+                }
+                break;
+
+            case Mode::Result:
+                auto result = easy.tryPerform();
+                if( !result ) {
+                    descriptionLength += std::strlen( result.message() );
+                    failed++;
+                }
+                break;
+            }
+        }
+
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+        // keeps the error descriptions observable
+        if( descriptionLength == 0 && failed > 0 ) {
+            std::cerr << "no error description" << std::endl;
+        }
+
+        return elapsed.count() / transfers;
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    size_t transfers = argc > 1 ? std::strtoul( argv[1], nullptr, 10 ) : 200000;
+    size_t failurePercentage = argc > 2 ? std::min<size_t>( 100, std::strtoul( argv[2], nullptr, 10 ) ) : 30;
+
+    std::cout << std::setw( 12 ) << "mode"
+              << std::setw( 16 ) << "ns/transfer"
+              << std::setw( 10 ) << "failed" << std::endl;
+
+    const char *names[] = { "exceptions", "bool", "result" };
+    Mode modes[] = { Mode::Exceptions, Mode::Bool, Mode::Result };
+
+    for( size_t i = 0; i < 3; ++i )
+    {
+        size_t failed = 0;
+        double ns = measure( modes[i], transfers, failurePercentage, failed );
+
+        std::cout << std::setw( 12 ) << names[i]
+                  << std::setw( 16 ) << std::fixed << std::setprecision( 0 ) << ns
+                  << std::setw( 10 ) << failed << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,409 @@
+/*
+ * benchmarks/loopback_suite.cpp
+ *
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2014 Ivan Grynko
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/* Overhead of curlite over plain libcurl, measured against an HTTP/1.1 server on loopback
+ *
+ * Usage: loopback_suite [benchmark] [scale]
+ *
+ * The server runs in the same process (a thread per connection) and serves "/bytes/N" with
+ * N bytes from memory, so the numbers show the client side. Every benchmark runs the same
+ * work through curlite and through the libcurl calls it wraps. Both sides are warmed up first
+ * (connections, allocator, caches), then they take turns going first for several rounds and
+ * the median of the rounds is reported:
+ *
+ *     construct     Easy constructor and destructor vs curl_easy_init()/curl_easy_cleanup()
+ *     set           Easy::set() vs curl_easy_setopt() (string and long options)
+ *     dispatch      write callback per 16 byte chunk of a chunked body (many chunks per read
+ *                   of the socket): onWrite() with std::function, onWrite_() with a lambda
+ *                   and operator >> ( std::string )
+ *     latency       small GET: a new handle (and connection) per request vs a reused handle
+ *     throughput    large body into a discarding handler and into a std::vector<char>
+ *     wire          cost of captureWire(): a reused handle with and without a WireCapture,
+ *                   for small requests and 1 MiB bodies (the libcurl column is curlite
+ *                   without the capture)
+ *
+ * All of them run by default, scale multiplies the number of iterations. POSIX only.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <curlite.hpp>
+
+#include "../tools/loopback_server.hpp"
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    using curlite::tools::LoopbackServer;
+
+    const size_t kRounds = 5;
+
+    template <class Fn>
+    double nanosecondsPerRun( size_t runs, Fn fn )
+    {
+        auto start = Clock::now();
+        for( size_t i = 0; i < runs; ++i ) {
+            fn();
+        }
+
+        std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+        return elapsed.count() / runs;
+    }
+
+    double median( std::vector<double> values )
+    {
+        std::sort( values.begin(), values.end() );
+        return values[values.size() / 2];
+    }
+
+    struct Comparison
+    {
+        double curlite;     // ns per run
+        double libcurl;
+    };
+
+    // runs are split between the rounds, the sides alternate so neither gains from going first
+    template <class CurliteFn, class LibcurlFn>
+    Comparison compare( size_t runs, CurliteFn curliteFn, LibcurlFn libcurlFn )
+    {
+        size_t perRound = std::max<size_t>( ( runs + kRounds - 1 ) / kRounds, 1 );
+
+        nanosecondsPerRun( perRound, curliteFn );
+        nanosecondsPerRun( perRound, libcurlFn );
+
+        std::vector<double> curlite, libcurl;
+        for( size_t round = 0; round < kRounds; ++round )
+        {
+            if( round % 2 == 0 ) {
+                curlite.push_back( nanosecondsPerRun( perRound, curliteFn ) );
+                libcurl.push_back( nanosecondsPerRun( perRound, libcurlFn ) );
+            } else {
+                libcurl.push_back( nanosecondsPerRun( perRound, libcurlFn ) );
+                curlite.push_back( nanosecondsPerRun( perRound, curliteFn ) );
+            }
+        }
+
+        return Comparison { median( curlite ), median( libcurl ) };
+    }
+
+    void printHeader( std::string const &title, std::string const &unit,
+                      std::string const &measured = "curlite", std::string const &baseline = "libcurl" )
+    {
+        std::cout << std::endl << title << std::endl;
+        std::cout << std::setw( 32 ) << "" << std::setw( 14 ) << measured << std::setw( 14 ) << baseline
+                  << std::setw( 12 ) << "overhead" << "    " << unit << std::endl;
+    }
+
+    // lower is better for times, higher for rates
+    void printRow( std::string const &name, double curlite, double libcurl, bool higherIsBetter = false )
+    {
+        double overhead = higherIsBetter ? libcurl / curlite - 1 : curlite / libcurl - 1;
+
+        std::cout << std::fixed << std::setprecision( 1 )
+                  << std::setw( 32 ) << name << std::setw( 14 ) << curlite << std::setw( 14 ) << libcurl
+                  << std::setw( 11 ) << overhead * 100 << "%" << std::endl;
+    }
+
+    void printTimes( std::string const &name, Comparison const &times, double divisor = 1 )
+    {
+        printRow( name, times.curlite / divisor, times.libcurl / divisor );
+    }
+
+    // MiB/s of the transfers
+    void printRates( std::string const &name, Comparison const &times, size_t bytes )
+    {
+        auto rate = [bytes] ( double ns ) { return double( bytes ) / ( 1 << 20 ) / ( ns / 1e9 ); };
+        printRow( name, rate( times.curlite ), rate( times.libcurl ), true );
+    }
+
+    size_t discard( char *, size_t size, size_t n, void * )
+    {
+        return size * n;
+    }
+
+    size_t appendToString( char *data, size_t size, size_t n, void *userPtr )
+    {
+        static_cast<std::string*>( userPtr )->append( data, size * n );
+        return size * n;
+    }
+
+    size_t appendToVector( char *data, size_t size, size_t n, void *userPtr )
+    {
+        auto body = static_cast<std::vector<char>*>( userPtr );
+        body->insert( body->end(), data, data + size * n );
+        return size * n;
+    }
+
+    void check( CURLcode code )
+    {
+        if( code != CURLE_OK ) {
+            std::cerr << "transfer failed: " << curl_easy_strerror( code ) << std::endl;
+            std::exit( 1 );
+        }
+    }
+
+    void benchmarkConstruct( size_t scale )
+    {
+        const size_t runs = 20000 * scale;
+
+        printHeader( "Easy construction and destruction", "ns/handle" );
+
+        auto times = compare( runs, [] {
+            curlite::Easy easy;
+        }, [] {
+            // the same default option as the Easy constructor
+            CURL *curl = curl_easy_init();
+            curl_easy_setopt( curl, CURLOPT_USERAGENT, "curlite::Easy" );
+            curl_easy_cleanup( curl );
+        } );
+
+        printTimes( "construct + destroy", times );
+    }
+
+    void benchmarkSet( size_t scale )
+    {
+        const size_t runs = 2000000 * scale;
+        const std::string url = "http://127.0.0.1/bytes/0";
+
+        printHeader( "Option setting", "ns/call" );
+
+        curlite::Easy easy;
+        CURL *curl = curl_easy_init();
+
+        printTimes( "set( CURLOPT_URL )", compare( runs,
+            [&] { easy.set( CURLOPT_URL, url ); },
+            [&] { curl_easy_setopt( curl, CURLOPT_URL, url.c_str() ); } ) );
+
+        long timeout = 0;
+        printTimes( "set( CURLOPT_TIMEOUT_MS )", compare( runs,
+            [&] { easy.set( CURLOPT_TIMEOUT_MS, ++timeout ); },
+            [&] { curl_easy_setopt( curl, CURLOPT_TIMEOUT_MS, ++timeout ); } ) );
+
+        curl_easy_cleanup( curl );
+    }
+
+    void benchmarkDispatch( LoopbackServer &server, size_t scale )
+    {
+        // libcurl calls the write callback for every chunk of the chunked encoding, a big receive
+        // buffer holds thousands of them, so the calls aren't hidden behind the reads of the socket
+        const size_t bytes = 1 << 20;
+        const size_t chunk = 16;
+        const size_t chunks = bytes / chunk;
+        const size_t runs = 64 * scale;
+        const std::string url = server.url( bytes ) + "?chunk=" + std::to_string( chunk );
+
+        printHeader( "Write callback dispatch, 16 byte chunks", "ns/chunk" );
+
+        CURL *curl = curl_easy_init();
+        curl_easy_setopt( curl, CURLOPT_URL, url.c_str() );
+        curl_easy_setopt( curl, CURLOPT_BUFFERSIZE, 256L << 10 );
+
+        curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION, &discard );
+        auto libcurlDiscard = [&] { check( curl_easy_perform( curl ) ); };
+
+        size_t received = 0;
+        curlite::Easy easy;
+        easy.set( CURLOPT_URL, url );
+        easy.set( CURLOPT_BUFFERSIZE, 256L << 10 );
+
+        easy.onWrite( curlite::WriteHandler( [&received] ( char *, size_t size, size_t n, void * ) -> size_t {
+            received += size * n;
+            return size * n;
+        } ) );
+        printTimes( "onWrite( std::function )", compare( runs, [&] { easy.perform(); }, libcurlDiscard ), chunks );
+
+        easy.onWrite_( [&received] ( char *, size_t size ) {
+            received += size;
+            return true;
+        } );
+        printTimes( "onWrite_( lambda )", compare( runs, [&] { easy.perform(); }, libcurlDiscard ), chunks );
+
+        // the baseline appends to the same kind of string
+        std::string body, baselineBody;
+        curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION, &appendToString );
+        curl_easy_setopt( curl, CURLOPT_WRITEDATA, &baselineBody );
+
+        printTimes( "operator >> ( std::string )", compare( runs,
+            [&] { easy >> body; },
+            [&] { baselineBody.clear(); check( curl_easy_perform( curl ) ); } ), chunks );
+
+        curl_easy_cleanup( curl );
+
+        if( received == 0 || body.size() != bytes ) {
+            std::cerr << "unexpected body size" << std::endl;
+            std::exit( 1 );
+        }
+    }
+
+    void benchmarkLatency( LoopbackServer &server, size_t scale )
+    {
+        const size_t runs = 2000 * scale;
+        const std::string url = server.url( 64 );
+
+        printHeader( "Small request latency", "us/request" );
+
+        auto fresh = compare( runs, [&] {
+            curlite::Easy easy;
+            easy.set( CURLOPT_URL, url );
+            easy.set( CURLOPT_WRITEFUNCTION, &discard );
+            easy.perform();
+        }, [&] {
+            CURL *curl = curl_easy_init();
+            curl_easy_setopt( curl, CURLOPT_USERAGENT, "curlite::Easy" );
+            curl_easy_setopt( curl, CURLOPT_URL, url.c_str() );
+            curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION, &discard );
+            check( curl_easy_perform( curl ) );
+            curl_easy_cleanup( curl );
+        } );
+
+        printTimes( "new handle per request", fresh, 1000 );
+
+        curlite::Easy easy;
+        easy.set( CURLOPT_URL, url );
+        easy.set( CURLOPT_WRITEFUNCTION, &discard );
+
+        CURL *curl = curl_easy_init();
+        curl_easy_setopt( curl, CURLOPT_USERAGENT, "curlite::Easy" );
+        curl_easy_setopt( curl, CURLOPT_URL, url.c_str() );
+        curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION, &discard );
+
+        auto reused = compare( runs, [&] { easy.perform(); }, [&] { check( curl_easy_perform( curl ) ); } );
+        printTimes( "reused handle", reused, 1000 );
+
+        curl_easy_cleanup( curl );
+    }
+
+    void benchmarkThroughput( LoopbackServer &server, size_t scale )
+    {
+        const size_t bytes = 256 << 20;
+        const size_t runs = 4 * scale;
+        const std::string url = server.url( bytes );
+
+        printHeader( "Large body throughput, 256 MiB", "MiB/s" );
+
+        curlite::Easy easy;
+        easy.set( CURLOPT_URL, url );
+
+        CURL *curl = curl_easy_init();
+        curl_easy_setopt( curl, CURLOPT_URL, url.c_str() );
+
+        easy.onWrite_( [] ( char *, size_t ) { return true; } );
+        curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION, &discard );
+
+        printRates( "discard", compare( runs, [&] { easy.perform(); }, [&] { check( curl_easy_perform( curl ) ); } ), bytes );
+
+        std::vector<char> body, baselineBody;
+        curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION, &appendToVector );
+        curl_easy_setopt( curl, CURLOPT_WRITEDATA, &baselineBody );
+
+        printRates( "operator >> ( vector<char> )", compare( runs,
+            [&] { easy >> body; },
+            [&] { baselineBody.clear(); check( curl_easy_perform( curl ) ); } ), bytes );
+
+        curl_easy_cleanup( curl );
+    }
+
+    void benchmarkWire( LoopbackServer &server, size_t scale )
+    {
+        printHeader( "WireCapture, reused handle", "us/request", "capture", "no capture" );
+
+        curlite::WireCapture wire;
+
+        const size_t sizes[] = { 64, 1 << 20 };
+        const size_t runs[] = { 2000 * scale, 200 * scale };
+
+        for( size_t i = 0; i < 2; ++i )
+        {
+            const std::string url = server.url( sizes[i] );
+
+            curlite::Easy captured;
+            captured.set( CURLOPT_URL, url );
+            captured.set( CURLOPT_WRITEFUNCTION, &discard );
+            captured.captureWire( wire );
+
+            curlite::Easy plain;
+            plain.set( CURLOPT_URL, url );
+            plain.set( CURLOPT_WRITEFUNCTION, &discard );
+
+            auto times = compare( runs[i], [&] { captured.perform(); }, [&] { plain.perform(); } );
+            printTimes( i == 0 ? "64 B body" : "1 MiB body", times, 1000 );
+        }
+
+        if( wire.events() == 0 ) {
+            std::cerr << "nothing captured" << std::endl;
+            std::exit( 1 );
+        }
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    std::string only = argc > 1 ? argv[1] : "";
+    size_t scale = argc > 2 ? std::max<size_t>( std::strtoul( argv[2], nullptr, 10 ), 1 ) : 1;
+
+    try
+    {
+        LoopbackServer server;
+
+        if( only.empty() || only == "construct" ) {
+            benchmarkConstruct( scale );
+        }
+
+        if( only.empty() || only == "set" ) {
+            benchmarkSet( scale );
+        }
+
+        if( only.empty() || only == "dispatch" ) {
+            benchmarkDispatch( server, scale );
+        }
+
+        if( only.empty() || only == "latency" ) {
+            benchmarkLatency( server, scale );
+        }
+
+        if( only.empty() || only == "throughput" ) {
+            benchmarkThroughput( server, scale );
+        }
+
+        if( only.empty() || only == "wire" ) {
+            benchmarkWire( server, scale );
+        }
+    }
+    catch( std::exception &e ) {
+        std::cerr << "Got an exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
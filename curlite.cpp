@@ -27,6 +27,66 @@
 
 #include "curlite.hpp"
 
+#include <unordered_map>
+#include <map>
+#include <chrono>
+#include <shared_mutex>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <exception>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#define CURLITE_AVX2
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define CURLITE_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// processor features are detected at runtime, functions are compiled for them with target attributes
+#if ( defined( __GNUC__ ) || defined( __clang__ ) ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#include <immintrin.h>
+#include <cpuid.h>
+#define CURLITE_X86_DISPATCH
+#endif
+
+#if defined( __ARM_FEATURE_CRC32 )
+#include <arm_acle.h>
+#endif
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#endif
+
 // anonymous namespace for internal usage
 namespace
 {
@@ -45,6 +105,24 @@ namespace
 
 namespace curlite
 {
+    CallbackSlot::CallbackSlot()
+        : _callable( nullptr ), _destroy( nullptr )
+    { }
+
+    CallbackSlot::~CallbackSlot()
+    {
+        reset();
+    }
+
+    void CallbackSlot::reset()
+    {
+        if( _callable ) {
+            _destroy( _callable );
+            _callable = nullptr;
+            _destroy = nullptr;
+        }
+    }
+
     template <class HandlerType>
     struct Event
     {
@@ -54,6 +132,255 @@ namespace curlite
         Event() : data( nullptr ) { }
     };
 
+    namespace
+    {
+        // "http://user@Example.com:8080/path" -> "example.com:8080"
+        std::string hostOfUrl( std::string_view url )
+        {
+            size_t scheme = url.find( "://" );
+            if( scheme != std::string_view::npos ) {
+                url.remove_prefix( scheme + 3 );
+            }
+
+            url = url.substr( 0, url.find_first_of( "/?#" ) );
+
+            size_t credentials = url.rfind( '@' );
+            if( credentials != std::string_view::npos ) {
+                url.remove_prefix( credentials + 1 );
+            }
+
+            std::string host( url );
+            std::transform( host.begin(), host.end(), host.begin(), [] ( unsigned char c ) {
+                return char( std::tolower( c ) );
+            } );
+
+            return host;
+        }
+
+        // Content-Length of the download or -1 if it's unknown
+        curl_off_t contentLengthOf( CURL *curl )
+        {
+#if LIBCURL_VERSION_NUM >= 0x073700
+            curl_off_t length = -1;
+            if( curl_easy_getinfo( curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length ) != CURLE_OK ) {
+                return -1;
+            }
+#else
+            double length = -1;
+            if( curl_easy_getinfo( curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &length ) != CURLE_OK ) {
+                return -1;
+            }
+#endif
+            return curl_off_t( length );
+        }
+    }
+
+    // declared here, because the data callbacks of Easy consult the limiter
+    struct RateLimiter::Pimpl
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        struct Bucket
+        {
+            double              rate;       // bytes per second, 0 means unlimited
+            double              burst;
+            double              tokens;     // negative while the last chunk is paid off
+            Clock::time_point   refilled;
+            curl_off_t          transferred;
+        };
+
+        struct TransferClass
+        {
+            double weight;
+            double finish[2];               // virtual finish time of the last chunk
+        };
+
+        struct Waiter
+        {
+            Easy::Pimpl *transfer;
+            size_t       transferClass;
+            size_t       bytes;
+        };
+
+        mutable std::mutex          mutex;
+        Bucket                      buckets[2];
+        double                      virtualTime[2];
+        std::vector<TransferClass>  classes;
+        std::vector<Waiter>         waiters[2];
+
+        Pimpl();
+
+        void refill( Bucket &bucket, Clock::time_point now );
+
+        // returns false if the transfer (run by a multi session) has to be paused
+        bool acquire( Easy::Pimpl *transfer, Direction direction, size_t bytes );
+        void refund( Direction direction, size_t bytes );
+
+        // unpause the transfers of the multi session, returns milliseconds until the next one,
+        // 0 if some were unpaused right now or -1 if none is waiting
+        int resume( void *owner );
+
+        void forget( Easy::Pimpl *transfer );
+    };
+
+    // declared here, because Easy and Multi record the completed transfers
+    struct Metrics::Pimpl
+    {
+        // log-linear buckets: 16 per power of two up to 2^40
+        static const int kSubBucketBits = 4;
+        static const int kMaxValueBits = 40;
+        static const int kBuckets = ( kMaxValueBits - kSubBucketBits + 1 ) << kSubBucketBits;
+
+        static const int kTimings = Total + 1;
+
+        // written by the owning thread only, so the updates are plain loads and stores
+        struct Histogram
+        {
+            std::atomic<uint64_t> counts[kBuckets];
+            std::atomic<uint64_t> sum;
+
+            Histogram();
+
+            void add( uint64_t value );
+
+            static int bucket( uint64_t value );
+            static uint64_t lowerBound( int bucket );
+        };
+
+        struct Series
+        {
+            std::string             host;
+            std::string             status;
+
+            Histogram               timings[kTimings];     // microseconds
+            Histogram               downloaded;
+            Histogram               uploaded;
+
+            std::atomic<uint64_t>   transfers;
+            std::atomic<uint64_t>   connections;
+            std::atomic<uint64_t>   reused;
+            std::atomic<uint64_t>   errors[CURL_LAST];
+
+            Series();
+        };
+
+        // series recorded by one thread, the mutex guards the insertion against the readers
+        struct Shard
+        {
+            std::mutex                                                  mutex;
+            std::unordered_map<std::string, std::unique_ptr<Series>>    series;
+        };
+
+        uint64_t                            id;
+        mutable std::mutex                  mutex;
+        std::vector<std::unique_ptr<Shard>> shards;
+
+        Pimpl();
+
+        Shard &localShard();
+
+        void record( CURL *curl, CURLcode result );
+
+        // calls fn( Series const & ) for every series of every thread
+        template <class Fn>
+        void forEach( Fn fn ) const;
+    };
+
+    // declared here, because the debug callback of Easy records into it
+    struct WireCapture::Pimpl
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        static const size_t kHeaderWords = 3;
+
+        // slots of one thread, the thread is the only writer
+        struct Ring
+        {
+            size_t                                      slots;
+            std::unique_ptr<std::atomic<uint64_t>[]>    words;
+            std::atomic<uint64_t>                       written;    // events published so far
+        };
+
+        struct Event
+        {
+            uint64_t            time;
+            uint32_t            transfer;
+            uint8_t             type;
+            uint64_t            size;
+            std::vector<char>   data;
+        };
+
+        uint64_t                            id;
+        size_t                              bytesPerThread;
+        size_t                              maxPayload;
+        size_t                              slotWords;
+        Clock::time_point                   start;
+        int64_t                             startTime;      // nanoseconds since the Unix epoch
+
+        std::atomic<uint32_t>               nextTransfer;
+        std::atomic<bool>                   redact;
+
+        mutable std::mutex                  mutex;
+        std::vector<std::unique_ptr<Ring>>  rings;
+        std::string                         errorPath;
+
+        Pimpl( size_t bytesPerThread, size_t maxPayload );
+
+        Ring &localRing();
+
+        void record( uint32_t transfer, curl_infotype type, const char *data, size_t size );
+
+        // copies the published events of every ring, ordered by time
+        std::vector<Event> snapshot() const;
+
+        bool write( std::ostream &stream ) const;
+        bool write( std::string const &path ) const;
+    };
+
+    // declared here, because Easy injects the addresses when a transfer starts
+    struct DnsCache::Pimpl
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        struct Entry
+        {
+            std::vector<std::string>    addresses;
+            std::string                 resolve;        // the addresses for CURLOPT_RESOLVE
+            Clock::time_point           expires;
+            Clock::time_point           refreshAt;      // when it should be resolved (again)
+            bool                        isStatic;
+            bool                        resolving;
+            bool                        used;           // since it was resolved
+        };
+
+        std::chrono::seconds            ttl;
+        size_t                          threads;
+        Resolver                        resolver;
+
+        mutable std::mutex              mutex;
+        std::condition_variable         changed;
+        std::unordered_map<std::string, Entry> entries;
+
+        bool                            stopping;
+        std::thread                     refresher;
+
+        Pimpl( std::chrono::seconds ttl, size_t threads );
+        ~Pimpl();
+
+        Entry &entry( std::string const &host );
+
+        // resolves the hosts on up to threads threads, returns the number of resolved ones
+        size_t resolveAll( std::vector<std::string> const &hosts );
+        bool resolve( std::string const &host );
+
+        void store( Entry &entry, std::vector<std::string> const &addresses, std::chrono::seconds ttl );
+
+        void refreshLoop();
+
+        // sets CURLOPT_RESOLVE of the handle for the host of its URL
+        void inject( CURL *curl, List &resolveList );
+    };
+
     struct Easy::Pimpl
     {
         CURL         *curl;
@@ -77,11 +404,56 @@ namespace curlite
         Event<SslContextHandler>    onSslContext;
         Event<DebugHandler>         onDebug;
 
+        // callables of the templated handlers
+        CallbackSlot                readSlot;
+        CallbackSlot                writeSlot;
+        CallbackSlot                headerSlot;
+
+        // data callbacks as they were set, the digests are computed in between
+        curl_write_callback         writeFunction;
+        void                       *writeData;
+        curl_read_callback          readFunction;
+        void                       *readData;
+
+        std::vector<Digest*>        downloadDigests;
+        std::vector<Digest*>        uploadDigests;
+
+        // bandwidth limit, the multi session which runs the transfer and pause bits
+        RateLimiter::Pimpl         *limiter;
+        size_t                      limiterClass;
+        void                       *owner;
+        int                         userPaused;
+        int                         throttled;
+
+        Metrics::Pimpl             *metrics;
+
+        WireCapture::Pimpl         *wire;
+        uint32_t                    wireTransfer;
+
+        DnsCache::Pimpl            *dns;
+        List                        resolveList;
+
         Pimpl();
 
+        // prepares the transfer before it starts
+        void starting();
+
+        // records the result of the completed transfer
+        void completed( CURLcode result );
+
+        void resetHandlers();
+
+        // returns expected size of the body or -1 if it's unknown yet
+        curl_off_t contentLength() const;
+
+        template <class Container>
+        auto containerWriter( Container &body );
+
         // static cURL callbacks
         static size_t read( char *data, size_t size, size_t n, void *userPtr );
         static size_t write( char *data, size_t size, size_t n, void *userPtr );
+        static size_t tappedWrite( char *data, size_t size, size_t n, void *userPtr );
+        static size_t tappedRead( char *data, size_t size, size_t n, void *userPtr );
         static size_t header( char *data, size_t size, size_t n, void *userPtr );
         static int seek( void *userPtr, curl_off_t offset, int origin );
         static int fnMatch( void *userPtr, const char *pattern, const char *string );
@@ -110,6 +482,137 @@ namespace curlite
         err = CURLE_OK;
         userData = nullptr;
         throwExceptions = true;
+
+        writeFunction = nullptr;
+        writeData = nullptr;
+        readFunction = nullptr;
+        readData = nullptr;
+
+        limiter = nullptr;
+        limiterClass = 0;
+        owner = nullptr;
+        userPaused = 0;
+        throttled = 0;
+
+        metrics = nullptr;
+
+        wire = nullptr;
+        wireTransfer = 0;
+
+        dns = nullptr;
+    }
+
+    void Easy::Pimpl::resetHandlers()
+    {
+        onRead          = Event<ReadHandler>();
+        onWrite         = Event<WriteHandler>();
+        onHeader        = Event<WriteHandler>();
+        onIoctl         = Event<IoctlHandler>();
+        onSeek          = Event<SeekHandler>();
+        onFnMatch       = Event<FnMatchHandler>();
+        onProgress      = Event<ProgressHandler>();
+        onXferInfo      = Event<XferInfoHandler>();
+        onChunkBegin    = Event<ChunkBeginHandler>();
+        onChunkEnd      = Event<ChunkEndHandler>();
+        onSockOpt       = Event<SockOptHandler>();
+        onOpenSocket    = Event<OpenSocketHandler>();
+        onCloseSocket   = Event<CloseSocketHandler>();
+        onSslContext    = Event<SslContextHandler>();
+        onDebug         = Event<DebugHandler>();
+
+        readSlot.reset();
+        writeSlot.reset();
+        headerSlot.reset();
+
+        writeFunction = nullptr;
+        writeData = nullptr;
+        readFunction = nullptr;
+        readData = nullptr;
+
+        downloadDigests.clear();
+        uploadDigests.clear();
+
+        // a rate limiter would resume the next transfer with the pause bits of the previous one
+        limiter = nullptr;
+        limiterClass = 0;
+        userPaused = 0;
+        throttled = 0;
+
+        metrics = nullptr;
+        wire = nullptr;
+        dns = nullptr;
+    }
+
+    void Easy::Pimpl::starting()
+    {
+        // every transfer of a reused handle has its own id in the recorded events
+        if( wire ) {
+            wireTransfer = wire->nextTransfer.fetch_add( 1, std::memory_order_relaxed );
+        }
+
+        if( dns ) {
+            dns->inject( curl, resolveList );
+        }
+    }
+
+    void Easy::Pimpl::completed( CURLcode result )
+    {
+        if( metrics ) {
+            metrics->record( curl, result );
+        }
+
+        if( wire && result != CURLE_OK )
+        {
+            std::string path;
+            {
+                std::lock_guard<std::mutex> lock( wire->mutex );
+                path = wire->errorPath;
+            }
+
+            if( !path.empty() ) {
+                wire->write( path );
+            }
+        }
+    }
+
+    curl_off_t Easy::Pimpl::contentLength() const
+    {
+        return contentLengthOf( curl );
+    }
+
+    // don't trust Content-Length blindly, larger bodies just grow as usual
+    static const curl_off_t kMaxReservedBody = curl_off_t( 1 ) << 30;
+
+    template <class Container>
+    auto Easy::Pimpl::containerWriter( Container &body )
+    {
+        body.clear();
+
+        // headers are already parsed when the first chunk of the body arrives
+        bool firstChunk = true;
+
+        return [this, &body, firstChunk] ( char *data, size_t size, size_t n, void * ) mutable -> size_t
+        {
+            try
+            {
+                if( firstChunk )
+                {
+                    firstChunk = false;
+
+                    curl_off_t length = contentLength();
+                    if( length > 0 && length <= kMaxReservedBody ) {
+                        body.reserve( body.size() + size_t( length ) );
+                    }
+                }
+
+                body.insert( body.end(), data, data + size * n );
+            }
+            catch( std::exception & ) {
+                return 0;
+            }
+
+            return size * n;
+        };
     }
 
     size_t Easy::Pimpl::read( char *data, size_t size, size_t n, void *userPtr )
@@ -138,6 +641,65 @@ namespace curlite
         return 0;
     }
 
+    size_t Easy::Pimpl::tappedWrite( char *data, size_t size, size_t n, void *userPtr )
+    {
+        auto impl = reinterpret_cast<Easy::Pimpl*>( userPtr );
+
+        // the data is held back by the limiter, cURL passes it again once the transfer is resumed
+        if( impl->limiter && !impl->limiter->acquire( impl, RateLimiter::Download, size * n ) ) {
+            return CURL_WRITEFUNC_PAUSE;
+        }
+
+        // cURL writes to a file (stdout by default) without a callback
+        size_t written = impl->writeFunction ? impl->writeFunction( data, size, n, impl->writeData )
+                                             : fwrite( data, size, n, impl->writeData ? (FILE*) impl->writeData : stdout ) * size;
+
+        // paused data is passed again later
+        if( written == CURL_WRITEFUNC_PAUSE )
+        {
+            if( impl->limiter ) {
+                impl->limiter->refund( RateLimiter::Download, size * n );
+            }
+
+            return written;
+        }
+
+        for( auto it = impl->downloadDigests.begin(); it != impl->downloadDigests.end(); ++it ) {
+            (*it)->update( data, std::min( written, size * n ) );
+        }
+
+        return written;
+    }
+
+    size_t Easy::Pimpl::tappedRead( char *data, size_t size, size_t n, void *userPtr )
+    {
+        auto impl = reinterpret_cast<Easy::Pimpl*>( userPtr );
+
+        if( impl->limiter && !impl->limiter->acquire( impl, RateLimiter::Upload, size * n ) ) {
+            return CURL_READFUNC_PAUSE;
+        }
+
+        // cURL reads from a file (stdin by default) without a callback
+        size_t read = impl->readFunction ? impl->readFunction( data, size, n, impl->readData )
+                                         : fread( data, size, n, impl->readData ? (FILE*) impl->readData : stdin ) * size;
+
+        bool hasData = read != CURL_READFUNC_ABORT && read != CURL_READFUNC_PAUSE;
+
+        // the tokens are taken for the whole buffer, the unused part is given back
+        if( impl->limiter ) {
+            impl->limiter->refund( RateLimiter::Upload, hasData ? size * n - std::min( read, size * n ) : size * n );
+        }
+
+        if( hasData )
+        {
+            for( auto it = impl->uploadDigests.begin(); it != impl->uploadDigests.end(); ++it ) {
+                (*it)->update( data, std::min( read, size * n ) );
+            }
+        }
+
+        return read;
+    }
+
     size_t Easy::Pimpl::header( char *data, size_t size, size_t n, void *userPtr )
     {
         if( auto impl = reinterpret_cast<Easy::Pimpl*>( userPtr ) )
@@ -298,6 +860,10 @@ namespace curlite
     {
         if( auto impl = reinterpret_cast<Easy::Pimpl*>( userPtr ) )
         {
+            if( impl->wire ) {
+                impl->wire->record( impl->wireTransfer, type, data, size );
+            }
+
             auto &ev = impl->onDebug;
             if( ev.handler ) {
                 ev.handler( nullptr, type, data, size, ev.data );
@@ -376,81 +942,233 @@ namespace curlite
         return perform();
     }
 
-    CURL *Easy::release()
+    bool Easy::operator >> ( std::string &body )
     {
-        CURL *curl = nullptr;
-        if( _impl ) {
-            std::swap( _impl->curl, curl );
-        }
-
-        return curl;
+        writeTo( body );
+        return perform();
     }
 
-    void Easy::reset()
+    bool Easy::operator >> ( std::vector<char> &body )
     {
-        curl_easy_reset( _impl->curl );
-
-        _impl->err = CURLE_OK;
-
-        onRead();
-        onWrite();
-        onHeader();
-        onProgress();
-        onDebug();
+        writeTo( body );
+        return perform();
     }
 
-    bool Easy::perform()
+    void Easy::writeTo( std::string &body )
     {
-        return handleError(
-            curl_easy_perform( _impl->curl )
-        );
+        onWrite( _impl->containerWriter( body ) );
     }
 
-    size_t Easy::send( const char *buffer, size_t bufferSize )
+    void Easy::writeTo( std::vector<char> &body )
     {
-        size_t sent = 0;
-        auto err = curl_easy_send( _impl->curl, buffer, bufferSize, &sent );
-        return handleError( err ) ? sent : 0;
+        onWrite( _impl->containerWriter( body ) );
     }
 
-    size_t Easy::recv( char *buffer, size_t bufferSize )
+    void Easy::writeTo( char *buffer, size_t bufferSize, size_t &bytesWritten )
     {
-        size_t received = 0;
-        auto err = curl_easy_recv( _impl->curl, buffer, bufferSize, &received );
-        return handleError( err ) ? received : 0;
-    }
+        auto impl = _impl.get();
+        bool firstChunk = true;
 
-    bool Easy::pause( int bitmask )
-    {
-        return handleError(
-            curl_easy_pause( _impl->curl, bitmask )
-        );
-    }
+        bytesWritten = 0;
 
-    CURL* Easy::get() const
-    {
-        return _impl->curl;
+        onWrite( [impl, buffer, bufferSize, &bytesWritten, firstChunk] ( char *data, size_t size, size_t n, void * ) mutable -> size_t
+        {
+            // fail early if the whole body obviously doesn't fit
+            if( firstChunk ) {
+                firstChunk = false;
+                if( impl->contentLength() > curl_off_t( bufferSize ) ) {
+                    return 0;
+                }
+            }
+
+            if( size * n > bufferSize - bytesWritten ) {
+                return 0;
+            }
+
+            std::memcpy( buffer + bytesWritten, data, size * n );
+            bytesWritten += size * n;
+
+            return size * n;
+        } );
     }
 
-    void Easy::setExceptionMode( bool throwExceptions )
+    void Easy::collectHeaders( Headers &headers )
     {
-        _impl->throwExceptions = throwExceptions;
+        headers.clear();
+
+        onHeader_( [&headers] ( char *data, size_t size ) -> bool
+        {
+            try {
+                headers.append( data, size );
+            }
+            catch( std::exception & ) {
+                return false;
+            }
+
+            return true;
+        } );
     }
 
-    bool Easy::exceptionMode() const
+    void Easy::writeTo( Framer &framer )
     {
-        return _impl->throwExceptions;
+        framer.reset();
+
+        onWrite_( [&framer] ( char *data, size_t size ) -> bool
+        {
+            try {
+                return framer.feed( data, size );
+            }
+            catch( std::exception & ) {
+                return false;
+            }
+        } );
     }
 
-    CURLcode Easy::error() const
+    bool Easy::operator >> ( Framer &framer )
     {
-        return _impl->err;
+        writeTo( framer );
+        return perform() && handleError( framer.finish() ? CURLE_OK : CURLE_WRITE_ERROR );
     }
 
-    std::string Easy::errorString() const
+#ifdef __linux__
+
+    void Easy::writeTo( FileSink &file )
     {
-        return curl_easy_strerror( _impl->err );
-    }
+        auto impl = _impl.get();
+        bool firstChunk = true;
+
+        onWrite( [impl, &file, firstChunk] ( char *data, size_t size, size_t n, void * ) mutable -> size_t
+        {
+            if( firstChunk ) {
+                firstChunk = false;
+
+                curl_off_t length = impl->contentLength();
+                if( length > 0 ) {
+                    file.reserve( file.size() + length );
+                }
+            }
+
+            return file.write( data, size * n ) ? size * n : 0;
+        } );
+    }
+
+    bool Easy::operator >> ( FileSink &file )
+    {
+        writeTo( file );
+        return perform() && handleError( file.commit() ? CURLE_OK : CURLE_WRITE_ERROR );
+    }
+
+#endif
+
+    CURL *Easy::release()
+    {
+        CURL *curl = nullptr;
+        if( _impl ) {
+            std::swap( _impl->curl, curl );
+        }
+
+        return curl;
+    }
+
+    void Easy::reset()
+    {
+        // curl_easy_reset() drops all the callbacks, so handlers are just forgotten
+        curl_easy_reset( _impl->curl );
+
+        _impl->err = CURLE_OK;
+        _impl->resetHandlers();
+
+        // install default options
+        set( CURLOPT_USERAGENT, "curlite::Easy" );
+    }
+
+    bool Easy::perform()
+    {
+        _impl->starting();
+
+        CURLcode result = curl_easy_perform( _impl->curl );
+        _impl->completed( result );
+
+        return handleError( result );
+    }
+
+    Result<void> Easy::tryPerform()
+    {
+        _impl->starting();
+
+        CURLcode result = curl_easy_perform( _impl->curl );
+        _impl->completed( result );
+
+        return storeError( result );
+    }
+
+    size_t Easy::send( const char *buffer, size_t bufferSize )
+    {
+        size_t sent = 0;
+        auto err = curl_easy_send( _impl->curl, buffer, bufferSize, &sent );
+        return handleError( err ) ? sent : 0;
+    }
+
+    size_t Easy::recv( char *buffer, size_t bufferSize )
+    {
+        size_t received = 0;
+        auto err = curl_easy_recv( _impl->curl, buffer, bufferSize, &received );
+        return handleError( err ) ? received : 0;
+    }
+
+    Result<size_t> Easy::trySend( const char *buffer, size_t bufferSize )
+    {
+        size_t sent = 0;
+        auto err = curl_easy_send( _impl->curl, buffer, bufferSize, &sent );
+        return Result<size_t>( storeError( err ), sent );
+    }
+
+    Result<size_t> Easy::tryRecv( char *buffer, size_t bufferSize )
+    {
+        size_t received = 0;
+        auto err = curl_easy_recv( _impl->curl, buffer, bufferSize, &received );
+        return Result<size_t>( storeError( err ), received );
+    }
+
+    bool Easy::pause( int bitmask )
+    {
+        // the directions paused by the rate limiter stay paused until it resumes them
+        _impl->userPaused = bitmask;
+
+        return handleError(
+            curl_easy_pause( _impl->curl, bitmask | _impl->throttled )
+        );
+    }
+
+    CURL* Easy::get() const
+    {
+        return _impl->curl;
+    }
+
+    void Easy::setExceptionMode( bool throwExceptions )
+    {
+        _impl->throwExceptions = throwExceptions;
+    }
+
+    bool Easy::exceptionMode() const
+    {
+        return _impl->throwExceptions;
+    }
+
+    CURLcode Easy::error() const
+    {
+        return _impl->err;
+    }
+
+    std::string Easy::errorString() const
+    {
+        return curl_easy_strerror( _impl->err );
+    }
+
+    CURLcode Easy::storeError( CURLcode code )
+    {
+        return _impl->err = code;
+    }
 
     bool Easy::handleError( CURLcode code )
     {
@@ -463,6 +1181,188 @@ namespace curlite
         return _impl->err == CURLE_OK;
     }
 
+    CallbackSlot &Easy::resetCallback( CURLoption function )
+    {
+        switch( function )
+        {
+        case CURLOPT_READFUNCTION:
+            _impl->onRead = Event<ReadHandler>();
+            _impl->readSlot.reset();
+            return _impl->readSlot;
+
+        case CURLOPT_WRITEFUNCTION:
+            _impl->onWrite = Event<WriteHandler>();
+            _impl->writeSlot.reset();
+            return _impl->writeSlot;
+
+        case CURLOPT_HEADERFUNCTION:
+            _impl->onHeader = Event<WriteHandler>();
+            _impl->headerSlot.reset();
+            return _impl->headerSlot;
+
+        default:
+            throw Exception( "the option doesn't support templated handlers" );
+        }
+    }
+
+    void Easy::setWriteFunction( curl_write_callback function, void *data )
+    {
+        _impl->writeFunction = function;
+        _impl->writeData = data;
+
+        handleError( storeError( applyDataFunctions() ) );
+    }
+
+    void Easy::setReadFunction( curl_read_callback function, void *data )
+    {
+        _impl->readFunction = function;
+        _impl->readData = data;
+
+        handleError( storeError( applyDataFunctions() ) );
+    }
+
+    CURLcode Easy::setDataOption( CURLoption key, void *data, curl_write_callback function )
+    {
+        switch( key )
+        {
+        case CURLOPT_WRITEFUNCTION: _impl->writeFunction = function; break;
+        case CURLOPT_WRITEDATA:     _impl->writeData = data;         break;
+        case CURLOPT_READFUNCTION:  _impl->readFunction = function;  break;
+        case CURLOPT_READDATA:      _impl->readData = data;          break;
+
+        default:
+            return CURLE_BAD_FUNCTION_ARGUMENT;
+        }
+
+        return applyDataFunctions();
+    }
+
+    CURLcode Easy::applyDataFunctions()
+    {
+        auto impl = _impl.get();
+        bool tapWrite = !impl->downloadDigests.empty() || impl->limiter;
+        bool tapRead = !impl->uploadDigests.empty() || impl->limiter;
+
+        // without a callback cURL uses the data as FILE*, stdout and stdin are its defaults
+        void *writeData = impl->writeFunction || impl->writeData ? impl->writeData : (void*) stdout;
+        void *readData = impl->readFunction || impl->readData ? impl->readData : (void*) stdin;
+
+        CURLcode codes[] = {
+            curl_easy_setopt( get(), CURLOPT_WRITEFUNCTION, tapWrite ? &Pimpl::tappedWrite : impl->writeFunction ),
+            curl_easy_setopt( get(), CURLOPT_WRITEDATA, tapWrite ? (void*) impl : writeData ),
+            curl_easy_setopt( get(), CURLOPT_READFUNCTION, tapRead ? &Pimpl::tappedRead : impl->readFunction ),
+            curl_easy_setopt( get(), CURLOPT_READDATA, tapRead ? (void*) impl : readData )
+        };
+
+        for( auto code : codes ) {
+            if( code != CURLE_OK ) {
+                return code;
+            }
+        }
+
+        return CURLE_OK;
+    }
+
+    CURLcode Easy::applyDebugFunction()
+    {
+        auto impl = _impl.get();
+        bool enabled = impl->onDebug.handler || impl->wire;
+
+        CURLcode codes[] = {
+            curl_easy_setopt( get(), CURLOPT_DEBUGFUNCTION, enabled ? &Pimpl::debug : nullptr ),
+            curl_easy_setopt( get(), CURLOPT_DEBUGDATA, enabled ? (void*) impl : nullptr ),
+            curl_easy_setopt( get(), CURLOPT_VERBOSE, enabled ? 1L : 0L )
+        };
+
+        for( auto code : codes ) {
+            if( code != CURLE_OK ) {
+                return code;
+            }
+        }
+
+        return CURLE_OK;
+    }
+
+    void Easy::digestDownload( Digest &digest )
+    {
+        _impl->downloadDigests.push_back( &digest );
+        handleError( storeError( applyDataFunctions() ) );
+    }
+
+    void Easy::digestUpload( Digest &digest )
+    {
+        _impl->uploadDigests.push_back( &digest );
+        handleError( storeError( applyDataFunctions() ) );
+    }
+
+    void Easy::clearDigests()
+    {
+        _impl->downloadDigests.clear();
+        _impl->uploadDigests.clear();
+
+        handleError( storeError( applyDataFunctions() ) );
+    }
+
+    void Easy::throttle( RateLimiter &limiter, size_t transferClass )
+    {
+        if( _impl->owner ) {
+            throw Exception( "the transfer is running, it can't be throttled" );
+        }
+
+        _impl->limiter = limiter._impl.get();
+        _impl->limiterClass = transferClass;
+
+        handleError( storeError( applyDataFunctions() ) );
+    }
+
+    void Easy::unthrottle()
+    {
+        if( _impl->owner ) {
+            throw Exception( "the transfer is running, it can't be unthrottled" );
+        }
+
+        _impl->limiter = nullptr;
+
+        handleError( storeError( applyDataFunctions() ) );
+    }
+
+    void Easy::collectMetrics( Metrics &metrics )
+    {
+        _impl->metrics = metrics._impl.get();
+    }
+
+    void Easy::clearMetrics()
+    {
+        _impl->metrics = nullptr;
+    }
+
+    void Easy::captureWire( WireCapture &capture )
+    {
+        _impl->wire = capture._impl.get();
+
+        handleError( storeError( applyDebugFunction() ) );
+    }
+
+    void Easy::clearWireCapture()
+    {
+        _impl->wire = nullptr;
+
+        handleError( storeError( applyDebugFunction() ) );
+    }
+
+    void Easy::useDnsCache( DnsCache &cache )
+    {
+        _impl->dns = cache._impl.get();
+    }
+
+    void Easy::clearDnsCache()
+    {
+        _impl->dns = nullptr;
+        _impl->resolveList = List();
+
+        handleError( storeError( curl_easy_setopt( get(), CURLOPT_RESOLVE, (curl_slist*) nullptr ) ) );
+    }
+
     void Easy::setUserData( void *data )
     {
         _impl->userData = data;
@@ -538,24 +1438,25 @@ namespace curlite
 
     void Easy::onRead( ReadHandler f, void *data )
     {
+        _impl->readSlot.reset();
         _impl->onRead.handler = f;
         _impl->onRead.data = data;
 
-        set( CURLOPT_READFUNCTION, f ? &Pimpl::read : nullptr );
-        set( CURLOPT_READDATA, f ? (void*) this->_impl.get() : nullptr );
+        setReadFunction( f ? &Pimpl::read : nullptr, f ? (void*) this->_impl.get() : nullptr );
     }
 
     void Easy::onWrite( WriteHandler f, void *data )
     {
+        _impl->writeSlot.reset();
         _impl->onWrite.handler = f;
         _impl->onWrite.data = data;
 
-        set( CURLOPT_WRITEFUNCTION, f ? &Pimpl::write : nullptr );
-        set( CURLOPT_WRITEDATA, f ? (void*) this->_impl.get() : nullptr );
+        setWriteFunction( f ? &Pimpl::write : nullptr, f ? (void*) this->_impl.get() : nullptr );
     }
 
     void Easy::onHeader( WriteHandler f, void *data)
     {
+        _impl->headerSlot.reset();
         _impl->onHeader.handler = f;
         _impl->onHeader.data = data;
 
@@ -578,9 +1479,7 @@ namespace curlite
         _impl->onDebug.handler = f;
         _impl->onDebug.data = data;
 
-        set( CURLOPT_DEBUGFUNCTION, f ? &Pimpl::debug : nullptr );
-        set( CURLOPT_DEBUGDATA, f ? (void*) this->_impl.get() : nullptr );
-        set( CURLOPT_VERBOSE, f ? true : false );
+        handleError( storeError( applyDebugFunction() ) );
     }
 
     void Easy::onIoctl( IoctlHandler f, void *data)
@@ -686,207 +1585,6686 @@ namespace curlite
         return stream;
     }
 
-    /* Definition of curlite::List
+    /* Definition of curlite::Multi
      */
 
-    List::List( curl_slist *list )
-        : _list( list )
+    struct Multi::Pimpl
+    {
+        struct Transfer
+        {
+            std::unique_ptr<Easy> easy;
+            bool active;
+        };
+
+        CURLM        *multi;
+        CURLMcode     err;
+        bool          throwExceptions;
+        int           running;
+
+        std::unordered_map<CURL*, Transfer> transfers;
+
+        // rate limiters of the running transfers with the number of transfers
+        std::unordered_map<RateLimiter::Pimpl*, size_t> limiters;
+
+        Pimpl();
+
+        Transfer *find( Easy *easy );
+        void detachAll();
+
+        void started( Easy *easy );
+        void stopped( Easy *easy );
+    };
+
+    Multi::Pimpl::Pimpl()
     {
+        multi = nullptr;
+        err = CURLM_OK;
+        throwExceptions = true;
+        running = 0;
     }
 
-    List::List( std::vector<std::string> const &values )
-        : _list( nullptr )
+    Multi::Pimpl::Transfer *Multi::Pimpl::find( Easy *easy )
     {
-        append( values );
+        if( easy == nullptr ) {
+            return nullptr;
+        }
+
+        auto it = transfers.find( easy->get() );
+        return it != transfers.end() && it->second.easy.get() == easy ? &it->second : nullptr;
     }
 
-    List::~List()
+    void Multi::Pimpl::detachAll()
     {
-        if( auto ptr = release() ) {
-            curl_slist_free_all( ptr );
+        for( auto it = transfers.begin(); it != transfers.end(); ++it )
+        {
+            if( it->second.active ) {
+                curl_multi_remove_handle( multi, it->first );
+                stopped( it->second.easy.get() );
+            }
         }
+
+        transfers.clear();
+        running = 0;
     }
 
-    List::List( List &&other )
-        : _list( nullptr )
+    void Multi::Pimpl::started( Easy *easy )
     {
-        *this = std::move( other );
+        auto impl = easy->_impl.get();
+        impl->owner = this;
+
+        if( impl->limiter ) {
+            limiters[impl->limiter]++;
+        }
     }
 
-    List &List::operator = ( List &&other )
+    void Multi::Pimpl::stopped( Easy *easy )
     {
-        if( this != &other )
+        auto impl = easy->_impl.get();
+        impl->owner = nullptr;
+        impl->throttled = 0;
+
+        if( impl->limiter )
         {
-            if( auto ptr = release() ) {
-                curl_slist_free_all( ptr );
+            impl->limiter->forget( impl );
+
+            auto it = limiters.find( impl->limiter );
+            if( it != limiters.end() && --it->second == 0 ) {
+                limiters.erase( it );
             }
-            
-            std::swap( _list, other._list );
         }
-
-        return *this;
     }
 
-    curl_slist *List::get() const
+    Multi::Multi()
+        : _impl( new Pimpl() )
     {
-        return _list;
+        _impl->multi = curl_multi_init();
+
+        if( _impl->multi == nullptr ) {
+            throw Exception( "can't init curl_multi interface" );
+        }
     }
 
-    curl_slist *List::release()
+    Multi::Multi( Multi &&other )
     {
-        curl_slist *list = nullptr;
-        std::swap( list, _list );
-        return list;
+        *this = std::move( other );
     }
 
-    List &List::append( char const *s )
+    Multi::~Multi()
     {
-        _list = curl_slist_append( _list, s );
-        return *this;
+        if( auto ptr = release() ) {
+            curl_multi_cleanup( ptr );
+        }
     }
 
-    List &List::append( std::vector<std::string> const &values )
+    Multi &Multi::operator = ( Multi &&other )
     {
-        for( auto it = values.begin(); it != values.end(); ++it ) {
-            append( it->c_str() );
+        if( this != &other )
+        {
+            if( auto ptr = release() ) {
+                curl_multi_cleanup( ptr );
+            }
+
+            _impl.swap( other._impl );
         }
 
         return *this;
     }
 
-    List &List::operator << ( char const *s )
+    Multi::operator bool() const
     {
-        return append( s );
+        return _impl->err == CURLM_OK;
     }
 
-    /* Definition of curlite::Form
-     */
-
-    Form::Form() : _first( nullptr ), _last( nullptr )
+    CURLM *Multi::release()
     {
-    }
+        CURLM *multi = nullptr;
+        if( _impl ) {
+            // easy handles must be removed before the multi handle is cleaned up
+            _impl->detachAll();
+            std::swap( _impl->multi, multi );
+        }
 
-    Form::Form( std::vector<curl_forms> const &forms )
-        : _first( nullptr ), _last( nullptr )
+        return multi;
+    }
+
+    CURLM *Multi::get() const
     {
-        add( forms );
+        return _impl->multi;
     }
 
-    Form::Form( Form &&other )
-        : _first( nullptr ), _last( nullptr )
+    void Multi::setExceptionMode( bool throwExceptions )
     {
-        std::swap( _first, other._first );
-        std::swap( _last, other._last );
+        _impl->throwExceptions = throwExceptions;
     }
 
-    Form::~Form()
+    bool Multi::exceptionMode() const
     {
-        if( auto ptr = release().first ) {
-            curl_formfree( ptr );
+        return _impl->throwExceptions;
+    }
+
+    CURLMcode Multi::error() const
+    {
+        return _impl->err;
+    }
+
+    std::string Multi::errorString() const
+    {
+        return curl_multi_strerror( _impl->err );
+    }
+
+    bool Multi::handleError( CURLMcode code )
+    {
+        _impl->err = code;
+
+        if( _impl->err != CURLM_OK && _impl->throwExceptions ) {
+            throw Exception( curl_multi_strerror(_impl->err) );
         }
+
+        return _impl->err == CURLM_OK;
     }
 
-    Form &Form::operator = ( Form &&other )
+    Easy *Multi::add( Easy &&easy )
     {
-        if( this != &other )
+        CURL *curl = easy.get();
+        if( curl == nullptr || _impl->transfers.count( curl ) ) {
+            handleError( CURLM_BAD_EASY_HANDLE );
+            return nullptr;
+        }
+
+        easy._impl->starting();
+
+        if( !handleError( curl_multi_add_handle( _impl->multi, curl ) ) ) {
+            return nullptr;
+        }
+
+        // Easy::Pimpl (callback userdata) is moved along with the handle, so callbacks remain valid
+        auto &transfer = _impl->transfers[curl];
+        transfer.easy.reset( new Easy( std::move( easy ) ) );
+        transfer.easy->_impl->err = CURLE_OK;
+        transfer.active = true;
+        _impl->running++;
+        _impl->started( transfer.easy.get() );
+
+        return transfer.easy.get();
+    }
+
+    Easy Multi::remove( Easy *easy )
+    {
+        auto transfer = _impl->find( easy );
+        if( transfer == nullptr ) {
+            handleError( CURLM_BAD_EASY_HANDLE );
+            return Easy();
+        }
+
+        CURL *curl = easy->get();
+        if( transfer->active ) {
+            transfer->active = false;
+            _impl->running--;
+            handleError( curl_multi_remove_handle( _impl->multi, curl ) );
+            _impl->stopped( easy );
+        }
+
+        Easy result( std::move( *easy ) );
+        _impl->transfers.erase( curl );
+
+        return result;
+    }
+
+    size_t Multi::size() const
+    {
+        return _impl->transfers.size();
+    }
+
+    size_t Multi::running() const
+    {
+        return size_t( _impl->running );
+    }
+
+    size_t Multi::perform()
+    {
+        resumeThrottled();
+
+        int stillRunning = 0;
+        handleError( curl_multi_perform( _impl->multi, &stillRunning ) );
+        return size_t( stillRunning );
+    }
+
+    size_t Multi::socketAction( curl_socket_t socket, int events )
+    {
+        int stillRunning = 0;
+        handleError( curl_multi_socket_action( _impl->multi, socket, events, &stillRunning ) );
+        return size_t( stillRunning );
+    }
+
+    bool Multi::poll( int timeoutMs )
+    {
+        // don't oversleep the moment when a throttled transfer may continue
+        int throttledMs = resumeThrottled();
+        if( throttledMs >= 0 && throttledMs < timeoutMs ) {
+            timeoutMs = throttledMs;
+        }
+
+#if LIBCURL_VERSION_NUM >= 0x074200
+        return handleError( curl_multi_poll( _impl->multi, nullptr, 0, timeoutMs, nullptr ) );
+#else
+        return handleError( curl_multi_wait( _impl->multi, nullptr, 0, timeoutMs, nullptr ) );
+#endif
+    }
+
+    bool Multi::wakeup()
+    {
+#if LIBCURL_VERSION_NUM >= 0x074400
+        return handleError( curl_multi_wakeup( _impl->multi ) );
+#else
+        return handleError( CURLM_UNKNOWN_OPTION );
+#endif
+    }
+
+    int Multi::resumeThrottled()
+    {
+        int timeoutMs = -1;
+
+        for( auto it = _impl->limiters.begin(); it != _impl->limiters.end(); ++it )
         {
-            if( auto ptr = release().first ) {
-                curl_formfree( ptr );
+            int limiterMs = it->first->resume( _impl.get() );
+            if( limiterMs >= 0 && ( timeoutMs < 0 || limiterMs < timeoutMs ) ) {
+                timeoutMs = limiterMs;
             }
-            
-            std::swap( _first, other._first );
-            std::swap( _last, other._last );
         }
 
-        return *this;
+        return timeoutMs;
     }
 
-    curl_httppost *Form::get() const
+    Easy *Multi::next()
     {
-        return _first;
+        int messagesLeft = 0;
+        while( CURLMsg *msg = curl_multi_info_read( _impl->multi, &messagesLeft ) )
+        {
+            if( msg->msg != CURLMSG_DONE ) {
+                continue;
+            }
+
+            auto it = _impl->transfers.find( msg->easy_handle );
+            if( it == _impl->transfers.end() || !it->second.active ) {
+                continue;
+            }
+
+            // read the result before the handle is removed, msg is invalidated by the removal
+            CURLcode result = msg->data.result;
+
+            it->second.active = false;
+            _impl->running--;
+            curl_multi_remove_handle( _impl->multi, msg->easy_handle );
+
+            Easy *easy = it->second.easy.get();
+            _impl->stopped( easy );
+            easy->_impl->err = result;
+            easy->_impl->completed( result );
+
+            return easy;
+        }
+
+        return nullptr;
     }
 
-    std::pair<curl_httppost*, curl_httppost*> Form::release()
+    bool Multi::run( CompletionHandler onDone )
     {
-        auto r = std::make_pair<curl_httppost*, curl_httppost*>( nullptr, nullptr );
+        while( _impl->running > 0 )
+        {
+            size_t stillRunning = perform();
+            if( !*this ) {
+                return false;
+            }
 
-        std::swap( r.first, _first );
-        std::swap( r.second, _last );
-        
-        return r;
+            while( Easy *easy = next() )
+            {
+                if( onDone ) {
+                    onDone( *easy );
+                }
+            }
+
+            if( stillRunning > 0 && !poll() ) {
+                return false;
+            }
+        }
+
+        return true;
     }
 
-    bool Form::add( std::vector<curl_forms> const &forms )
+#ifdef __linux__
+
+    /* Definition of curlite::EventLoop
+     */
+
+    struct EventLoop::Pimpl
     {
-        auto err = curl_formadd( &_first, &_last, CURLFORM_ARRAY, forms.data(), CURLFORM_END );
-        return err == CURL_FORMADD_OK;
+        typedef std::chrono::steady_clock Clock;
+
+        Multi             multi;
+        int               epoll;
+        int               wakeupFd;
+        bool              timerArmed;
+        Clock::time_point deadline;
+
+        Pimpl();
+        ~Pimpl();
+
+        int timeoutMs( int maxTimeoutMs ) const;
+
+        // static cURL callbacks
+        static int socket( CURL *easy, curl_socket_t socket, int what, void *userPtr, void *socketPtr );
+        static int timer( CURLM *multi, long timeoutMs, void *userPtr );
+    };
+
+    EventLoop::Pimpl::Pimpl()
+    {
+        epoll = epoll_create1( EPOLL_CLOEXEC );
+        wakeupFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+        timerArmed = false;
+
+        if( epoll < 0 || wakeupFd < 0 )
+        {
+            if( epoll >= 0 ) {
+                close( epoll );
+            }
+
+            if( wakeupFd >= 0 ) {
+                close( wakeupFd );
+            }
+
+            throw Exception( "can't init epoll" );
+        }
+
+        epoll_event ev = epoll_event();
+        ev.events = EPOLLIN;
+        ev.data.fd = wakeupFd;
+        epoll_ctl( epoll, EPOLL_CTL_ADD, wakeupFd, &ev );
+
+        multi.set( CURLMOPT_SOCKETFUNCTION, &Pimpl::socket );
+        multi.set( CURLMOPT_SOCKETDATA, (void*) this );
+        multi.set( CURLMOPT_TIMERFUNCTION, &Pimpl::timer );
+        multi.set( CURLMOPT_TIMERDATA, (void*) this );
     }
 
-    /* Other functions
-     */
+    EventLoop::Pimpl::~Pimpl()
+    {
+        // removing of easy handles calls socket callback, so epoll must still be alive
+        if( auto ptr = multi.release() ) {
+            curl_multi_cleanup( ptr );
+        }
 
-    bool global_init( long flags )
+        if( wakeupFd >= 0 ) {
+            close( wakeupFd );
+        }
+
+        if( epoll >= 0 ) {
+            close( epoll );
+        }
+    }
+
+    int EventLoop::Pimpl::timeoutMs( int maxTimeoutMs ) const
     {
-        return curl_global_init( flags ) == 0;
+        if( !timerArmed ) {
+            return maxTimeoutMs;
+        }
+
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>( deadline - Clock::now() ).count();
+        if( left < 0 ) {
+            left = 0;
+        }
+
+        return maxTimeoutMs < 0 || left < maxTimeoutMs ? int( left ) : maxTimeoutMs;
     }
 
-    void global_cleanup()
+    int EventLoop::Pimpl::socket( CURL *, curl_socket_t socket, int what, void *userPtr, void * )
     {
-        curl_global_cleanup();
+        auto impl = reinterpret_cast<EventLoop::Pimpl*>( userPtr );
+
+        if( what == CURL_POLL_REMOVE ) {
+            epoll_ctl( impl->epoll, EPOLL_CTL_DEL, socket, nullptr );
+            return 0;
+        }
+
+        epoll_event ev = epoll_event();
+        ev.events = ( what & CURL_POLL_IN ? uint32_t( EPOLLIN ) : 0 ) | ( what & CURL_POLL_OUT ? uint32_t( EPOLLOUT ) : 0 );
+        ev.data.fd = socket;
+
+        if( epoll_ctl( impl->epoll, EPOLL_CTL_MOD, socket, &ev ) != 0 && errno == ENOENT ) {
+            epoll_ctl( impl->epoll, EPOLL_CTL_ADD, socket, &ev );
+        }
+
+        return 0;
     }
 
-    std::string version()
+    int EventLoop::Pimpl::timer( CURLM *, long timeoutMs, void *userPtr )
     {
-        return std::string( curl_version() );
+        auto impl = reinterpret_cast<EventLoop::Pimpl*>( userPtr );
+
+        // cURL folds timeouts of all the transfers into a single deadline
+        impl->timerArmed = timeoutMs >= 0;
+        impl->deadline = Clock::now() + std::chrono::milliseconds( timeoutMs );
+
+        return 0;
     }
 
-    curl_version_info_data *versionInfo( CURLversion type )
+    EventLoop::EventLoop()
+        : _impl( new Pimpl() )
     {
-        return curl_version_info( type );
     }
 
-    Easy download( std::string const &url, std::ostream &ostr, bool followRedirect, bool throwExceptions )
+    EventLoop::EventLoop( EventLoop &&other )
     {
-        Easy c;
-        c.setExceptionMode( throwExceptions );
-        c.set( CURLOPT_URL, url );
-        c.set( CURLOPT_FOLLOWLOCATION, followRedirect );
+        *this = std::move( other );
+    }
+
+    EventLoop::~EventLoop()
+    {
+    }
 
-        c >> ostr;
+    EventLoop &EventLoop::operator = ( EventLoop &&other )
+    {
+        if( this != &other ) {
+            _impl.reset();
+            _impl.swap( other._impl );
+        }
 
-        return std::move( c );
+        return *this;
     }
 
-    Easy upload( std::istream &istr,
-                 std::string const &url,
-                 std::string const &username,
-                 std::string const &password,
-                 curl_off_t size,
-                 bool throwExceptions )
+    Multi &EventLoop::multi()
     {
-        Easy c;
-        c.setExceptionMode( throwExceptions );
-        c.set( CURLOPT_URL, url );
-        c.set( CURLOPT_USERNAME, username );
-        c.set( CURLOPT_PASSWORD, password );
-        c.set( CURLOPT_INFILESIZE_LARGE, size );
-        c.set( CURLOPT_UPLOAD, true );
+        return _impl->multi;
+    }
 
-        List headers;
-        if( size == -1 ) {
-            headers << "Transfer-Encoding: chunked";
-            headers << "Expect:";
+    Easy *EventLoop::add( Easy &&easy )
+    {
+        return _impl->multi.add( std::move( easy ) );
+    }
 
-            // if it's not http(s) upload then the option will be ignored
-            c.set( CURLOPT_HTTPHEADER, headers.get() );
+    Easy EventLoop::remove( Easy *easy )
+    {
+        return _impl->multi.remove( easy );
+    }
+
+    size_t EventLoop::running() const
+    {
+        return _impl->multi.running();
+    }
+
+    bool EventLoop::runOnce( int timeoutMs, Multi::CompletionHandler const &onDone )
+    {
+        const int kMaxEvents = 256;
+        epoll_event events[kMaxEvents];
+
+        Multi &multi = _impl->multi;
+
+        // resumed transfers rearm the cURL timer, so they go first
+        int throttledMs = multi.resumeThrottled();
+        int waitMs = _impl->timeoutMs( timeoutMs );
+        if( throttledMs >= 0 && ( waitMs < 0 || throttledMs < waitMs ) ) {
+            waitMs = throttledMs;
         }
 
-        istr >> c;
+        int count = epoll_wait( _impl->epoll, events, kMaxEvents, waitMs );
+        if( count < 0 && errno != EINTR ) {
+            return false;
+        }
 
-        // reset the option to avoid access violation (if a client reuses the Easy object)
-        c.set( CURLOPT_HTTPHEADER, nullptr );
+        for( int i = 0; i < count; ++i )
+        {
+            int fd = events[i].data.fd;
+
+            if( fd == _impl->wakeupFd ) {
+                eventfd_t value;
+                eventfd_read( _impl->wakeupFd, &value );
+                continue;
+            }
+
+            int flags = ( events[i].events & EPOLLIN  ? CURL_CSELECT_IN  : 0 ) |
+                        ( events[i].events & EPOLLOUT ? CURL_CSELECT_OUT : 0 ) |
+                        ( events[i].events & ( EPOLLERR | EPOLLHUP ) ? CURL_CSELECT_ERR : 0 );
+
+            multi.socketAction( fd, flags );
+            if( !multi ) {
+                return false;
+            }
+        }
+
+        if( _impl->timerArmed && _impl->timeoutMs( -1 ) == 0 )
+        {
+            _impl->timerArmed = false;
+            multi.socketAction( CURL_SOCKET_TIMEOUT, 0 );
+            if( !multi ) {
+                return false;
+            }
+        }
+
+        while( Easy *easy = multi.next() )
+        {
+            if( onDone ) {
+                onDone( *easy );
+            }
+        }
+
+        return true;
+    }
+
+    bool EventLoop::run( Multi::CompletionHandler onDone )
+    {
+        while( running() > 0 )
+        {
+            if( !runOnce( -1, onDone ) ) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool EventLoop::wakeup()
+    {
+        return eventfd_write( _impl->wakeupFd, 1 ) == 0;
+    }
+
+#endif
+
+#ifdef CURLITE_COROUTINES
+
+    /* Definition of curlite::Client
+     */
+
+    struct Client::Pimpl
+    {
+#ifdef __linux__
+        EventLoop loop;
+#else
+        Multi multi;
+#endif
+
+        // awaiting transfers by the Easy objects owned by the multi session
+        std::unordered_map<Easy*, Transfer*> transfers;
+
+        // coroutines to resume once the events are processed
+        std::vector<std::coroutine_handle<>> ready;
+
+        struct Spawned
+        {
+            Task<void> task;
+
+            // coroutine which reports the end of the task, it's destroyed when it's done
+            std::coroutine_handle<> watcher;
+        };
+
+        // spawned tasks and the ones of them which are finished, run() doesn't have to check every task
+        std::list<Spawned> spawned;
+        std::deque<std::list<Spawned>::iterator> finished;
+
+        ~Pimpl();
+
+        Multi &multiSession();
+
+        void complete( Easy *easy );
+        void resumeReady();
+    };
+
+    namespace
+    {
+        // fire-and-forget coroutine, which starts a spawned task and reports when it's finished
+        struct SpawnWatcher
+        {
+            struct promise_type
+            {
+                // the watched task is taken from the arguments of watchSpawned()
+                template <class Iterator, class Finished>
+                promise_type( Iterator spawned, Finished & ) noexcept
+                {
+                    spawned->watcher = std::coroutine_handle<promise_type>::from_promise( *this );
+                }
+
+                SpawnWatcher get_return_object() noexcept { return {}; }
+                std::suspend_never initial_suspend() const noexcept { return {}; }
+                std::suspend_never final_suspend() const noexcept { return {}; }
+
+                void return_void() noexcept { }
+                void unhandled_exception() noexcept { }
+            };
+        };
+
+        template <class Iterator, class Finished>
+        SpawnWatcher watchSpawned( Iterator spawned, Finished &finished )
+        {
+            co_await spawned->task.finished();
+
+            spawned->watcher = nullptr;
+            finished.push_back( spawned );
+        }
+    }
+
+    Client::Pimpl::~Pimpl()
+    {
+        // the tasks which are not finished are destroyed together with their watchers
+        for( auto it = spawned.begin(); it != spawned.end(); ++it ) {
+            if( it->watcher ) {
+                it->watcher.destroy();
+            }
+        }
+    }
+
+    Multi &Client::Pimpl::multiSession()
+    {
+#ifdef __linux__
+        return loop.multi();
+#else
+        return multi;
+#endif
+    }
+
+    void Client::Pimpl::complete( Easy *easy )
+    {
+        auto it = transfers.find( easy );
+        if( it == transfers.end() ) {
+            return;
+        }
+
+        Transfer *transfer = it->second;
+        transfers.erase( it );
+
+        *transfer->_easy = multiSession().remove( easy );
+        ready.push_back( transfer->_awaiting );
+    }
+
+    void Client::Pimpl::resumeReady()
+    {
+        // resumed coroutines may start new transfers and complete them right away
+        while( !ready.empty() )
+        {
+            std::vector<std::coroutine_handle<>> resuming;
+            resuming.swap( ready );
+
+            for( auto it = resuming.begin(); it != resuming.end(); ++it ) {
+                it->resume();
+            }
+        }
+    }
+
+    Client::Transfer::Transfer( Pimpl *client, Easy &easy )
+        : _client( client ), _easy( &easy )
+    {
+    }
+
+    bool Client::Transfer::await_suspend( std::coroutine_handle<> awaiting )
+    {
+        Easy *running = _client->multiSession().add( std::move( *_easy ) );
+        if( running == nullptr ) {
+            // the Easy object isn't taken on error, the coroutine just continues
+            _easy->_impl->err = CURLE_FAILED_INIT;
+            return false;
+        }
+
+        _awaiting = awaiting;
+        _client->transfers[running] = this;
+
+        return true;
+    }
+
+    Client::Client()
+        : _impl( new Pimpl() )
+    {
+    }
+
+    Client::Client( Client &&other )
+    {
+        *this = std::move( other );
+    }
+
+    Client::~Client()
+    {
+    }
+
+    Client &Client::operator = ( Client &&other )
+    {
+        if( this != &other ) {
+            _impl.reset();
+            _impl.swap( other._impl );
+        }
+
+        return *this;
+    }
+
+    Multi &Client::multi()
+    {
+        return _impl->multiSession();
+    }
+
+    Client::Transfer Client::fetch( Easy &easy )
+    {
+        return Transfer( _impl.get(), easy );
+    }
+
+    void Client::spawn( Task<void> task )
+    {
+        auto impl = _impl.get();
+
+        impl->spawned.push_back( Pimpl::Spawned { std::move( task ), nullptr } );
+        watchSpawned( std::prev( impl->spawned.end() ), impl->finished );
+    }
+
+    size_t Client::running() const
+    {
+#ifdef __linux__
+        return _impl->loop.running();
+#else
+        return _impl->multi.running();
+#endif
+    }
+
+    bool Client::runOnce( int timeoutMs )
+    {
+        auto impl = _impl.get();
+        auto onDone = [impl] ( Easy &easy ) {
+            impl->complete( &easy );
+        };
+
+#ifdef __linux__
+        bool result = impl->loop.runOnce( timeoutMs, onDone );
+#else
+        Multi &multi = impl->multi;
+
+        size_t stillRunning = multi.perform();
+        while( Easy *easy = multi.next() ) {
+            onDone( *easy );
+        }
+
+        bool result = multi && ( stillRunning == 0 || !impl->ready.empty() || multi.poll( timeoutMs < 0 ? 1000 : timeoutMs ) );
+#endif
+
+        impl->resumeReady();
+        return result;
+    }
+
+    bool Client::run()
+    {
+        auto &spawned = _impl->spawned;
+        auto &finished = _impl->finished;
+
+        while( !spawned.empty() )
+        {
+            while( !finished.empty() )
+            {
+                Task<void> task( std::move( finished.front()->task ) );
+                spawned.erase( finished.front() );
+                finished.pop_front();
+
+                task.result();
+            }
+
+            if( spawned.empty() ) {
+                break;
+            }
+
+            if( running() == 0 ) {
+                throw Exception( "the task waits for something which doesn't run on the client" );
+            }
+
+            if( !runOnce() ) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+#endif
+
+    /* Definition of curlite::AsyncClient
+     */
+
+    namespace
+    {
+        /* Intrusive multi-producer single-consumer queue (D. Vyukov)
+         *
+         * push() is wait-free: a single exchange links the node. pop() may see the queue as empty
+         * for a moment while a producer is between the exchange and the link, the item is
+         * picked up on the next pop() then.
+         */
+
+        template <class T>
+        class MpscQueue
+        {
+            struct Node
+            {
+                std::atomic<Node*> next;
+                T value;
+
+                Node() : next( nullptr ) { }
+                explicit Node( T &&item ) : next( nullptr ), value( std::move( item ) ) { }
+            };
+
+            std::atomic<Node*> _head;
+            Node *_tail;
+
+            MpscQueue( MpscQueue const &other );
+            void operator = ( MpscQueue const &other );
+
+        public:
+            MpscQueue()
+            {
+                _tail = new Node();
+                _head.store( _tail, std::memory_order_relaxed );
+            }
+
+            ~MpscQueue()
+            {
+                T item;
+                while( pop( item ) ) { }
+
+                delete _tail;
+            }
+
+            void push( T &&item )
+            {
+                Node *node = new Node( std::move( item ) );
+                Node *previous = _head.exchange( node, std::memory_order_acq_rel );
+                previous->next.store( node, std::memory_order_release );
+            }
+
+            bool pop( T &item )
+            {
+                Node *next = _tail->next.load( std::memory_order_acquire );
+                if( next == nullptr ) {
+                    return false;
+                }
+
+                // the node becomes the new stub, its value is taken away
+                item = std::move( next->value );
+                delete _tail;
+                _tail = next;
+
+                return true;
+            }
+
+            bool empty() const
+            {
+                return _tail->next.load( std::memory_order_acquire ) == nullptr;
+            }
+        };
+    }
+
+    struct AsyncClient::Pimpl
+    {
+        struct Submission
+        {
+            std::unique_ptr<Easy> easy;
+            std::unique_ptr<std::promise<Easy>> promise;
+            Multi::CompletionHandler onDone;
+        };
+
+#ifdef __linux__
+        EventLoop loop;
+#else
+        Multi multi;
+#endif
+
+        MpscQueue<Submission> submissions;
+
+        std::atomic<bool> stopping;
+        std::atomic<bool> sleeping;
+        std::atomic<size_t> pending;
+
+        // the transfers in flight, accessed only by the transfer thread
+        std::unordered_map<Easy*, Submission> transfers;
+
+        std::thread thread;
+
+        Pimpl();
+
+        Multi &multiSession();
+
+        void enqueue( Submission &&submission );
+        void wakeup();
+        void stop();
+
+        void run();
+        void start( Submission &&submission );
+        void complete( Submission &submission, Easy &&easy );
+    };
+
+    AsyncClient::Pimpl::Pimpl()
+        : stopping( false ), sleeping( false ), pending( 0 )
+    {
+        // errors of a single transfer must not break the thread
+        multiSession().setExceptionMode( false );
+    }
+
+    Multi &AsyncClient::Pimpl::multiSession()
+    {
+#ifdef __linux__
+        return loop.multi();
+#else
+        return multi;
+#endif
+    }
+
+    void AsyncClient::Pimpl::enqueue( Submission &&submission )
+    {
+        pending.fetch_add( 1, std::memory_order_relaxed );
+        submissions.push( std::move( submission ) );
+
+        // pairs with the fence in run(): either the thread sees the item or we see it sleeping
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+
+        if( sleeping.load( std::memory_order_relaxed ) && sleeping.exchange( false ) ) {
+            wakeup();
+        }
+    }
+
+    void AsyncClient::Pimpl::wakeup()
+    {
+#ifdef __linux__
+        loop.wakeup();
+#else
+        multi.wakeup();
+#endif
+    }
+
+    void AsyncClient::Pimpl::stop()
+    {
+        stopping.store( true, std::memory_order_release );
+        wakeup();
+
+        thread.join();
+    }
+
+    void AsyncClient::Pimpl::run()
+    {
+        auto onDone = [this] ( Easy &easy )
+        {
+            auto it = transfers.find( &easy );
+            if( it == transfers.end() ) {
+                return;
+            }
+
+            Submission submission( std::move( it->second ) );
+            transfers.erase( it );
+
+            complete( submission, multiSession().remove( &easy ) );
+        };
+
+        while( !stopping.load( std::memory_order_acquire ) )
+        {
+            Submission submission;
+            while( submissions.pop( submission ) ) {
+                start( std::move( submission ) );
+            }
+
+            sleeping.store( true, std::memory_order_relaxed );
+            std::atomic_thread_fence( std::memory_order_seq_cst );
+
+            // don't sleep if something has been submitted meanwhile
+            int timeoutMs = submissions.empty() && !stopping.load( std::memory_order_acquire ) ? -1 : 0;
+
+#ifdef __linux__
+            loop.runOnce( timeoutMs, onDone );
+#else
+            multi.perform();
+            while( Easy *easy = multi.next() ) {
+                onDone( *easy );
+            }
+
+#if LIBCURL_VERSION_NUM < 0x074400
+            // curl_multi_wakeup() isn't available, new submissions are picked up by timeout
+            if( timeoutMs < 0 ) {
+                timeoutMs = 10;
+            }
+#endif
+
+            multi.poll( timeoutMs < 0 ? 1000 : timeoutMs );
+#endif
+
+            sleeping.store( false, std::memory_order_relaxed );
+        }
+
+        // cancel whatever is left
+        while( !transfers.empty() )
+        {
+            auto it = transfers.begin();
+
+            Easy *easy = it->first;
+            Submission submission( std::move( it->second ) );
+            transfers.erase( it );
+
+            Easy result = multiSession().remove( easy );
+            result._impl->err = CURLE_ABORTED_BY_CALLBACK;
+            complete( submission, std::move( result ) );
+        }
+
+        Submission submission;
+        while( submissions.pop( submission ) )
+        {
+            submission.easy->_impl->err = CURLE_ABORTED_BY_CALLBACK;
+            complete( submission, std::move( *submission.easy ) );
+        }
+    }
+
+    void AsyncClient::Pimpl::start( Submission &&submission )
+    {
+        Easy *running = multiSession().add( std::move( *submission.easy ) );
+        if( running == nullptr ) {
+            // the Easy object isn't taken on error
+            submission.easy->_impl->err = CURLE_FAILED_INIT;
+            complete( submission, std::move( *submission.easy ) );
+            return;
+        }
+
+        submission.easy.reset();
+        transfers[running] = std::move( submission );
+    }
+
+    void AsyncClient::Pimpl::complete( Submission &submission, Easy &&easy )
+    {
+        pending.fetch_sub( 1, std::memory_order_relaxed );
+
+        if( submission.promise ) {
+            submission.promise->set_value( std::move( easy ) );
+            return;
+        }
+
+        // an exception of the handler would stop all the transfers
+        try {
+            submission.onDone( easy );
+        } catch( ... ) {
+        }
+    }
+
+    AsyncClient::AsyncClient()
+        : _impl( new Pimpl() )
+    {
+        auto impl = _impl.get();
+        impl->thread = std::thread( [impl] { impl->run(); } );
+    }
+
+    AsyncClient::AsyncClient( AsyncClient &&other )
+    {
+        *this = std::move( other );
+    }
+
+    AsyncClient::~AsyncClient()
+    {
+        if( _impl ) {
+            _impl->stop();
+        }
+    }
+
+    AsyncClient &AsyncClient::operator = ( AsyncClient &&other )
+    {
+        if( this != &other )
+        {
+            if( _impl ) {
+                _impl->stop();
+            }
+
+            _impl.reset();
+            _impl.swap( other._impl );
+        }
+
+        return *this;
+    }
+
+    std::future<Easy> AsyncClient::submit( Easy &&easy )
+    {
+        Pimpl::Submission submission;
+        submission.easy.reset( new Easy( std::move( easy ) ) );
+        submission.promise.reset( new std::promise<Easy>() );
+
+        auto future = submission.promise->get_future();
+        _impl->enqueue( std::move( submission ) );
+
+        return future;
+    }
+
+    void AsyncClient::submit( Easy &&easy, Multi::CompletionHandler onDone )
+    {
+        Pimpl::Submission submission;
+        submission.easy.reset( new Easy( std::move( easy ) ) );
+        submission.onDone = std::move( onDone );
+
+        _impl->enqueue( std::move( submission ) );
+    }
+
+    size_t AsyncClient::pending() const
+    {
+        return _impl->pending.load( std::memory_order_relaxed );
+    }
+
+    /* Definition of curlite::Scheduler
+     */
+
+    struct Scheduler::Pimpl
+    {
+        static const int kPriorities = Bulk + 1;
+
+        struct Host
+        {
+            size_t                          limit;
+            size_t                          running;
+            bool                            customLimit;
+            std::string                     name;
+
+            std::deque<Easy>                queues[kPriorities];
+
+            // position in the list of hosts, which may start a transfer of the priority
+            bool                            ready[kPriorities];
+            std::list<Host*>::iterator      readyPosition[kPriorities];
+        };
+
+#ifdef __linux__
+        EventLoop loop;
+#else
+        Multi multi;
+#endif
+
+        size_t maxTotal;
+        size_t maxPerHost;
+        size_t queuedCount;
+
+        std::unordered_map<std::string, Host> hosts;
+        std::list<Host*> readyHosts[kPriorities];
+
+        // host of every transfer in flight
+        std::unordered_map<Easy*, Host*> running;
+
+        // transfers which couldn't be started: not reported yet and the reported ones waiting for remove()
+        std::list<Easy> rejected;
+        std::list<Easy> reported;
+
+        Pimpl();
+
+        Multi &multiSession();
+
+        Host &host( std::string const &name );
+
+        void setReady( Host &host, int priority, bool ready );
+        void updateReady( Host &host );
+
+        // start as many queued transfers as the limits allow
+        void dispatch();
+
+        void finished( Easy *easy );
+        void reportRejected( Multi::CompletionHandler const &onDone );
+    };
+
+    Scheduler::Pimpl::Pimpl()
+    {
+        maxTotal = 64;
+        maxPerHost = 6;
+        queuedCount = 0;
+    }
+
+    Multi &Scheduler::Pimpl::multiSession()
+    {
+#ifdef __linux__
+        return loop.multi();
+#else
+        return multi;
+#endif
+    }
+
+    Scheduler::Pimpl::Host &Scheduler::Pimpl::host( std::string const &name )
+    {
+        auto it = hosts.find( name );
+        if( it != hosts.end() ) {
+            return it->second;
+        }
+
+        Host &entry = hosts[name];
+        entry.limit = maxPerHost;
+        entry.running = 0;
+        entry.customLimit = false;
+        entry.name = name;
+
+        for( int i = 0; i < kPriorities; ++i ) {
+            entry.ready[i] = false;
+        }
+
+        return entry;
+    }
+
+    void Scheduler::Pimpl::setReady( Host &host, int priority, bool ready )
+    {
+        if( host.ready[priority] == ready ) {
+            return;
+        }
+
+        auto &list = readyHosts[priority];
+        if( ready ) {
+            host.readyPosition[priority] = list.insert( list.end(), &host );
+        } else {
+            list.erase( host.readyPosition[priority] );
+        }
+
+        host.ready[priority] = ready;
+    }
+
+    void Scheduler::Pimpl::updateReady( Host &host )
+    {
+        for( int i = 0; i < kPriorities; ++i ) {
+            setReady( host, i, host.running < host.limit && !host.queues[i].empty() );
+        }
+
+        // forget idle hosts, unless their limit has been set
+        if( host.running == 0 && !host.customLimit )
+        {
+            for( int i = 0; i < kPriorities; ++i )
+            {
+                if( !host.queues[i].empty() ) {
+                    return;
+                }
+            }
+
+            hosts.erase( host.name );
+        }
+    }
+
+    void Scheduler::Pimpl::dispatch()
+    {
+        while( running.size() < maxTotal )
+        {
+            int priority = 0;
+            while( priority < kPriorities && readyHosts[priority].empty() ) {
+                ++priority;
+            }
+
+            if( priority == kPriorities ) {
+                break;
+            }
+
+            Host &host = *readyHosts[priority].front();
+
+            // the transfer leaves the queue even if it fails to start, so it doesn't hold back the others
+            Easy next( std::move( host.queues[priority].front() ) );
+            host.queues[priority].pop_front();
+            host.running++;
+            queuedCount--;
+
+            // the host goes to the end of the line
+            setReady( host, priority, false );
+            updateReady( host );
+
+            Easy *easy = nullptr;
+            try {
+                easy = multiSession().add( std::move( next ) );
+            } catch( ... ) {
+                host.running--;
+                updateReady( host );
+                throw;
+            }
+
+            if( easy == nullptr )
+            {
+                // the Easy object isn't taken on error, it's reported by runOnce()
+                next._impl->err = CURLE_FAILED_INIT;
+                rejected.push_back( std::move( next ) );
+
+                host.running--;
+                updateReady( host );
+                continue;
+            }
+
+            running[easy] = &host;
+        }
+    }
+
+    void Scheduler::Pimpl::finished( Easy *easy )
+    {
+        auto it = running.find( easy );
+        if( it == running.end() ) {
+            return;
+        }
+
+        Host &host = *it->second;
+        running.erase( it );
+
+        host.running--;
+        updateReady( host );
+    }
+
+    void Scheduler::Pimpl::reportRejected( Multi::CompletionHandler const &onDone )
+    {
+        // the handler may remove the object or submit more
+        while( !rejected.empty() )
+        {
+            reported.splice( reported.end(), rejected, rejected.begin() );
+
+            if( onDone ) {
+                onDone( reported.back() );
+            }
+        }
+    }
+
+    Scheduler::Scheduler( size_t maxTotal, size_t maxPerHost )
+        : _impl( new Pimpl() )
+    {
+        _impl->maxTotal = std::max( maxTotal, size_t( 1 ) );
+        _impl->maxPerHost = std::max( maxPerHost, size_t( 1 ) );
+    }
+
+    Scheduler::Scheduler( Scheduler &&other )
+    {
+        *this = std::move( other );
+    }
+
+    Scheduler::~Scheduler()
+    {
+    }
+
+    Scheduler &Scheduler::operator = ( Scheduler &&other )
+    {
+        if( this != &other ) {
+            _impl.reset();
+            _impl.swap( other._impl );
+        }
+
+        return *this;
+    }
+
+    Multi &Scheduler::multi()
+    {
+        return _impl->multiSession();
+    }
+
+    void Scheduler::setHostLimit( std::string const &host, size_t limit )
+    {
+        auto &entry = _impl->host( hostOfUrl( host ) );
+        entry.limit = std::max( limit, size_t( 1 ) );
+        entry.customLimit = true;
+
+        _impl->updateReady( entry );
+        _impl->dispatch();
+    }
+
+    void Scheduler::submit( Easy &&easy, Priority priority )
+    {
+        auto &host = _impl->host( hostOfUrl( easy.getInfo<std::string>( CURLINFO_EFFECTIVE_URL ) ) );
+
+        host.queues[priority].push_back( std::move( easy ) );
+        _impl->queuedCount++;
+
+        _impl->setReady( host, priority, host.running < host.limit );
+        _impl->dispatch();
+    }
+
+    Easy Scheduler::remove( Easy *easy )
+    {
+        auto &reported = _impl->reported;
+        for( auto it = reported.begin(); it != reported.end(); ++it )
+        {
+            if( &*it == easy ) {
+                Easy result( std::move( *it ) );
+                reported.erase( it );
+                return result;
+            }
+        }
+
+        _impl->finished( easy );
+        Easy result = _impl->multiSession().remove( easy );
+
+        _impl->dispatch();
+        return result;
+    }
+
+    size_t Scheduler::queued() const
+    {
+        return _impl->queuedCount;
+    }
+
+    size_t Scheduler::running() const
+    {
+        return _impl->running.size();
+    }
+
+    bool Scheduler::runOnce( int timeoutMs, Multi::CompletionHandler const &onDone )
+    {
+        auto impl = _impl.get();
+
+        // transfers which couldn't be started are reported without waiting
+        if( !impl->rejected.empty() ) {
+            timeoutMs = 0;
+        }
+
+        // the slot is freed before the handler, so the handler may remove the object or submit more
+        auto onFinished = [impl, &onDone] ( Easy &easy )
+        {
+            impl->finished( &easy );
+
+            if( onDone ) {
+                onDone( easy );
+            }
+        };
+
+#ifdef __linux__
+        bool result = impl->loop.runOnce( timeoutMs, onFinished );
+#else
+        Multi &multi = impl->multi;
+
+        size_t stillRunning = multi.perform();
+        while( Easy *easy = multi.next() ) {
+            onFinished( *easy );
+        }
+
+        bool result = multi && ( stillRunning == 0 || multi.poll( timeoutMs < 0 ? 1000 : timeoutMs ) );
+#endif
+
+        impl->dispatch();
+        impl->reportRejected( onDone );
+
+        return result;
+    }
+
+    bool Scheduler::run( Multi::CompletionHandler onDone )
+    {
+        while( running() > 0 || !_impl->rejected.empty() )
+        {
+            if( !runOnce( -1, onDone ) ) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /* Definition of curlite::Share
+     */
+
+    struct Share::Pimpl
+    {
+        CURLSH       *share;
+        CURLSHcode    err;
+        bool          throwExceptions;
+
+        // one lock per kind of data, so e.g. DNS lookups don't wait for TLS session cache
+        std::shared_timed_mutex locks[CURL_LOCK_DATA_LAST];
+
+        // unlock callback doesn't receive the access type, so it's remembered by the locking thread.
+        // All the holders of a lock have the same access, so it doesn't change until they unlock it.
+        std::atomic<int> lockAccess[CURL_LOCK_DATA_LAST];
+
+        Pimpl();
+
+        // static cURL callbacks
+        static void lock( CURL *, curl_lock_data data, curl_lock_access access, void *userPtr );
+        static void unlock( CURL *, curl_lock_data data, void *userPtr );
+    };
+
+    Share::Pimpl::Pimpl()
+    {
+        share = nullptr;
+        err = CURLSHE_OK;
+        throwExceptions = true;
+
+        for( auto &access: lockAccess ) {
+            access.store( CURL_LOCK_ACCESS_NONE, std::memory_order_relaxed );
+        }
+    }
+
+    void Share::Pimpl::lock( CURL *, curl_lock_data data, curl_lock_access access, void *userPtr )
+    {
+        auto impl = reinterpret_cast<Share::Pimpl*>( userPtr );
+        if( data < 0 || data >= CURL_LOCK_DATA_LAST ) {
+            return;
+        }
+
+        if( access == CURL_LOCK_ACCESS_SHARED ) {
+            impl->locks[data].lock_shared();
+        } else {
+            impl->locks[data].lock();
+        }
+
+        impl->lockAccess[data].store( access, std::memory_order_relaxed );
+    }
+
+    void Share::Pimpl::unlock( CURL *, curl_lock_data data, void *userPtr )
+    {
+        auto impl = reinterpret_cast<Share::Pimpl*>( userPtr );
+        if( data < 0 || data >= CURL_LOCK_DATA_LAST ) {
+            return;
+        }
+
+        if( impl->lockAccess[data].load( std::memory_order_relaxed ) == CURL_LOCK_ACCESS_SHARED ) {
+            impl->locks[data].unlock_shared();
+        } else {
+            impl->locks[data].unlock();
+        }
+    }
+
+    Share::Share( std::vector<curl_lock_data> const &data )
+        : _impl( new Pimpl() )
+    {
+        _impl->share = curl_share_init();
+
+        if( _impl->share == nullptr ) {
+            throw Exception( "can't init curl_share interface" );
+        }
+
+        curl_share_setopt( _impl->share, CURLSHOPT_LOCKFUNC, &Pimpl::lock );
+        curl_share_setopt( _impl->share, CURLSHOPT_UNLOCKFUNC, &Pimpl::unlock );
+        curl_share_setopt( _impl->share, CURLSHOPT_USERDATA, (void*) _impl.get() );
+
+        for( auto it = data.begin(); it != data.end(); ++it ) {
+            share( *it );
+        }
+    }
+
+    Share::Share( Share &&other )
+    {
+        *this = std::move( other );
+    }
+
+    Share::~Share()
+    {
+        cleanup();
+    }
+
+    Share &Share::operator = ( Share &&other )
+    {
+        if( this != &other )
+        {
+            cleanup();
+
+            _impl.reset();
+            _impl.swap( other._impl );
+        }
+
+        return *this;
+    }
+
+    void Share::cleanup()
+    {
+        auto ptr = release();
+        if( ptr && curl_share_cleanup( ptr ) == CURLSHE_IN_USE )
+        {
+            // Easy handles attached to the share still call the lock functions with the Pimpl,
+            // so both are left alive for them
+            _impl->share = ptr;
+            _impl.release();
+        }
+    }
+
+    Share::operator bool() const
+    {
+        return _impl->err == CURLSHE_OK;
+    }
+
+    CURLSH *Share::release()
+    {
+        CURLSH *share = nullptr;
+        if( _impl ) {
+            std::swap( _impl->share, share );
+        }
+
+        return share;
+    }
+
+    CURLSH *Share::get() const
+    {
+        return _impl->share;
+    }
+
+    void Share::setExceptionMode( bool throwExceptions )
+    {
+        _impl->throwExceptions = throwExceptions;
+    }
+
+    bool Share::exceptionMode() const
+    {
+        return _impl->throwExceptions;
+    }
+
+    CURLSHcode Share::error() const
+    {
+        return _impl->err;
+    }
+
+    std::string Share::errorString() const
+    {
+        return curl_share_strerror( _impl->err );
+    }
+
+    bool Share::handleError( CURLSHcode code )
+    {
+        _impl->err = code;
+
+        if( _impl->err != CURLSHE_OK && _impl->throwExceptions ) {
+            throw Exception( curl_share_strerror(_impl->err) );
+        }
+
+        return _impl->err == CURLSHE_OK;
+    }
+
+    bool Share::share( curl_lock_data data )
+    {
+        return handleError( curl_share_setopt( _impl->share, CURLSHOPT_SHARE, data ) );
+    }
+
+    bool Share::unshare( curl_lock_data data )
+    {
+        return handleError( curl_share_setopt( _impl->share, CURLSHOPT_UNSHARE, data ) );
+    }
+
+    /* Definition of curlite::Headers
+     */
+
+    namespace
+    {
+        inline unsigned countTrailingZeros( uint32_t mask )
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward( &index, mask );
+            return unsigned( index );
+#else
+            return unsigned( __builtin_ctz( mask ) );
+#endif
+        }
+
+        // calls handler( position, isNewLine ) for every '\n' and ':' of the data in order
+        template <class Handler>
+        void scanHeaderSeparators( const char *data, size_t size, Handler &&handler )
+        {
+            size_t i = 0;
+
+#if defined( CURLITE_AVX2 )
+            const __m256i newLine = _mm256_set1_epi8( '\n' );
+            const __m256i colon = _mm256_set1_epi8( ':' );
+
+            for( ; i + 32 <= size; i += 32 )
+            {
+                __m256i chunk = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( data + i ) );
+                uint32_t lines = uint32_t( _mm256_movemask_epi8( _mm256_cmpeq_epi8( chunk, newLine ) ) );
+                uint32_t colons = uint32_t( _mm256_movemask_epi8( _mm256_cmpeq_epi8( chunk, colon ) ) );
+
+                for( uint32_t mask = lines | colons; mask != 0; mask &= mask - 1 ) {
+                    unsigned bit = countTrailingZeros( mask );
+                    handler( i + bit, ( ( lines >> bit ) & 1 ) != 0 );
+                }
+            }
+#elif defined( CURLITE_SSE2 )
+            const __m128i newLine = _mm_set1_epi8( '\n' );
+            const __m128i colon = _mm_set1_epi8( ':' );
+
+            for( ; i + 16 <= size; i += 16 )
+            {
+                __m128i chunk = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + i ) );
+                uint32_t lines = uint32_t( _mm_movemask_epi8( _mm_cmpeq_epi8( chunk, newLine ) ) );
+                uint32_t colons = uint32_t( _mm_movemask_epi8( _mm_cmpeq_epi8( chunk, colon ) ) );
+
+                for( uint32_t mask = lines | colons; mask != 0; mask &= mask - 1 ) {
+                    unsigned bit = countTrailingZeros( mask );
+                    handler( i + bit, ( ( lines >> bit ) & 1 ) != 0 );
+                }
+            }
+#endif
+
+            // the tail (or everything without SIMD)
+            for( ; i < size; ++i )
+            {
+                if( data[i] == '\n' || data[i] == ':' ) {
+                    handler( i, data[i] == '\n' );
+                }
+            }
+        }
+
+        inline char toLowerAscii( char c )
+        {
+            return c >= 'A' && c <= 'Z' ? char( c - 'A' + 'a' ) : c;
+        }
+
+        bool equalsIgnoreCase( std::string_view a, std::string_view b )
+        {
+            if( a.size() != b.size() ) {
+                return false;
+            }
+
+            for( size_t i = 0; i < a.size(); ++i )
+            {
+                if( toLowerAscii( a[i] ) != toLowerAscii( b[i] ) ) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        inline bool isWhitespace( char c )
+        {
+            return c == ' ' || c == '\t';
+        }
+    }
+
+    struct Headers::Pimpl
+    {
+        struct Field
+        {
+            size_t nameBegin, nameSize;
+            size_t valueBegin, valueSize;
+        };
+
+        static const size_t kMissing = size_t( -1 );
+
+        std::string          block;
+        std::vector<Field>   fields;
+        size_t               statusSize;
+        bool                 indexed;
+
+        // indices of the frequent fields
+        size_t               contentLength;
+        size_t               contentType;
+        size_t               etag;
+
+        Pimpl();
+
+        void clear();
+
+        // builds the index of the fields if the block has changed
+        void index();
+        void addField( size_t lineBegin, size_t colon, size_t lineEnd );
+
+        // returns index of the first field with the name or kMissing
+        size_t find( std::string_view fieldName ) const;
+
+        std::string_view name( size_t index ) const;
+        std::string_view value( size_t index ) const;
+    };
+
+    Headers::Pimpl::Pimpl()
+    {
+        clear();
+    }
+
+    void Headers::Pimpl::clear()
+    {
+        block.clear();
+        fields.clear();
+        statusSize = 0;
+        indexed = true;
+        contentLength = contentType = etag = kMissing;
+    }
+
+    void Headers::Pimpl::index()
+    {
+        if( indexed ) {
+            return;
+        }
+
+        fields.clear();
+        statusSize = 0;
+        contentLength = contentType = etag = kMissing;
+
+        bool statusLine = block.compare( 0, 5, "HTTP/" ) == 0;
+        size_t lineBegin = 0;
+        size_t colon = kMissing;
+
+        scanHeaderSeparators( block.data(), block.size(), [&] ( size_t position, bool newLine )
+        {
+            if( !newLine ) {
+                colon = std::min( colon, position );
+                return;
+            }
+
+            size_t lineEnd = position;
+            if( lineEnd > lineBegin && block[lineEnd - 1] == '\r' ) {
+                --lineEnd;
+            }
+
+            if( statusLine ) {
+                statusSize = lineEnd;
+                statusLine = false;
+            } else if( colon < lineEnd && lineBegin < colon && !isWhitespace( block[lineBegin] ) ) {
+                addField( lineBegin, colon, lineEnd );
+            }
+
+            lineBegin = position + 1;
+            colon = kMissing;
+        } );
+
+        indexed = true;
+    }
+
+    void Headers::Pimpl::addField( size_t lineBegin, size_t colon, size_t lineEnd )
+    {
+        size_t nameEnd = colon;
+        while( nameEnd > lineBegin && isWhitespace( block[nameEnd - 1] ) ) {
+            --nameEnd;
+        }
+
+        size_t valueBegin = colon + 1;
+        while( valueBegin < lineEnd && isWhitespace( block[valueBegin] ) ) {
+            ++valueBegin;
+        }
+
+        size_t valueEnd = lineEnd;
+        while( valueEnd > valueBegin && isWhitespace( block[valueEnd - 1] ) ) {
+            --valueEnd;
+        }
+
+        Field field = { lineBegin, nameEnd - lineBegin, valueBegin, valueEnd - valueBegin };
+        fields.push_back( field );
+
+        // the first field with the name wins, as in get()
+        std::string_view fieldName = name( fields.size() - 1 );
+        if( contentLength == kMissing && equalsIgnoreCase( fieldName, "content-length" ) ) {
+            contentLength = fields.size() - 1;
+        } else if( contentType == kMissing && equalsIgnoreCase( fieldName, "content-type" ) ) {
+            contentType = fields.size() - 1;
+        } else if( etag == kMissing && equalsIgnoreCase( fieldName, "etag" ) ) {
+            etag = fields.size() - 1;
+        }
+    }
+
+    size_t Headers::Pimpl::find( std::string_view fieldName ) const
+    {
+        for( size_t i = 0; i < fields.size(); ++i )
+        {
+            if( equalsIgnoreCase( name( i ), fieldName ) ) {
+                return i;
+            }
+        }
+
+        return kMissing;
+    }
+
+    std::string_view Headers::Pimpl::name( size_t index ) const
+    {
+        return std::string_view( block.data() + fields[index].nameBegin, fields[index].nameSize );
+    }
+
+    std::string_view Headers::Pimpl::value( size_t index ) const
+    {
+        return index == kMissing ? std::string_view()
+                                 : std::string_view( block.data() + fields[index].valueBegin, fields[index].valueSize );
+    }
+
+    Headers::Headers()
+        : _impl( new Pimpl() )
+    { }
+
+    Headers::Headers( Headers &&other )
+    {
+        *this = std::move( other );
+    }
+
+    Headers::~Headers()
+    {
+    }
+
+    Headers &Headers::operator = ( Headers &&other )
+    {
+        if( this != &other ) {
+            _impl.reset();
+            _impl.swap( other._impl );
+        }
+
+        return *this;
+    }
+
+    void Headers::append( const char *data, size_t size )
+    {
+        // every response (e.g. after a redirect or 100 Continue) starts with a status line
+        if( size >= 5 && std::memcmp( data, "HTTP/", 5 ) == 0 ) {
+            _impl->clear();
+        }
+
+        _impl->block.append( data, size );
+        _impl->indexed = false;
+    }
+
+    void Headers::clear()
+    {
+        _impl->clear();
+    }
+
+    std::string_view Headers::raw() const
+    {
+        return _impl->block;
+    }
+
+    std::string_view Headers::statusLine() const
+    {
+        _impl->index();
+        return std::string_view( _impl->block.data(), _impl->statusSize );
+    }
+
+    long Headers::status() const
+    {
+        std::string_view line = statusLine();
+
+        size_t space = line.find( ' ' );
+        if( space == std::string_view::npos ) {
+            return 0;
+        }
+
+        long code = 0;
+        for( size_t i = space + 1; i < line.size() && i < space + 4; ++i )
+        {
+            if( line[i] < '0' || line[i] > '9' ) {
+                return 0;
+            }
+
+            code = code * 10 + ( line[i] - '0' );
+        }
+
+        return code;
+    }
+
+    size_t Headers::size() const
+    {
+        _impl->index();
+        return _impl->fields.size();
+    }
+
+    std::string_view Headers::name( size_t index ) const
+    {
+        _impl->index();
+        return index < _impl->fields.size() ? _impl->name( index ) : std::string_view();
+    }
+
+    std::string_view Headers::value( size_t index ) const
+    {
+        _impl->index();
+        return index < _impl->fields.size() ? _impl->value( index ) : std::string_view();
+    }
+
+    std::string_view Headers::get( std::string_view name ) const
+    {
+        _impl->index();
+        return _impl->value( _impl->find( name ) );
+    }
+
+    bool Headers::has( std::string_view name ) const
+    {
+        _impl->index();
+        return _impl->find( name ) != Pimpl::kMissing;
+    }
+
+    curl_off_t Headers::contentLength() const
+    {
+        _impl->index();
+
+        std::string_view value = _impl->value( _impl->contentLength );
+        if( value.empty() || value.size() > 18 ) {
+            return -1;
+        }
+
+        curl_off_t length = 0;
+        for( size_t i = 0; i < value.size(); ++i )
+        {
+            if( value[i] < '0' || value[i] > '9' ) {
+                return -1;
+            }
+
+            length = length * 10 + ( value[i] - '0' );
+        }
+
+        return length;
+    }
+
+    std::string_view Headers::contentType() const
+    {
+        _impl->index();
+        return _impl->value( _impl->contentType );
+    }
+
+    std::string_view Headers::etag() const
+    {
+        _impl->index();
+        return _impl->value( _impl->etag );
+    }
+
+    /* Definition of the framers
+     */
+
+    namespace
+    {
+        // returns pointer to the first occurrence of either byte or nullptr
+        const char *findByte( const char *data, size_t size, char byte, char other )
+        {
+            size_t i = 0;
+
+#if defined( CURLITE_AVX2 )
+            const __m256i pattern = _mm256_set1_epi8( byte );
+            const __m256i otherPattern = _mm256_set1_epi8( other );
+
+            for( ; i + 32 <= size; i += 32 )
+            {
+                __m256i chunk = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( data + i ) );
+                __m256i found = _mm256_or_si256( _mm256_cmpeq_epi8( chunk, pattern ), _mm256_cmpeq_epi8( chunk, otherPattern ) );
+                uint32_t mask = uint32_t( _mm256_movemask_epi8( found ) );
+
+                if( mask != 0 ) {
+                    return data + i + countTrailingZeros( mask );
+                }
+            }
+#elif defined( CURLITE_SSE2 )
+            const __m128i pattern = _mm_set1_epi8( byte );
+            const __m128i otherPattern = _mm_set1_epi8( other );
+
+            for( ; i + 16 <= size; i += 16 )
+            {
+                __m128i chunk = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + i ) );
+                __m128i found = _mm_or_si128( _mm_cmpeq_epi8( chunk, pattern ), _mm_cmpeq_epi8( chunk, otherPattern ) );
+                uint32_t mask = uint32_t( _mm_movemask_epi8( found ) );
+
+                if( mask != 0 ) {
+                    return data + i + countTrailingZeros( mask );
+                }
+            }
+#endif
+
+            for( ; i < size; ++i )
+            {
+                if( data[i] == byte || data[i] == other ) {
+                    return data + i;
+                }
+            }
+
+            return nullptr;
+        }
+
+        // returns pointer to the first occurrence of the byte or nullptr
+        const char *findByte( const char *data, size_t size, char byte )
+        {
+            return findByte( data, size, byte, byte );
+        }
+
+        // Splits the data into lines (without CR and LF), a line split between chunks is gathered in spill.
+        // onLine( line, inChunk ) is told if the line points into the data or into spill.
+        //
+        // Lines end with LF or CRLF. If pendingCr is given, a lone CR ends the line as well, and
+        // *pendingCr remembers the CR at the end of the data, so LF at the beginning of the next data is skipped.
+        template <class LineHandler>
+        bool splitLines( const char *data, size_t size, std::string &spill, size_t maxLineSize, LineHandler &&onLine,
+                         bool *pendingCr = nullptr )
+        {
+            const char *end = data + size;
+
+            if( pendingCr && *pendingCr && data < end )
+            {
+                *pendingCr = false;
+
+                if( *data == '\n' ) {
+                    data++;
+                }
+            }
+
+            while( data < end )
+            {
+                const char *newLine = pendingCr ? findByte( data, size_t( end - data ), '\n', '\r' )
+                                                : findByte( data, size_t( end - data ), '\n' );
+                size_t length = size_t( ( newLine ? newLine : end ) - data );
+
+                if( spill.size() + length > maxLineSize ) {
+                    return false;
+                }
+
+                if( !newLine ) {
+                    spill.append( data, length );
+                    break;
+                }
+
+                bool inChunk = spill.empty();
+                if( !inChunk ) {
+                    spill.append( data, length );
+                }
+
+                std::string_view line = inChunk ? std::string_view( data, length ) : std::string_view( spill );
+                if( !pendingCr && !line.empty() && line.back() == '\r' ) {
+                    line.remove_suffix( 1 );
+                }
+
+                // the line ends after CRLF, CR or LF
+                const char *next = newLine + 1;
+                if( *newLine == '\r' )
+                {
+                    if( next == end ) {
+                        *pendingCr = true;
+                    } else if( *next == '\n' ) {
+                        next++;
+                    }
+                }
+
+                bool proceed = onLine( line, inChunk );
+                spill.clear();
+
+                if( !proceed ) {
+                    return false;
+                }
+
+                data = next;
+            }
+
+            return true;
+        }
+    }
+
+    Framer::~Framer()
+    {
+    }
+
+    /* Definition of curlite::LineFramer
+     */
+
+    struct LineFramer::Pimpl
+    {
+        RecordHandler   onRecord;
+        size_t          maxRecordSize;
+
+        // beginning of the record, which is split between chunks
+        std::string     spill;
+    };
+
+    LineFramer::LineFramer( RecordHandler onRecord, size_t maxRecordSize )
+        : _impl( new Pimpl() )
+    {
+        _impl->onRecord = onRecord;
+        _impl->maxRecordSize = maxRecordSize;
+    }
+
+    LineFramer::LineFramer( LineFramer &&other )
+    {
+        *this = std::move( other );
+    }
+
+    LineFramer::~LineFramer()
+    {
+    }
+
+    LineFramer &LineFramer::operator = ( LineFramer &&other )
+    {
+        if( this != &other ) {
+            _impl.reset();
+            _impl.swap( other._impl );
+        }
+
+        return *this;
+    }
+
+    bool LineFramer::feed( const char *data, size_t size )
+    {
+        auto impl = _impl.get();
+
+        return splitLines( data, size, impl->spill, impl->maxRecordSize, [impl] ( std::string_view line, bool ) {
+            return line.empty() || impl->onRecord( line );
+        } );
+    }
+
+    bool LineFramer::finish()
+    {
+        std::string_view line = _impl->spill;
+        if( !line.empty() && line.back() == '\r' ) {
+            line.remove_suffix( 1 );
+        }
+
+        bool proceed = line.empty() || _impl->onRecord( line );
+        _impl->spill.clear();
+
+        return proceed;
+    }
+
+    void LineFramer::reset()
+    {
+        _impl->spill.clear();
+    }
+
+    /* Definition of curlite::EventStreamFramer
+     */
+
+    struct EventStreamFramer::Pimpl
+    {
+        EventHandler        onEvent;
+        size_t              maxEventSize;
+
+        // the stream may start with UTF-8 BOM, the number of its bytes received so far
+        bool                started;
+        size_t              bomReceived;
+
+        // beginning of the line, which is split between chunks
+        std::string         spill;
+
+        // the last chunk has ended with CR, which may be followed by LF
+        bool                pendingCr;
+
+        // fields of the current event
+        std::string         type;
+        size_t              dataLines;
+
+        // data is a view into the chunk until it's joined with other lines or the chunk ends
+        std::string_view    dataView;
+        std::string         dataBuffer;
+        bool                dataOwned;
+
+        // state of the stream
+        std::string         lastEventId;
+        long                retry;
+
+        Pimpl();
+
+        bool line( std::string_view line, bool inChunk );
+        bool dispatch();
+
+        void keepData();
+        void clearEvent();
+    };
+
+    EventStreamFramer::Pimpl::Pimpl()
+    {
+        maxEventSize = 0;
+        started = false;
+        bomReceived = 0;
+        pendingCr = false;
+        retry = -1;
+
+        clearEvent();
+    }
+
+    bool EventStreamFramer::Pimpl::line( std::string_view line, bool inChunk )
+    {
+        if( line.empty() ) {
+            return dispatch();
+        }
+
+        // comment
+        if( line[0] == ':' ) {
+            return true;
+        }
+
+        size_t colon = line.find( ':' );
+        std::string_view field = line.substr( 0, colon );
+        std::string_view value = colon == std::string_view::npos ? std::string_view() : line.substr( colon + 1 );
+
+        if( !value.empty() && value[0] == ' ' ) {
+            value.remove_prefix( 1 );
+        }
+
+        if( field == "data" )
+        {
+            if( dataLines == 0 && inChunk ) {
+                dataView = value;
+            } else {
+                keepData();
+
+                if( dataLines > 0 ) {
+                    dataBuffer.push_back( '\n' );
+                }
+
+                dataBuffer.append( value.data(), value.size() );
+            }
+
+            dataLines++;
+            return dataOwned ? dataBuffer.size() <= maxEventSize : true;
+        }
+
+        if( field == "event" ) {
+            type.assign( value.data(), value.size() );
+        } else if( field == "id" ) {
+            if( value.find( '\0' ) == std::string_view::npos ) {
+                lastEventId.assign( value.data(), value.size() );
+            }
+        } else if( field == "retry" ) {
+            long milliseconds = 0;
+            bool digits = !value.empty() && value.size() < 10;
+
+            for( size_t i = 0; digits && i < value.size(); ++i ) {
+                digits = value[i] >= '0' && value[i] <= '9';
+                milliseconds = milliseconds * 10 + ( value[i] - '0' );
+            }
+
+            if( digits ) {
+                retry = milliseconds;
+            }
+        }
+
+        return true;
+    }
+
+    bool EventStreamFramer::Pimpl::dispatch()
+    {
+        if( dataLines == 0 ) {
+            clearEvent();
+            return true;
+        }
+
+        ServerSentEvent event;
+        event.type = type.empty() ? std::string_view( "message" ) : std::string_view( type );
+        event.data = dataOwned ? std::string_view( dataBuffer ) : dataView;
+        event.id = lastEventId;
+        event.retry = retry;
+
+        bool proceed = onEvent( event );
+        clearEvent();
+
+        return proceed;
+    }
+
+    void EventStreamFramer::Pimpl::keepData()
+    {
+        if( !dataOwned ) {
+            dataBuffer.assign( dataView.data(), dataView.size() );
+            dataView = std::string_view();
+            dataOwned = true;
+        }
+    }
+
+    void EventStreamFramer::Pimpl::clearEvent()
+    {
+        type.clear();
+        dataLines = 0;
+        dataView = std::string_view();
+        dataBuffer.clear();
+        dataOwned = false;
+    }
+
+    EventStreamFramer::EventStreamFramer( EventHandler onEvent, size_t maxEventSize )
+        : _impl( new Pimpl() )
+    {
+        _impl->onEvent = onEvent;
+        _impl->maxEventSize = maxEventSize;
+    }
+
+    EventStreamFramer::EventStreamFramer( EventStreamFramer &&other )
+    {
+        *this = std::move( other );
+    }
+
+    EventStreamFramer::~EventStreamFramer()
+    {
+    }
+
+    EventStreamFramer &EventStreamFramer::operator = ( EventStreamFramer &&other )
+    {
+        if( this != &other ) {
+            _impl.reset();
+            _impl.swap( other._impl );
+        }
+
+        return *this;
+    }
+
+    std::string const &EventStreamFramer::lastEventId() const
+    {
+        return _impl->lastEventId;
+    }
+
+    bool EventStreamFramer::feed( const char *data, size_t size )
+    {
+        auto impl = _impl.get();
+
+        // BOM may be split between chunks, nothing is parsed until it's received or ruled out
+        const char kBom[] = "\xEF\xBB\xBF";
+
+        while( !impl->started && size > 0 )
+        {
+            if( *data != kBom[impl->bomReceived] )
+            {
+                // the bytes taken for BOM so far begin the first line
+                impl->spill.assign( kBom, impl->bomReceived );
+                impl->started = true;
+                break;
+            }
+
+            data++;
+            size--;
+            impl->started = ++impl->bomReceived == 3;
+        }
+
+        bool proceed = splitLines( data, size, impl->spill, impl->maxEventSize, [impl] ( std::string_view line, bool inChunk ) {
+            return impl->line( line, inChunk );
+        }, &impl->pendingCr );
+
+        // the chunk is about to go away
+        if( impl->dataLines > 0 ) {
+            impl->keepData();
+        }
+
+        return proceed;
+    }
+
+    bool EventStreamFramer::finish()
+    {
+        // an incomplete event is discarded
+        bool complete = _impl->spill.empty() && _impl->dataLines == 0 && ( _impl->started || _impl->bomReceived == 0 );
+        reset();
+
+        return complete;
+    }
+
+    void EventStreamFramer::reset()
+    {
+        _impl->spill.clear();
+        _impl->started = false;
+        _impl->bomReceived = 0;
+        _impl->pendingCr = false;
+        _impl->clearEvent();
+    }
+
+    /* Definition of curlite::LengthPrefixFramer
+     */
+
+    struct LengthPrefixFramer::Pimpl
+    {
+        static const size_t kPrefixSize = 4;
+
+        RecordHandler   onRecord;
+        size_t          maxRecordSize;
+
+        // prefix and the beginning of the record, which is split between chunks
+        std::string     spill;
+
+        static size_t recordSize( const char *prefix );
+    };
+
+    size_t LengthPrefixFramer::Pimpl::recordSize( const char *prefix )
+    {
+        auto bytes = reinterpret_cast<const unsigned char*>( prefix );
+        return ( size_t( bytes[0] ) << 24 ) | ( size_t( bytes[1] ) << 16 ) | ( size_t( bytes[2] ) << 8 ) | size_t( bytes[3] );
+    }
+
+    LengthPrefixFramer::LengthPrefixFramer( RecordHandler onRecord, size_t maxRecordSize )
+        : _impl( new Pimpl() )
+    {
+        _impl->onRecord = onRecord;
+        _impl->maxRecordSize = maxRecordSize;
+    }
+
+    LengthPrefixFramer::LengthPrefixFramer( LengthPrefixFramer &&other )
+    {
+        *this = std::move( other );
+    }
+
+    LengthPrefixFramer::~LengthPrefixFramer()
+    {
+    }
+
+    LengthPrefixFramer &LengthPrefixFramer::operator = ( LengthPrefixFramer &&other )
+    {
+        if( this != &other ) {
+            _impl.reset();
+            _impl.swap( other._impl );
+        }
+
+        return *this;
+    }
+
+    bool LengthPrefixFramer::feed( const char *data, size_t size )
+    {
+        auto impl = _impl.get();
+        auto &spill = impl->spill;
+        const size_t kPrefixSize = Pimpl::kPrefixSize;
+
+        while( size > 0 )
+        {
+            if( spill.empty() )
+            {
+                // the whole record is in the chunk
+                if( size >= kPrefixSize )
+                {
+                    size_t recordSize = Pimpl::recordSize( data );
+                    if( recordSize > impl->maxRecordSize ) {
+                        return false;
+                    }
+
+                    if( size - kPrefixSize >= recordSize )
+                    {
+                        if( !impl->onRecord( std::string_view( data + kPrefixSize, recordSize ) ) ) {
+                            return false;
+                        }
+
+                        data += kPrefixSize + recordSize;
+                        size -= kPrefixSize + recordSize;
+                        continue;
+                    }
+
+                    spill.reserve( kPrefixSize + recordSize );
+                }
+
+                spill.assign( data, size );
+                break;
+            }
+
+            // complete the prefix first
+            if( spill.size() < kPrefixSize )
+            {
+                size_t count = std::min( kPrefixSize - spill.size(), size );
+                spill.append( data, count );
+                data += count;
+                size -= count;
+
+                if( spill.size() < kPrefixSize ) {
+                    break;
+                }
+
+                if( Pimpl::recordSize( spill.data() ) > impl->maxRecordSize ) {
+                    return false;
+                }
+            }
+
+            size_t recordSize = Pimpl::recordSize( spill.data() );
+            size_t count = std::min( kPrefixSize + recordSize - spill.size(), size );
+            spill.append( data, count );
+            data += count;
+            size -= count;
+
+            if( spill.size() == kPrefixSize + recordSize )
+            {
+                bool proceed = impl->onRecord( std::string_view( spill.data() + kPrefixSize, recordSize ) );
+                spill.clear();
+
+                if( !proceed ) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool LengthPrefixFramer::finish()
+    {
+        bool complete = _impl->spill.empty();
+        reset();
+
+        return complete;
+    }
+
+    void LengthPrefixFramer::reset()
+    {
+        _impl->spill.clear();
+    }
+
+    /* Definition of curlite::Digest
+     */
+
+    namespace
+    {
+        inline uint32_t rotateRight( uint32_t value, int bits )
+        {
+            return ( value >> bits ) | ( value << ( 32 - bits ) );
+        }
+
+        inline uint64_t rotateLeft( uint64_t value, int bits )
+        {
+            return ( value << bits ) | ( value >> ( 64 - bits ) );
+        }
+
+        inline uint32_t readLittle32( const unsigned char *data )
+        {
+            return uint32_t( data[0] ) | ( uint32_t( data[1] ) << 8 ) | ( uint32_t( data[2] ) << 16 ) | ( uint32_t( data[3] ) << 24 );
+        }
+
+        inline uint64_t readLittle64( const unsigned char *data )
+        {
+            return uint64_t( readLittle32( data ) ) | ( uint64_t( readLittle32( data + 4 ) ) << 32 );
+        }
+
+        inline uint32_t readBig32( const unsigned char *data )
+        {
+            return ( uint32_t( data[0] ) << 24 ) | ( uint32_t( data[1] ) << 16 ) | ( uint32_t( data[2] ) << 8 ) | uint32_t( data[3] );
+        }
+
+        void appendBig( std::vector<unsigned char> &bytes, uint64_t value, size_t size )
+        {
+            for( size_t i = size; i > 0; --i ) {
+                bytes.push_back( (unsigned char)( value >> ( 8 * ( i - 1 ) ) ) );
+            }
+        }
+
+#ifdef CURLITE_X86_DISPATCH
+        bool cpuHasSse42()
+        {
+            unsigned eax, ebx, ecx, edx;
+            return __get_cpuid( 1, &eax, &ebx, &ecx, &edx ) && ( ecx & ( 1u << 20 ) ) != 0;
+        }
+
+        bool cpuHasShaExtensions()
+        {
+            unsigned eax, ebx, ecx, edx;
+            if( !__get_cpuid( 1, &eax, &ebx, &ecx, &edx ) || ( ecx & ( 1u << 19 ) ) == 0 ) {
+                return false;
+            }
+
+            return __get_cpuid_count( 7, 0, &eax, &ebx, &ecx, &edx ) && ( ebx & ( 1u << 29 ) ) != 0;
+        }
+#endif
+
+        /* CRC32C (Castagnoli)
+         */
+
+        struct Crc32cTables
+        {
+            uint32_t table[8][256];
+
+            Crc32cTables()
+            {
+                for( uint32_t i = 0; i < 256; ++i )
+                {
+                    uint32_t crc = i;
+                    for( int bit = 0; bit < 8; ++bit ) {
+                        crc = ( crc >> 1 ) ^ ( ( crc & 1 ) ? 0x82F63B78u : 0 );
+                    }
+
+                    table[0][i] = crc;
+                }
+
+                for( uint32_t i = 0; i < 256; ++i ) {
+                    for( int k = 1; k < 8; ++k ) {
+                        table[k][i] = ( table[k - 1][i] >> 8 ) ^ table[0][table[k - 1][i] & 0xff];
+                    }
+                }
+            }
+        };
+
+        // slicing-by-8
+        uint32_t crc32cSoftware( uint32_t crc, const unsigned char *data, size_t size )
+        {
+            static const Crc32cTables tables;
+            auto &t = tables.table;
+
+            for( ; size >= 8; data += 8, size -= 8 )
+            {
+                uint32_t low = crc ^ readLittle32( data );
+                uint32_t high = readLittle32( data + 4 );
+
+                crc = t[7][low & 0xff] ^ t[6][( low >> 8 ) & 0xff] ^ t[5][( low >> 16 ) & 0xff] ^ t[4][low >> 24] ^
+                      t[3][high & 0xff] ^ t[2][( high >> 8 ) & 0xff] ^ t[1][( high >> 16 ) & 0xff] ^ t[0][high >> 24];
+            }
+
+            for( ; size > 0; ++data, --size ) {
+                crc = t[0][( crc ^ *data ) & 0xff] ^ ( crc >> 8 );
+            }
+
+            return crc;
+        }
+
+#if defined( CURLITE_X86_DISPATCH )
+        __attribute__(( target( "sse4.2" ) ))
+        uint32_t crc32cHardware( uint32_t crc, const unsigned char *data, size_t size )
+        {
+#ifdef __x86_64__
+            uint64_t crc64 = crc;
+            for( ; size >= 8; data += 8, size -= 8 ) {
+                crc64 = _mm_crc32_u64( crc64, readLittle64( data ) );
+            }
+
+            crc = uint32_t( crc64 );
+#endif
+            for( ; size > 0; ++data, --size ) {
+                crc = _mm_crc32_u8( crc, *data );
+            }
+
+            return crc;
+        }
+#elif defined( __ARM_FEATURE_CRC32 )
+        uint32_t crc32cHardware( uint32_t crc, const unsigned char *data, size_t size )
+        {
+            for( ; size >= 8; data += 8, size -= 8 ) {
+                crc = __crc32cd( crc, readLittle64( data ) );
+            }
+
+            for( ; size > 0; ++data, --size ) {
+                crc = __crc32cb( crc, *data );
+            }
+
+            return crc;
+        }
+#endif
+
+        uint32_t crc32cUpdate( uint32_t crc, const unsigned char *data, size_t size )
+        {
+#if defined( CURLITE_X86_DISPATCH )
+            static const auto update = cpuHasSse42() ? &crc32cHardware : &crc32cSoftware;
+            return update( crc, data, size );
+#elif defined( __ARM_FEATURE_CRC32 )
+            return crc32cHardware( crc, data, size );
+#else
+            return crc32cSoftware( crc, data, size );
+#endif
+        }
+
+        /* SHA-256
+         */
+
+        const uint32_t kSha256Constants[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+
+        void sha256Software( uint32_t state[8], const unsigned char *data, size_t blocks )
+        {
+            for( ; blocks > 0; --blocks, data += 64 )
+            {
+                uint32_t w[64];
+                for( int i = 0; i < 16; ++i ) {
+                    w[i] = readBig32( data + 4 * i );
+                }
+
+                for( int i = 16; i < 64; ++i )
+                {
+                    uint32_t s0 = rotateRight( w[i - 15], 7 ) ^ rotateRight( w[i - 15], 18 ) ^ ( w[i - 15] >> 3 );
+                    uint32_t s1 = rotateRight( w[i - 2], 17 ) ^ rotateRight( w[i - 2], 19 ) ^ ( w[i - 2] >> 10 );
+                    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+                }
+
+                uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+                uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+                for( int i = 0; i < 64; ++i )
+                {
+                    uint32_t s1 = rotateRight( e, 6 ) ^ rotateRight( e, 11 ) ^ rotateRight( e, 25 );
+                    uint32_t choice = ( e & f ) ^ ( ~e & g );
+                    uint32_t t1 = h + s1 + choice + kSha256Constants[i] + w[i];
+                    uint32_t s0 = rotateRight( a, 2 ) ^ rotateRight( a, 13 ) ^ rotateRight( a, 22 );
+                    uint32_t majority = ( a & b ) ^ ( a & c ) ^ ( b & c );
+                    uint32_t t2 = s0 + majority;
+
+                    h = g; g = f; f = e; e = d + t1;
+                    d = c; c = b; b = a; a = t1 + t2;
+                }
+
+                state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+                state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+            }
+        }
+
+#ifdef CURLITE_X86_DISPATCH
+        // SHA extensions, 4 rounds per group, the message schedule is computed along the way
+        __attribute__(( target( "sha,sse4.1" ) ))
+        void sha256Hardware( uint32_t state[8], const unsigned char *data, size_t blocks )
+        {
+            const __m128i byteSwap = _mm_set_epi64x( 0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL );
+
+            // the instructions keep the state as ABEF and CDGH
+            __m128i tmp = _mm_shuffle_epi32( _mm_loadu_si128( reinterpret_cast<const __m128i*>( &state[0] ) ), 0xB1 );
+            __m128i state1 = _mm_shuffle_epi32( _mm_loadu_si128( reinterpret_cast<const __m128i*>( &state[4] ) ), 0x1B );
+            __m128i state0 = _mm_alignr_epi8( tmp, state1, 8 );
+            state1 = _mm_blend_epi16( state1, tmp, 0xF0 );
+
+            for( ; blocks > 0; --blocks, data += 64 )
+            {
+                __m128i savedState0 = state0;
+                __m128i savedState1 = state1;
+                __m128i message[4];
+
+                for( int group = 0; group < 16; ++group )
+                {
+                    __m128i &current = message[group % 4];
+
+                    if( group < 4 ) {
+                        current = _mm_shuffle_epi8( _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + 16 * group ) ), byteSwap );
+                    }
+
+                    __m128i words = _mm_add_epi32( current, _mm_loadu_si128( reinterpret_cast<const __m128i*>( &kSha256Constants[4 * group] ) ) );
+                    state1 = _mm_sha256rnds2_epu32( state1, state0, words );
+
+                    if( group >= 3 && group <= 14 ) {
+                        __m128i &next = message[( group + 1 ) % 4];
+                        next = _mm_add_epi32( next, _mm_alignr_epi8( current, message[( group + 3 ) % 4], 4 ) );
+                        next = _mm_sha256msg2_epu32( next, current );
+                    }
+
+                    state0 = _mm_sha256rnds2_epu32( state0, state1, _mm_shuffle_epi32( words, 0x0E ) );
+
+                    if( group >= 1 && group <= 12 ) {
+                        __m128i &previous = message[( group + 3 ) % 4];
+                        previous = _mm_sha256msg1_epu32( previous, current );
+                    }
+                }
+
+                state0 = _mm_add_epi32( state0, savedState0 );
+                state1 = _mm_add_epi32( state1, savedState1 );
+            }
+
+            tmp = _mm_shuffle_epi32( state0, 0x1B );
+            state1 = _mm_shuffle_epi32( state1, 0xB1 );
+            state0 = _mm_blend_epi16( tmp, state1, 0xF0 );
+            state1 = _mm_alignr_epi8( state1, tmp, 8 );
+
+            _mm_storeu_si128( reinterpret_cast<__m128i*>( &state[0] ), state0 );
+            _mm_storeu_si128( reinterpret_cast<__m128i*>( &state[4] ), state1 );
+        }
+#endif
+
+        void sha256Blocks( uint32_t state[8], const unsigned char *data, size_t blocks )
+        {
+#ifdef CURLITE_X86_DISPATCH
+            static const auto process = cpuHasShaExtensions() ? &sha256Hardware : &sha256Software;
+            process( state, data, blocks );
+#else
+            sha256Software( state, data, blocks );
+#endif
+        }
+
+        struct Sha256State
+        {
+            uint32_t        state[8];
+            unsigned char   buffer[64];
+            size_t          buffered;
+            uint64_t        total;
+
+            Sha256State()
+            {
+                static const uint32_t initial[8] = {
+                    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+                };
+
+                std::memcpy( state, initial, sizeof( state ) );
+                buffered = 0;
+                total = 0;
+            }
+
+            void update( const unsigned char *data, size_t size )
+            {
+                total += size;
+
+                if( buffered > 0 )
+                {
+                    size_t count = std::min( size, sizeof( buffer ) - buffered );
+                    std::memcpy( buffer + buffered, data, count );
+                    buffered += count;
+                    data += count;
+                    size -= count;
+
+                    if( buffered < sizeof( buffer ) ) {
+                        return;
+                    }
+
+                    sha256Blocks( state, buffer, 1 );
+                    buffered = 0;
+                }
+
+                // full blocks are hashed right from the data
+                sha256Blocks( state, data, size / 64 );
+
+                buffered = size % 64;
+                std::memcpy( buffer, data + size - buffered, buffered );
+            }
+
+            void final( std::vector<unsigned char> &digest ) const
+            {
+                Sha256State copy = *this;
+
+                unsigned char padding[72] = { 0x80 };
+                size_t paddingSize = ( buffered < 56 ? 56 : 120 ) - buffered;
+
+                for( int i = 0; i < 8; ++i ) {
+                    padding[paddingSize + i] = (unsigned char)( ( total * 8 ) >> ( 56 - 8 * i ) );
+                }
+
+                copy.update( padding, paddingSize + 8 );
+
+                for( int i = 0; i < 8; ++i ) {
+                    appendBig( digest, copy.state[i], 4 );
+                }
+            }
+        };
+
+        /* xxHash64 (seed 0)
+         */
+
+        const uint64_t kXxPrime1 = 0x9E3779B185EBCA87ULL;
+        const uint64_t kXxPrime2 = 0xC2B2AE3D27D4EB4FULL;
+        const uint64_t kXxPrime3 = 0x165667B19E3779F9ULL;
+        const uint64_t kXxPrime4 = 0x85EBCA77C2B2AE63ULL;
+        const uint64_t kXxPrime5 = 0x27D4EB2F165667C5ULL;
+
+        inline uint64_t xxRound( uint64_t accumulator, uint64_t input )
+        {
+            return rotateLeft( accumulator + input * kXxPrime2, 31 ) * kXxPrime1;
+        }
+
+        inline uint64_t xxMerge( uint64_t hash, uint64_t accumulator )
+        {
+            return ( hash ^ xxRound( 0, accumulator ) ) * kXxPrime1 + kXxPrime4;
+        }
+
+        struct XxHash64State
+        {
+            uint64_t        accumulators[4];
+            unsigned char   buffer[32];
+            size_t          buffered;
+            uint64_t        total;
+
+            XxHash64State()
+            {
+                accumulators[0] = kXxPrime1 + kXxPrime2;
+                accumulators[1] = kXxPrime2;
+                accumulators[2] = 0;
+                accumulators[3] = 0 - kXxPrime1;
+                buffered = 0;
+                total = 0;
+            }
+
+            void stripe( const unsigned char *data )
+            {
+                for( int i = 0; i < 4; ++i ) {
+                    accumulators[i] = xxRound( accumulators[i], readLittle64( data + 8 * i ) );
+                }
+            }
+
+            void update( const unsigned char *data, size_t size )
+            {
+                total += size;
+
+                if( buffered > 0 )
+                {
+                    size_t count = std::min( size, sizeof( buffer ) - buffered );
+                    std::memcpy( buffer + buffered, data, count );
+                    buffered += count;
+                    data += count;
+                    size -= count;
+
+                    if( buffered < sizeof( buffer ) ) {
+                        return;
+                    }
+
+                    stripe( buffer );
+                    buffered = 0;
+                }
+
+                for( ; size >= 32; data += 32, size -= 32 ) {
+                    stripe( data );
+                }
+
+                std::memcpy( buffer, data, size );
+                buffered = size;
+            }
+
+            void final( std::vector<unsigned char> &digest ) const
+            {
+                uint64_t hash = kXxPrime5;
+
+                if( total >= 32 )
+                {
+                    hash = rotateLeft( accumulators[0], 1 ) + rotateLeft( accumulators[1], 7 ) +
+                           rotateLeft( accumulators[2], 12 ) + rotateLeft( accumulators[3], 18 );
+
+                    for( int i = 0; i < 4; ++i ) {
+                        hash = xxMerge( hash, accumulators[i] );
+                    }
+                }
+
+                hash += total;
+
+                const unsigned char *data = buffer;
+                const unsigned char *end = buffer + buffered;
+
+                for( ; data + 8 <= end; data += 8 ) {
+                    hash = rotateLeft( hash ^ xxRound( 0, readLittle64( data ) ), 27 ) * kXxPrime1 + kXxPrime4;
+                }
+
+                if( data + 4 <= end ) {
+                    hash = rotateLeft( hash ^ ( uint64_t( readLittle32( data ) ) * kXxPrime1 ), 23 ) * kXxPrime2 + kXxPrime3;
+                    data += 4;
+                }
+
+                for( ; data < end; ++data ) {
+                    hash = rotateLeft( hash ^ ( *data * kXxPrime5 ), 11 ) * kXxPrime1;
+                }
+
+                hash ^= hash >> 33;
+                hash *= kXxPrime2;
+                hash ^= hash >> 29;
+                hash *= kXxPrime3;
+                hash ^= hash >> 32;
+
+                appendBig( digest, hash, 8 );
+            }
+        };
+
+        /* Encodings of the digests
+         */
+
+        const char kBase64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        // returns false if the text isn't base64 (standard or URL-safe alphabet, padding is optional)
+        bool decodeBase64( std::string_view text, std::vector<unsigned char> &bytes )
+        {
+            while( !text.empty() && text.back() == '=' ) {
+                text.remove_suffix( 1 );
+            }
+
+            uint32_t bits = 0;
+            int count = 0;
+
+            for( size_t i = 0; i < text.size(); ++i )
+            {
+                char c = text[i];
+                int value = c >= 'A' && c <= 'Z' ? c - 'A'
+                          : c >= 'a' && c <= 'z' ? c - 'a' + 26
+                          : c >= '0' && c <= '9' ? c - '0' + 52
+                          : c == '+' || c == '-' ? 62
+                          : c == '/' || c == '_' ? 63 : -1;
+
+                if( value < 0 ) {
+                    return false;
+                }
+
+                bits = ( bits << 6 ) | uint32_t( value );
+                count += 6;
+
+                if( count >= 8 ) {
+                    count -= 8;
+                    bytes.push_back( (unsigned char)( bits >> count ) );
+                }
+            }
+
+            return true;
+        }
+
+        inline std::string_view trimWhitespace( std::string_view text )
+        {
+            while( !text.empty() && isWhitespace( text.front() ) ) {
+                text.remove_prefix( 1 );
+            }
+
+            while( !text.empty() && isWhitespace( text.back() ) ) {
+                text.remove_suffix( 1 );
+            }
+
+            return text;
+        }
+    }
+
+    struct Digest::Pimpl
+    {
+        Algorithm       algorithm;
+        curl_off_t      size;
+
+        uint32_t        crc;
+        Sha256State     sha;
+        XxHash64State   xx;
+
+        Pimpl() : algorithm( Crc32c ), size( 0 ), crc( 0xFFFFFFFF ) { }
+    };
+
+    Digest::Digest( Algorithm algorithm )
+        : _impl( new Pimpl() )
+    {
+        _impl->algorithm = algorithm;
+    }
+
+    Digest::Digest( Digest &&other )
+    {
+        *this = std::move( other );
+    }
+
+    Digest::~Digest()
+    {
+    }
+
+    Digest &Digest::operator = ( Digest &&other )
+    {
+        if( this != &other ) {
+            _impl.reset();
+            _impl.swap( other._impl );
+        }
+
+        return *this;
+    }
+
+    Digest::Algorithm Digest::algorithm() const
+    {
+        return _impl->algorithm;
+    }
+
+    void Digest::update( const char *data, size_t size )
+    {
+        auto bytes = reinterpret_cast<const unsigned char*>( data );
+
+        switch( _impl->algorithm )
+        {
+        case Crc32c:
+            _impl->crc = crc32cUpdate( _impl->crc, bytes, size );
+            break;
+
+        case Sha256:
+            _impl->sha.update( bytes, size );
+            break;
+
+        case XxHash64:
+            _impl->xx.update( bytes, size );
+            break;
+        }
+
+        _impl->size += curl_off_t( size );
+    }
+
+    void Digest::reset()
+    {
+        Algorithm algorithm = _impl->algorithm;
+
+        *_impl = Pimpl();
+        _impl->algorithm = algorithm;
+    }
+
+    curl_off_t Digest::size() const
+    {
+        return _impl->size;
+    }
+
+    std::vector<unsigned char> Digest::value() const
+    {
+        std::vector<unsigned char> digest;
+
+        switch( _impl->algorithm )
+        {
+        case Crc32c:
+            appendBig( digest, ~_impl->crc, 4 );
+            break;
+
+        case Sha256:
+            _impl->sha.final( digest );
+            break;
+
+        case XxHash64:
+            _impl->xx.final( digest );
+            break;
+        }
+
+        return digest;
+    }
+
+    std::string Digest::hex() const
+    {
+        static const char digits[] = "0123456789abcdef";
+
+        std::string text;
+        auto digest = value();
+
+        for( auto it = digest.begin(); it != digest.end(); ++it ) {
+            text.push_back( digits[*it >> 4] );
+            text.push_back( digits[*it & 0x0f] );
+        }
+
+        return text;
+    }
+
+    std::string Digest::base64() const
+    {
+        std::string text;
+        auto digest = value();
+
+        for( size_t i = 0; i < digest.size(); i += 3 )
+        {
+            uint32_t bits = uint32_t( digest[i] ) << 16;
+            if( i + 1 < digest.size() ) bits |= uint32_t( digest[i + 1] ) << 8;
+            if( i + 2 < digest.size() ) bits |= uint32_t( digest[i + 2] );
+
+            text.push_back( kBase64Alphabet[( bits >> 18 ) & 0x3f] );
+            text.push_back( kBase64Alphabet[( bits >> 12 ) & 0x3f] );
+            text.push_back( i + 1 < digest.size() ? kBase64Alphabet[( bits >> 6 ) & 0x3f] : '=' );
+            text.push_back( i + 2 < digest.size() ? kBase64Alphabet[bits & 0x3f] : '=' );
+        }
+
+        return text;
+    }
+
+    bool Digest::matches( std::string_view expected ) const
+    {
+        expected = trimWhitespace( expected );
+
+        std::string digestHex = hex();
+        if( equalsIgnoreCase( expected, digestHex ) ) {
+            return true;
+        }
+
+        std::vector<unsigned char> bytes;
+        return decodeBase64( expected, bytes ) && bytes == value();
+    }
+
+    bool Digest::matches( Headers const &headers ) const
+    {
+        const char *key = _impl->algorithm == Sha256 ? "sha-256" : _impl->algorithm == Crc32c ? "crc32c" : nullptr;
+        if( !key ) {
+            return false;
+        }
+
+        bool found = false;
+
+        for( size_t i = 0; i < headers.size(); ++i )
+        {
+            std::string_view name = headers.name( i );
+            if( !equalsIgnoreCase( name, "content-digest" ) && !equalsIgnoreCase( name, "repr-digest" ) &&
+                !equalsIgnoreCase( name, "digest" ) && !equalsIgnoreCase( name, "x-goog-hash" ) ) {
+                continue;
+            }
+
+            // e.g. "sha-256=:base64:, sha-512=:base64:" or "crc32c=base64, md5=base64"
+            std::string_view list = headers.value( i );
+            while( !list.empty() )
+            {
+                size_t comma = list.find( ',' );
+                std::string_view item = list.substr( 0, comma );
+                list = comma == std::string_view::npos ? std::string_view() : list.substr( comma + 1 );
+
+                size_t equals = item.find( '=' );
+                if( equals == std::string_view::npos || !equalsIgnoreCase( trimWhitespace( item.substr( 0, equals ) ), key ) ) {
+                    continue;
+                }
+
+                std::string_view digest = trimWhitespace( item.substr( equals + 1 ) );
+                if( digest.size() >= 2 && digest.front() == ':' && digest.back() == ':' ) {
+                    digest = digest.substr( 1, digest.size() - 2 );
+                }
+
+                if( !matches( digest ) ) {
+                    return false;
+                }
+
+                found = true;
+            }
+        }
+
+        return found;
+    }
+
+    /* Definition of curlite::RateLimiter
+     */
+
+    RateLimiter::Pimpl::Pimpl()
+    {
+        auto now = Clock::now();
+
+        for( int i = 0; i < 2; ++i )
+        {
+            buckets[i].rate = 0;
+            buckets[i].burst = 0;
+            buckets[i].tokens = 0;
+            buckets[i].refilled = now;
+            buckets[i].transferred = 0;
+
+            virtualTime[i] = 0;
+        }
+
+        classes.push_back( TransferClass { 1, { 0, 0 } } );
+    }
+
+    void RateLimiter::Pimpl::refill( Bucket &bucket, Clock::time_point now )
+    {
+        double elapsed = std::chrono::duration<double>( now - bucket.refilled ).count();
+
+        bucket.refilled = now;
+        bucket.tokens = std::min( bucket.burst, bucket.tokens + elapsed * bucket.rate );
+    }
+
+    bool RateLimiter::Pimpl::acquire( Easy::Pimpl *transfer, Direction direction, size_t bytes )
+    {
+        std::unique_lock<std::mutex> lock( mutex );
+
+        Bucket &bucket = buckets[direction];
+        size_t transferClass = transfer->limiterClass < classes.size() ? transfer->limiterClass : 0;
+
+        if( bucket.rate > 0 )
+        {
+            refill( bucket, Clock::now() );
+
+            if( transfer->owner == nullptr )
+            {
+                // blocking transfer, nothing else runs on this thread
+                while( bucket.tokens <= 0 && bucket.rate > 0 )
+                {
+                    auto wait = std::chrono::duration<double>( -bucket.tokens / bucket.rate );
+
+                    lock.unlock();
+                    std::this_thread::sleep_for( wait );
+                    lock.lock();
+
+                    refill( bucket, Clock::now() );
+                }
+            }
+            else
+            {
+                // the class which is most behind its share goes first
+                auto &list = waiters[direction];
+                double finish = classes[transferClass].finish[direction];
+
+                bool waiting = false;
+                bool preferred = true;
+
+                for( auto it = list.begin(); it != list.end(); ++it )
+                {
+                    if( it->transfer == transfer ) {
+                        it->bytes = bytes;
+                        waiting = true;
+                    } else if( it->transfer->owner == transfer->owner && classes[it->transferClass].finish[direction] < finish ) {
+                        preferred = false;
+                    }
+                }
+
+                if( bucket.tokens <= 0 || !preferred )
+                {
+                    if( !waiting ) {
+                        list.push_back( Waiter { transfer, transferClass, bytes } );
+                    }
+
+                    transfer->throttled |= direction == Download ? CURLPAUSE_RECV : CURLPAUSE_SEND;
+                    return false;
+                }
+            }
+        }
+
+        // the tokens may go below zero, the debt is paid off by the next refills
+        bucket.tokens -= double( bytes );
+        bucket.transferred += curl_off_t( bytes );
+
+        TransferClass &group = classes[transferClass];
+        double start = std::max( group.finish[direction], virtualTime[direction] );
+
+        group.finish[direction] = start + double( bytes ) / group.weight;
+        virtualTime[direction] = start;
+
+        return true;
+    }
+
+    void RateLimiter::Pimpl::refund( Direction direction, size_t bytes )
+    {
+        if( bytes == 0 ) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock( mutex );
+
+        Bucket &bucket = buckets[direction];
+        bucket.tokens = std::min( bucket.burst, bucket.tokens + double( bytes ) );
+        bucket.transferred -= curl_off_t( bytes );
+    }
+
+    int RateLimiter::Pimpl::resume( void *owner )
+    {
+        std::vector<std::pair<Easy::Pimpl*, int>> ready;
+        int timeoutMs = -1;
+
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            auto now = Clock::now();
+
+            for( int direction = 0; direction < 2; ++direction )
+            {
+                Bucket &bucket = buckets[direction];
+                auto &list = waiters[direction];
+
+                refill( bucket, now );
+
+                // each resumed transfer is expected to take as much as it has asked for before
+                double tokens = bucket.tokens;
+
+                while( true )
+                {
+                    auto next = list.end();
+                    for( auto it = list.begin(); it != list.end(); ++it )
+                    {
+                        if( it->transfer->owner == owner && ( next == list.end() ||
+                            classes[it->transferClass].finish[direction] < classes[next->transferClass].finish[direction] ) ) {
+                            next = it;
+                        }
+                    }
+
+                    if( next == list.end() ) {
+                        break;
+                    }
+
+                    if( bucket.rate > 0 && tokens <= 0 )
+                    {
+                        int waitMs = int( std::ceil( -tokens / bucket.rate * 1000 ) );
+                        waitMs = std::max( waitMs, 1 );
+
+                        if( timeoutMs < 0 || waitMs < timeoutMs ) {
+                            timeoutMs = waitMs;
+                        }
+
+                        break;
+                    }
+
+                    tokens -= double( next->bytes );
+                    ready.push_back( std::make_pair( next->transfer, direction == Download ? CURLPAUSE_RECV : CURLPAUSE_SEND ) );
+                    list.erase( next );
+                }
+            }
+        }
+
+        // the paused data is passed to the callbacks right away, so the lock must be released
+        for( auto it = ready.begin(); it != ready.end(); ++it )
+        {
+            Easy::Pimpl *transfer = it->first;
+            transfer->throttled &= ~it->second;
+
+            curl_easy_pause( transfer->curl, transfer->userPaused | transfer->throttled );
+        }
+
+        // the resumed transfers have to be performed without waiting
+        return ready.empty() ? timeoutMs : 0;
+    }
+
+    void RateLimiter::Pimpl::forget( Easy::Pimpl *transfer )
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+
+        for( int direction = 0; direction < 2; ++direction )
+        {
+            auto &list = waiters[direction];
+            list.erase( std::remove_if( list.begin(), list.end(), [transfer] ( Waiter const &waiter ) {
+                return waiter.transfer == transfer;
+            } ), list.end() );
+        }
+    }
+
+    RateLimiter::RateLimiter( curl_off_t downloadRate, curl_off_t uploadRate )
+        : _impl( new Pimpl() )
+    {
+        setRate( Download, downloadRate );
+        setRate( Upload, uploadRate );
+    }
+
+    RateLimiter::RateLimiter( RateLimiter &&other )
+    {
+        *this = std::move( other );
+    }
+
+    RateLimiter::~RateLimiter()
+    {
+    }
+
+    RateLimiter &RateLimiter::operator = ( RateLimiter &&other )
+    {
+        if( this != &other ) {
+            _impl.reset();
+            _impl.swap( other._impl );
+        }
+
+        return *this;
+    }
+
+    void RateLimiter::setRate( Direction direction, curl_off_t bytesPerSecond, curl_off_t burst )
+    {
+        std::lock_guard<std::mutex> lock( _impl->mutex );
+
+        Pimpl::Bucket &bucket = _impl->buckets[direction];
+        _impl->refill( bucket, Pimpl::Clock::now() );
+
+        bool wasUnlimited = bucket.rate <= 0;
+
+        bucket.rate = bytesPerSecond > 0 ? double( bytesPerSecond ) : 0;
+        bucket.burst = burst > 0 ? double( burst ) : std::max( bucket.rate / 20, double( CURL_MAX_WRITE_SIZE ) );
+        bucket.tokens = wasUnlimited ? bucket.burst : std::min( bucket.tokens, bucket.burst );
+    }
+
+    curl_off_t RateLimiter::rate( Direction direction ) const
+    {
+        std::lock_guard<std::mutex> lock( _impl->mutex );
+        return curl_off_t( _impl->buckets[direction].rate );
+    }
+
+    size_t RateLimiter::addClass( unsigned weight )
+    {
+        std::lock_guard<std::mutex> lock( _impl->mutex );
+
+        // the new class starts at the current virtual time, so it doesn't get the past share
+        _impl->classes.push_back( Pimpl::TransferClass { double( std::max( weight, 1u ) ),
+                                                          { _impl->virtualTime[Download], _impl->virtualTime[Upload] } } );
+
+        return _impl->classes.size() - 1;
+    }
+
+    curl_off_t RateLimiter::transferred( Direction direction ) const
+    {
+        std::lock_guard<std::mutex> lock( _impl->mutex );
+        return _impl->buckets[direction].transferred;
+    }
+
+    /* Definition of curlite::Metrics
+     */
+
+    namespace
+    {
+        inline int highestBit( uint64_t value )
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanReverse64( &index, value );
+            return int( index );
+#else
+            return 63 - __builtin_clzll( value );
+#endif
+        }
+
+        // the counters have a single writer, so there is no need for a locked read-modify-write
+        inline void increment( std::atomic<uint64_t> &counter, uint64_t value = 1 )
+        {
+            counter.store( counter.load( std::memory_order_relaxed ) + value, std::memory_order_relaxed );
+        }
+
+        const char *const timingNames[] = {
+            "namelookup", "connect", "appconnect", "pretransfer", "starttransfer", "total"
+        };
+
+        const double secondBounds[] = {
+            0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60
+        };
+
+        const double byteBounds[] = {
+            1 << 10, 1 << 12, 1 << 14, 1 << 16, 1 << 18, 1 << 20, 1 << 22, 1 << 24, 1 << 26, 1 << 28, 1 << 30
+        };
+
+        std::string escapeLabel( std::string const &value )
+        {
+            std::string result;
+            result.reserve( value.size() );
+
+            for( char c: value )
+            {
+                if( c == '\\' || c == '"' ) {
+                    result += '\\';
+                    result += c;
+                } else if( c == '\n' ) {
+                    result += "\\n";
+                } else {
+                    result += c;
+                }
+            }
+
+            return result;
+        }
+    }
+
+    Metrics::Pimpl::Histogram::Histogram()
+    {
+        for( int i = 0; i < kBuckets; ++i ) {
+            counts[i].store( 0, std::memory_order_relaxed );
+        }
+
+        sum.store( 0, std::memory_order_relaxed );
+    }
+
+    void Metrics::Pimpl::Histogram::add( uint64_t value )
+    {
+        increment( counts[bucket( value )] );
+        increment( sum, value );
+    }
+
+    int Metrics::Pimpl::Histogram::bucket( uint64_t value )
+    {
+        const uint64_t subBuckets = uint64_t( 1 ) << kSubBucketBits;
+
+        value = std::min( value, ( uint64_t( 1 ) << kMaxValueBits ) - 1 );
+        if( value < subBuckets ) {
+            return int( value );
+        }
+
+        int shift = highestBit( value ) - kSubBucketBits;
+        return ( ( shift + 1 ) << kSubBucketBits ) + int( ( value >> shift ) & ( subBuckets - 1 ) );
+    }
+
+    uint64_t Metrics::Pimpl::Histogram::lowerBound( int bucket )
+    {
+        const int subBuckets = 1 << kSubBucketBits;
+
+        if( bucket < subBuckets ) {
+            return uint64_t( bucket );
+        }
+
+        int shift = ( bucket >> kSubBucketBits ) - 1;
+        return uint64_t( subBuckets + ( bucket & ( subBuckets - 1 ) ) ) << shift;
+    }
+
+    Metrics::Pimpl::Series::Series()
+    {
+        transfers.store( 0, std::memory_order_relaxed );
+        connections.store( 0, std::memory_order_relaxed );
+        reused.store( 0, std::memory_order_relaxed );
+
+        for( int i = 0; i < CURL_LAST; ++i ) {
+            errors[i].store( 0, std::memory_order_relaxed );
+        }
+    }
+
+    Metrics::Pimpl::Pimpl()
+    {
+        static std::atomic<uint64_t> nextId( 1 );
+        id = nextId.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    Metrics::Pimpl::Shard &Metrics::Pimpl::localShard()
+    {
+        // ids aren't reused, so the entries of destroyed metrics are never matched again
+        thread_local std::unordered_map<uint64_t, Shard*> threadShards;
+
+        Shard *&shard = threadShards[id];
+        if( shard == nullptr )
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            shards.emplace_back( new Shard() );
+            shard = shards.back().get();
+        }
+
+        return *shard;
+    }
+
+    void Metrics::Pimpl::record( CURL *curl, CURLcode result )
+    {
+        char *url = nullptr;
+        long responseCode = 0;
+        long numConnects = 0;
+
+        curl_easy_getinfo( curl, CURLINFO_EFFECTIVE_URL, &url );
+        curl_easy_getinfo( curl, CURLINFO_RESPONSE_CODE, &responseCode );
+        curl_easy_getinfo( curl, CURLINFO_NUM_CONNECTS, &numConnects );
+
+        std::string status;
+        if( result != CURLE_OK ) {
+            status = "error";
+        } else if( responseCode <= 0 || responseCode >= 1000 ) {
+            status = "none";
+        } else {
+            status = std::to_string( responseCode / 100 ) + "xx";
+        }
+
+        std::string host = url ? hostOfUrl( url ) : std::string();
+
+        // only this thread inserts into the shard, so the lookup doesn't need the lock
+        Shard &shard = localShard();
+        std::string key = status + ' ' + host;
+
+        Series *series = nullptr;
+        auto it = shard.series.find( key );
+        if( it != shard.series.end() ) {
+            series = it->second.get();
+        }
+        else
+        {
+            std::unique_ptr<Series> created( new Series() );
+            created->host = host;
+            created->status = status;
+            series = created.get();
+
+            std::lock_guard<std::mutex> lock( shard.mutex );
+            shard.series.emplace( key, std::move( created ) );
+        }
+
+        static const CURLINFO timingInfos[kTimings] = {
+            CURLINFO_NAMELOOKUP_TIME, CURLINFO_CONNECT_TIME, CURLINFO_APPCONNECT_TIME,
+            CURLINFO_PRETRANSFER_TIME, CURLINFO_STARTTRANSFER_TIME, CURLINFO_TOTAL_TIME
+        };
+
+        for( int i = 0; i < kTimings; ++i )
+        {
+            double seconds = 0;
+            curl_easy_getinfo( curl, timingInfos[i], &seconds );
+
+            // zero means the phase wasn't reached (failed transfer) or didn't happen (no TLS handshake)
+            bool skip = seconds <= 0 && ( i == AppConnect || ( result != CURLE_OK && i != Total ) );
+            if( !skip ) {
+                series->timings[i].add( uint64_t( std::max( seconds, 0.0 ) * 1e6 + 0.5 ) );
+            }
+        }
+
+#if LIBCURL_VERSION_NUM >= 0x073700
+        curl_off_t downloaded = 0;
+        curl_off_t uploaded = 0;
+        curl_easy_getinfo( curl, CURLINFO_SIZE_DOWNLOAD_T, &downloaded );
+        curl_easy_getinfo( curl, CURLINFO_SIZE_UPLOAD_T, &uploaded );
+#else
+        double downloaded = 0;
+        double uploaded = 0;
+        curl_easy_getinfo( curl, CURLINFO_SIZE_DOWNLOAD, &downloaded );
+        curl_easy_getinfo( curl, CURLINFO_SIZE_UPLOAD, &uploaded );
+#endif
+
+        series->downloaded.add( uint64_t( std::max<double>( downloaded, 0 ) ) );
+        series->uploaded.add( uint64_t( std::max<double>( uploaded, 0 ) ) );
+
+        increment( series->transfers );
+        increment( series->connections, uint64_t( std::max( numConnects, 0L ) ) );
+
+        if( result == CURLE_OK && numConnects == 0 ) {
+            increment( series->reused );
+        }
+
+        if( result != CURLE_OK && result < CURL_LAST ) {
+            increment( series->errors[result] );
+        }
+    }
+
+    template <class Fn>
+    void Metrics::Pimpl::forEach( Fn fn ) const
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+
+        for( auto const &shard: shards )
+        {
+            std::lock_guard<std::mutex> shardLock( shard->mutex );
+
+            for( auto const &it: shard->series ) {
+                fn( *it.second );
+            }
+        }
+    }
+
+    Metrics::Metrics()
+        : _impl( new Pimpl() )
+    {
+    }
+
+    Metrics::Metrics( Metrics &&other )
+    {
+        *this = std::move( other );
+    }
+
+    Metrics::~Metrics()
+    {
+    }
+
+    Metrics &Metrics::operator = ( Metrics &&other )
+    {
+        if( this != &other ) {
+            _impl.reset();
+            _impl.swap( other._impl );
+        }
+
+        return *this;
+    }
+
+    void Metrics::record( Easy const &easy )
+    {
+        _impl->record( easy.get(), easy.error() );
+    }
+
+    uint64_t Metrics::transfers() const
+    {
+        uint64_t count = 0;
+        _impl->forEach( [&count] ( Pimpl::Series const &series ) {
+            count += series.transfers.load( std::memory_order_relaxed );
+        } );
+
+        return count;
+    }
+
+    uint64_t Metrics::connections() const
+    {
+        uint64_t count = 0;
+        _impl->forEach( [&count] ( Pimpl::Series const &series ) {
+            count += series.connections.load( std::memory_order_relaxed );
+        } );
+
+        return count;
+    }
+
+    uint64_t Metrics::reusedConnections() const
+    {
+        uint64_t count = 0;
+        _impl->forEach( [&count] ( Pimpl::Series const &series ) {
+            count += series.reused.load( std::memory_order_relaxed );
+        } );
+
+        return count;
+    }
+
+    double Metrics::quantile( Timing timing, double q ) const
+    {
+        std::vector<uint64_t> counts( Pimpl::kBuckets );
+        uint64_t total = 0;
+
+        _impl->forEach( [&] ( Pimpl::Series const &series )
+        {
+            for( int i = 0; i < Pimpl::kBuckets; ++i )
+            {
+                uint64_t count = series.timings[timing].counts[i].load( std::memory_order_relaxed );
+                counts[i] += count;
+                total += count;
+            }
+        } );
+
+        if( total == 0 ) {
+            return 0;
+        }
+
+        uint64_t rank = uint64_t( std::ceil( std::min( std::max( q, 0.0 ), 1.0 ) * double( total ) ) );
+        rank = std::max( rank, uint64_t( 1 ) );
+
+        uint64_t seen = 0;
+        for( int i = 0; i < Pimpl::kBuckets; ++i )
+        {
+            seen += counts[i];
+            if( seen >= rank )
+            {
+                // middle of the bucket
+                uint64_t lower = Pimpl::Histogram::lowerBound( i );
+                uint64_t upper = Pimpl::Histogram::lowerBound( i + 1 ) - 1;
+                return double( lower + upper ) / 2 / 1e6;
+            }
+        }
+
+        return 0;
+    }
+
+    std::string Metrics::prometheus( std::string const &prefix ) const
+    {
+        // the series of all threads summed by host and status
+        struct Totals
+        {
+            std::string             host;
+            std::string             status;
+
+            std::vector<uint64_t>   counts[Pimpl::kTimings + 2];
+            uint64_t                sums[Pimpl::kTimings + 2];
+
+            uint64_t                transfers;
+            uint64_t                connections;
+            uint64_t                reused;
+            uint64_t                errors[CURL_LAST];
+        };
+
+        std::map<std::pair<std::string, std::string>, Totals> totals;
+
+        _impl->forEach( [&totals] ( Pimpl::Series const &series )
+        {
+            auto inserted = totals.emplace( std::make_pair( series.host, series.status ), Totals() );
+            Totals &sum = inserted.first->second;
+
+            if( inserted.second )
+            {
+                sum.host = series.host;
+                sum.status = series.status;
+                sum.transfers = sum.connections = sum.reused = 0;
+
+                for( int h = 0; h < Pimpl::kTimings + 2; ++h ) {
+                    sum.counts[h].assign( Pimpl::kBuckets, 0 );
+                    sum.sums[h] = 0;
+                }
+
+                for( int i = 0; i < CURL_LAST; ++i ) {
+                    sum.errors[i] = 0;
+                }
+            }
+
+            for( int h = 0; h < Pimpl::kTimings + 2; ++h )
+            {
+                Pimpl::Histogram const &histogram = h < Pimpl::kTimings ? series.timings[h]
+                                                  : h == Pimpl::kTimings ? series.downloaded : series.uploaded;
+
+                for( int i = 0; i < Pimpl::kBuckets; ++i ) {
+                    sum.counts[h][i] += histogram.counts[i].load( std::memory_order_relaxed );
+                }
+
+                sum.sums[h] += histogram.sum.load( std::memory_order_relaxed );
+            }
+
+            sum.transfers += series.transfers.load( std::memory_order_relaxed );
+            sum.connections += series.connections.load( std::memory_order_relaxed );
+            sum.reused += series.reused.load( std::memory_order_relaxed );
+
+            for( int i = 0; i < CURL_LAST; ++i ) {
+                sum.errors[i] += series.errors[i].load( std::memory_order_relaxed );
+            }
+        } );
+
+        std::ostringstream out;
+        out.precision( 12 );
+
+        auto labels = [] ( Totals const &sum ) {
+            return "host=\"" + escapeLabel( sum.host ) + "\",status=\"" + sum.status + "\"";
+        };
+
+        auto histogram = [&out, &prefix] ( std::string const &name, std::string const &labels,
+                                           std::vector<uint64_t> const &counts, uint64_t sum,
+                                           const double *bounds, size_t boundCount, double scale )
+        {
+            uint64_t cumulative = 0;
+            int bucket = 0;
+
+            for( size_t b = 0; b < boundCount; ++b )
+            {
+                // buckets which lie entirely below the bound
+                while( bucket < Pimpl::kBuckets &&
+                       double( Pimpl::Histogram::lowerBound( bucket + 1 ) - 1 ) * scale <= bounds[b] ) {
+                    cumulative += counts[bucket++];
+                }
+
+                out << prefix << name << "_bucket{" << labels << ",le=\"" << bounds[b] << "\"} " << cumulative << "\n";
+            }
+
+            while( bucket < Pimpl::kBuckets ) {
+                cumulative += counts[bucket++];
+            }
+
+            out << prefix << name << "_bucket{" << labels << ",le=\"+Inf\"} " << cumulative << "\n";
+            out << prefix << name << "_sum{" << labels << "} " << double( sum ) * scale << "\n";
+            out << prefix << name << "_count{" << labels << "} " << cumulative << "\n";
+        };
+
+        out << "# HELP " << prefix << "_transfers_total Completed transfers.\n";
+        out << "# TYPE " << prefix << "_transfers_total counter\n";
+        for( auto const &it: totals ) {
+            out << prefix << "_transfers_total{" << labels( it.second ) << "} " << it.second.transfers << "\n";
+        }
+
+        out << "# HELP " << prefix << "_connections_total New connections opened by the transfers.\n";
+        out << "# TYPE " << prefix << "_connections_total counter\n";
+        for( auto const &it: totals ) {
+            out << prefix << "_connections_total{" << labels( it.second ) << "} " << it.second.connections << "\n";
+        }
+
+        out << "# HELP " << prefix << "_reused_connections_total Transfers which reused a connection.\n";
+        out << "# TYPE " << prefix << "_reused_connections_total counter\n";
+        for( auto const &it: totals ) {
+            out << prefix << "_reused_connections_total{" << labels( it.second ) << "} " << it.second.reused << "\n";
+        }
+
+        out << "# HELP " << prefix << "_errors_total Failed transfers by libcurl error code.\n";
+        out << "# TYPE " << prefix << "_errors_total counter\n";
+        for( auto const &it: totals )
+        {
+            for( int i = 0; i < CURL_LAST; ++i )
+            {
+                if( it.second.errors[i] ) {
+                    out << prefix << "_errors_total{host=\"" << escapeLabel( it.second.host ) << "\",code=\"" << i << "\"} "
+                        << it.second.errors[i] << "\n";
+                }
+            }
+        }
+
+        out << "# HELP " << prefix << "_phase_seconds Time from the start of the transfer until the end of the phase.\n";
+        out << "# TYPE " << prefix << "_phase_seconds histogram\n";
+        for( auto const &it: totals )
+        {
+            for( int t = 0; t < Pimpl::kTimings; ++t ) {
+                histogram( "_phase_seconds", labels( it.second ) + ",phase=\"" + timingNames[t] + "\"",
+                           it.second.counts[t], it.second.sums[t],
+                           secondBounds, sizeof( secondBounds ) / sizeof( secondBounds[0] ), 1e-6 );
+            }
+        }
+
+        out << "# HELP " << prefix << "_transfer_bytes Size of the transferred body.\n";
+        out << "# TYPE " << prefix << "_transfer_bytes histogram\n";
+        for( auto const &it: totals )
+        {
+            for( int d = 0; d < 2; ++d ) {
+                histogram( "_transfer_bytes", labels( it.second ) + ( d == 0 ? ",direction=\"download\"" : ",direction=\"upload\"" ),
+                           it.second.counts[Pimpl::kTimings + d], it.second.sums[Pimpl::kTimings + d],
+                           byteBounds, sizeof( byteBounds ) / sizeof( byteBounds[0] ), 1 );
+            }
+        }
+
+        return out.str();
+    }
+
+    /* Definition of curlite::WireCapture
+     */
+
+    namespace
+    {
+        template <class T>
+        void writeLittleEndian( std::ostream &stream, T value )
+        {
+            char bytes[sizeof( T )];
+            for( size_t i = 0; i < sizeof( T ); ++i ) {
+                bytes[i] = char( uint64_t( value ) >> ( 8 * i ) );
+            }
+
+            stream.write( bytes, sizeof( T ) );
+        }
+
+        // the ranges of header values to hide, the ones past the limit are merged into the last one
+        struct RedactedRanges
+        {
+            static const size_t kMaxRanges = 8;
+
+            size_t  begin[kMaxRanges];
+            size_t  end[kMaxRanges];
+            size_t  count;
+
+            RedactedRanges() : count( 0 ) { }
+
+            void add( size_t from, size_t to )
+            {
+                if( count < kMaxRanges ) {
+                    begin[count] = from;
+                    end[count++] = to;
+                } else {
+                    end[count - 1] = to;
+                }
+            }
+
+            void apply( char *bytes, size_t offset, size_t size ) const
+            {
+                for( size_t i = 0; i < count; ++i )
+                {
+                    size_t from = std::max( begin[i], offset ), to = std::min( end[i], offset + size );
+                    for( size_t j = from; j < to; ++j ) {
+                        bytes[j - offset] = '*';
+                    }
+                }
+            }
+        };
+
+        bool startsWithName( const char *line, size_t size, const char *name, size_t nameSize )
+        {
+            if( size <= nameSize || line[nameSize] != ':' ) {
+                return false;
+            }
+
+            for( size_t i = 0; i < nameSize; ++i ) {
+                if( std::tolower( static_cast<unsigned char>( line[i] ) ) != name[i] ) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        // finds the values of the headers with credentials in the header lines
+        void findCredentials( const char *data, size_t size, RedactedRanges &ranges )
+        {
+            static const std::pair<const char*, size_t> names[] = {
+                { "authorization", 13 }, { "proxy-authorization", 19 }, { "cookie", 6 }, { "set-cookie", 10 }
+            };
+
+            for( size_t line = 0; line < size; )
+            {
+                const char *newLine = static_cast<const char*>( std::memchr( data + line, '\n', size - line ) );
+                size_t lineEnd = newLine ? size_t( newLine - data ) : size;
+
+                for( auto const &name: names )
+                {
+                    if( startsWithName( data + line, lineEnd - line, name.first, name.second ) ) {
+                        size_t value = line + name.second + 1;
+                        size_t valueEnd = data[lineEnd - 1] == '\r' ? lineEnd - 1 : lineEnd;
+
+                        while( value < valueEnd && data[value] == ' ' ) {
+                            value++;
+                        }
+
+                        ranges.add( value, valueEnd );
+                        break;
+                    }
+                }
+
+                line = lineEnd + 1;
+            }
+        }
+    }
+
+    WireCapture::Pimpl::Pimpl( size_t bytesPerThread, size_t maxPayload )
+        : bytesPerThread( bytesPerThread ), maxPayload( std::min<size_t>( maxPayload, 0xffff ) ), nextTransfer( 1 ),
+          redact( true )
+    {
+        static std::atomic<uint64_t> nextId( 1 );
+        id = nextId.fetch_add( 1, std::memory_order_relaxed );
+
+        slotWords = kHeaderWords + ( this->maxPayload + 7 ) / 8;
+        start = Clock::now();
+        startTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch() ).count();
+    }
+
+    WireCapture::Pimpl::Ring &WireCapture::Pimpl::localRing()
+    {
+        // ids aren't reused, so the rings of destroyed recorders are never matched again
+        thread_local uint64_t lastId = 0;
+        thread_local Ring *lastRing = nullptr;
+
+        if( lastId == id ) {
+            return *lastRing;
+        }
+
+        thread_local std::unordered_map<uint64_t, Ring*> threadRings;
+
+        Ring *&ring = threadRings[id];
+        if( ring == nullptr )
+        {
+            std::unique_ptr<Ring> created( new Ring() );
+            created->slots = std::max<size_t>( bytesPerThread / ( slotWords * sizeof( uint64_t ) ), 1 );
+            created->words.reset( new std::atomic<uint64_t>[created->slots * slotWords] );
+            created->written.store( 0, std::memory_order_relaxed );
+
+            std::lock_guard<std::mutex> lock( mutex );
+            rings.push_back( std::move( created ) );
+            ring = rings.back().get();
+        }
+
+        lastId = id;
+        lastRing = ring;
+        return *ring;
+    }
+
+    void WireCapture::Pimpl::record( uint32_t transfer, curl_infotype type, const char *data, size_t size )
+    {
+        Ring &ring = localRing();
+
+        uint64_t sequence = ring.written.load( std::memory_order_relaxed );
+        std::atomic<uint64_t> *slot = &ring.words[( sequence % ring.slots ) * slotWords];
+
+        size_t stored = std::min( size, maxPayload );
+        uint64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>( Clock::now() - start ).count();
+
+        RedactedRanges ranges;
+        if( ( type == CURLINFO_HEADER_OUT || type == CURLINFO_HEADER_IN ) && redact.load( std::memory_order_relaxed ) ) {
+            findCredentials( data, stored, ranges );
+        }
+
+        // a reader which sees any word of the slot overwritten, also sees the event as unfinished
+        std::atomic_thread_fence( std::memory_order_release );
+
+        slot[0].store( time, std::memory_order_relaxed );
+        slot[1].store( uint64_t( transfer ) | uint64_t( type & 0xff ) << 32 | uint64_t( stored ) << 40, std::memory_order_relaxed );
+        slot[2].store( uint64_t( size ), std::memory_order_relaxed );
+
+        for( size_t offset = 0, word = kHeaderWords; offset < stored; offset += 8, ++word )
+        {
+            char bytes[8] = { 0 };
+            size_t count = std::min<size_t>( 8, stored - offset );
+
+            std::memcpy( bytes, data + offset, count );
+            ranges.apply( bytes, offset, count );
+
+            uint64_t value;
+            std::memcpy( &value, bytes, 8 );
+            slot[word].store( value, std::memory_order_relaxed );
+        }
+
+        ring.written.store( sequence + 1, std::memory_order_release );
+    }
+
+    std::vector<WireCapture::Pimpl::Event> WireCapture::Pimpl::snapshot() const
+    {
+        std::vector<Event> events;
+        std::vector<uint64_t> words;
+
+        std::lock_guard<std::mutex> lock( mutex );
+
+        for( auto const &ring: rings )
+        {
+            uint64_t published = ring->written.load( std::memory_order_acquire );
+            uint64_t first = published > ring->slots ? published - ring->slots : 0;
+
+            words.resize( size_t( published - first ) * slotWords );
+            for( uint64_t sequence = first; sequence < published; ++sequence )
+            {
+                const std::atomic<uint64_t> *slot = &ring->words[( sequence % ring->slots ) * slotWords];
+                uint64_t *copy = &words[size_t( sequence - first ) * slotWords];
+
+                for( size_t i = 0; i < slotWords; ++i ) {
+                    copy[i] = slot[i].load( std::memory_order_relaxed );
+                }
+            }
+
+            // the slots, which the writer could have reused meanwhile, are dropped
+            std::atomic_thread_fence( std::memory_order_acquire );
+            uint64_t written = ring->written.load( std::memory_order_relaxed );
+            uint64_t valid = written >= ring->slots ? written - ring->slots + 1 : 0;
+
+            for( uint64_t sequence = std::max( first, valid ); sequence < published; ++sequence )
+            {
+                const uint64_t *copy = &words[size_t( sequence - first ) * slotWords];
+                size_t stored = size_t( copy[1] >> 40 ) & 0xffff;
+
+                Event event;
+                event.time = copy[0];
+                event.transfer = uint32_t( copy[1] );
+                event.type = uint8_t( copy[1] >> 32 );
+                event.size = copy[2];
+                event.data.resize( stored );
+
+                if( stored ) {
+                    std::memcpy( event.data.data(), copy + kHeaderWords, stored );
+                }
+
+                events.push_back( std::move( event ) );
+            }
+        }
+
+        std::stable_sort( events.begin(), events.end(), [] ( Event const &a, Event const &b ) {
+            return a.time < b.time;
+        } );
+
+        return events;
+    }
+
+    bool WireCapture::Pimpl::write( std::ostream &stream ) const
+    {
+        std::vector<Event> events = snapshot();
+
+        stream.write( "CURLWIRE", 8 );
+        writeLittleEndian<uint32_t>( stream, 1 );
+        writeLittleEndian<uint32_t>( stream, uint32_t( maxPayload ) );
+        writeLittleEndian<int64_t>( stream, startTime );
+        writeLittleEndian<uint64_t>( stream, events.size() );
+
+        for( auto const &event: events )
+        {
+            writeLittleEndian<uint64_t>( stream, event.time );
+            writeLittleEndian<uint32_t>( stream, event.transfer );
+            writeLittleEndian<uint8_t>( stream, event.type );
+            writeLittleEndian<uint8_t>( stream, 0 );
+            writeLittleEndian<uint16_t>( stream, uint16_t( event.data.size() ) );
+            writeLittleEndian<uint64_t>( stream, event.size );
+            stream.write( event.data.data(), std::streamsize( event.data.size() ) );
+        }
+
+        return bool( stream );
+    }
+
+    bool WireCapture::Pimpl::write( std::string const &path ) const
+    {
+        std::ofstream file( path, std::ios::binary | std::ios::trunc );
+        return file && write( file ) && file.flush();
+    }
+
+    WireCapture::WireCapture( size_t bytesPerThread, size_t maxPayload )
+        : _impl( new Pimpl( bytesPerThread, maxPayload ) )
+    {
+    }
+
+    WireCapture::WireCapture( WireCapture &&other )
+    {
+        *this = std::move( other );
+    }
+
+    WireCapture::~WireCapture()
+    {
+    }
+
+    WireCapture &WireCapture::operator = ( WireCapture &&other )
+    {
+        if( this != &other ) {
+            _impl.reset();
+            _impl.swap( other._impl );
+        }
+
+        return *this;
+    }
+
+    void WireCapture::dumpOnError( std::string const &path )
+    {
+        std::lock_guard<std::mutex> lock( _impl->mutex );
+        _impl->errorPath = path;
+    }
+
+    void WireCapture::redactCredentials( bool redact )
+    {
+        _impl->redact.store( redact, std::memory_order_relaxed );
+    }
+
+    bool WireCapture::dump( std::ostream &stream ) const
+    {
+        return _impl->write( stream );
+    }
+
+    bool WireCapture::dump( std::string const &path ) const
+    {
+        return _impl->write( path );
+    }
+
+    uint64_t WireCapture::events() const
+    {
+        uint64_t count = 0;
+
+        std::lock_guard<std::mutex> lock( _impl->mutex );
+        for( auto const &ring: _impl->rings ) {
+            count += ring->written.load( std::memory_order_relaxed );
+        }
+
+        return count;
+    }
+
+    /* Definition of curlite::DnsCache
+     */
+
+    namespace
+    {
+        // addresses of the host by getaddrinfo(), the TTL isn't known
+        std::vector<std::string> resolveHost( std::string const &host, std::chrono::seconds & )
+        {
+            std::vector<std::string> addresses;
+
+            addrinfo hints;
+            std::memset( &hints, 0, sizeof( hints ) );
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+
+            addrinfo *result = nullptr;
+            if( getaddrinfo( host.c_str(), nullptr, &hints, &result ) != 0 ) {
+                return addresses;
+            }
+
+            for( addrinfo *it = result; it != nullptr; it = it->ai_next )
+            {
+                char address[NI_MAXHOST];
+                if( getnameinfo( it->ai_addr, socklen_t( it->ai_addrlen ), address, sizeof( address ),
+                                 nullptr, 0, NI_NUMERICHOST ) != 0 ) {
+                    continue;
+                }
+
+                if( std::find( addresses.begin(), addresses.end(), address ) == addresses.end() ) {
+                    addresses.push_back( address );
+                }
+            }
+
+            freeaddrinfo( result );
+            return addresses;
+        }
+
+        std::string toLower( std::string value )
+        {
+            std::transform( value.begin(), value.end(), value.begin(), [] ( unsigned char c ) {
+                return char( std::tolower( c ) );
+            } );
+
+            return value;
+        }
+
+        // splits "example.com:8080" of the URL, the port defaults to the one of the scheme
+        bool hostAndPortOfUrl( std::string_view url, std::string &host, std::string &port )
+        {
+            size_t scheme = url.find( "://" );
+            if( scheme == std::string_view::npos ) {
+                return false;
+            }
+
+            std::string authority = hostOfUrl( url );
+            if( authority.empty() || authority[0] == '[' ) {
+                // an IPv6 literal doesn't need resolving
+                return false;
+            }
+
+            size_t colon = authority.rfind( ':' );
+            if( colon != std::string::npos ) {
+                host = authority.substr( 0, colon );
+                port = authority.substr( colon + 1 );
+                return !host.empty() && !port.empty();
+            }
+
+            static const std::pair<const char*, const char*> defaultPorts[] = {
+                { "http", "80" }, { "https", "443" }, { "ws", "80" }, { "wss", "443" },
+                { "ftp", "21" }, { "ftps", "990" }
+            };
+
+            std::string schemeName = toLower( std::string( url.substr( 0, scheme ) ) );
+            for( auto const &it: defaultPorts )
+            {
+                if( schemeName == it.first ) {
+                    host = authority;
+                    port = it.second;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+    }
+
+    DnsCache::Pimpl::Pimpl( std::chrono::seconds ttl, size_t threads )
+        : ttl( std::max( ttl, std::chrono::seconds( 1 ) ) ), threads( std::max<size_t>( threads, 1 ) ),
+          resolver( &resolveHost ), stopping( false )
+    {
+        refresher = std::thread( [this] { refreshLoop(); } );
+    }
+
+    DnsCache::Pimpl::~Pimpl()
+    {
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            stopping = true;
+        }
+
+        changed.notify_all();
+        refresher.join();
+    }
+
+    DnsCache::Pimpl::Entry &DnsCache::Pimpl::entry( std::string const &host )
+    {
+        auto it = entries.find( host );
+        if( it != entries.end() ) {
+            return it->second;
+        }
+
+        Entry &created = entries[host];
+        created.expires = Clock::time_point();
+        created.refreshAt = Clock::now();
+        created.isStatic = false;
+        created.resolving = false;
+        created.used = true;
+
+        return created;
+    }
+
+    size_t DnsCache::Pimpl::resolveAll( std::vector<std::string> const &hosts )
+    {
+        std::atomic<size_t> next( 0 );
+        std::atomic<size_t> resolved( 0 );
+
+        auto worker = [&] ()
+        {
+            for( size_t i; ( i = next.fetch_add( 1 ) ) < hosts.size(); )
+            {
+                if( resolve( hosts[i] ) ) {
+                    resolved.fetch_add( 1 );
+                }
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for( size_t i = 1; i < std::min( threads, hosts.size() ); ++i ) {
+            pool.emplace_back( worker );
+        }
+
+        worker();
+
+        for( auto &thread: pool ) {
+            thread.join();
+        }
+
+        return resolved.load();
+    }
+
+    bool DnsCache::Pimpl::resolve( std::string const &host )
+    {
+        Resolver currentResolver;
+        std::chrono::seconds hostTtl;
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            currentResolver = resolver;
+            hostTtl = ttl;
+        }
+
+        std::vector<std::string> addresses = currentResolver( host, hostTtl );
+
+        std::lock_guard<std::mutex> lock( mutex );
+
+        Entry &cached = entry( host );
+        cached.resolving = false;
+
+        if( cached.isStatic ) {
+            return true;
+        }
+
+        if( addresses.empty() )
+        {
+            // nothing to fall back on, the host is queued again by the next transfer which needs it
+            if( cached.expires <= Clock::now() ) {
+                entries.erase( host );
+                return false;
+            }
+
+            // try again soon, the old addresses are used until they expire
+            cached.refreshAt = Clock::now() + std::min( ttl, std::chrono::seconds( 5 ) );
+            return false;
+        }
+
+        // 0 would make it static
+        store( cached, addresses, std::max( hostTtl, std::chrono::seconds( 1 ) ) );
+        return true;
+    }
+
+    void DnsCache::Pimpl::store( Entry &entry, std::vector<std::string> const &addresses, std::chrono::seconds ttl )
+    {
+        entry.addresses = addresses;
+        entry.resolve.clear();
+
+        for( auto const &address: addresses )
+        {
+            if( !entry.resolve.empty() ) {
+                entry.resolve += ',';
+            }
+
+            // IPv6 addresses are bracketed in CURLOPT_RESOLVE
+            bool ipv6 = address.find( ':' ) != std::string::npos && address[0] != '[';
+            entry.resolve += ipv6 ? "[" + address + "]" : address;
+        }
+
+        entry.isStatic = ttl.count() == 0;
+        if( !entry.isStatic )
+        {
+            auto now = Clock::now();
+            entry.expires = now + ttl;
+
+            // a bit ahead of the expiry, so the transfers never see it expired
+            entry.refreshAt = now + std::max<Clock::duration>( ttl - ttl / 10, ttl - std::chrono::seconds( 5 ) );
+        }
+
+        entry.used = false;
+    }
+
+    void DnsCache::Pimpl::refreshLoop()
+    {
+        std::unique_lock<std::mutex> lock( mutex );
+
+        while( !stopping )
+        {
+            auto now = Clock::now();
+            auto wakeUp = now + std::chrono::hours( 1 );
+
+            std::vector<std::string> due;
+
+            for( auto it = entries.begin(); it != entries.end(); )
+            {
+                Entry &entry = it->second;
+
+                if( entry.isStatic || entry.resolving ) {
+                    ++it;
+                    continue;
+                }
+
+                if( !entry.used )
+                {
+                    // nobody has needed it since it was resolved
+                    if( entry.expires <= now ) {
+                        it = entries.erase( it );
+                        continue;
+                    }
+
+                    wakeUp = std::min( wakeUp, entry.expires );
+                }
+                else if( entry.refreshAt <= now ) {
+                    entry.resolving = true;
+                    due.push_back( it->first );
+                }
+                else {
+                    wakeUp = std::min( wakeUp, entry.refreshAt );
+                }
+
+                ++it;
+            }
+
+            if( due.empty() ) {
+                changed.wait_until( lock, wakeUp );
+                continue;
+            }
+
+            lock.unlock();
+            resolveAll( due );
+            lock.lock();
+        }
+    }
+
+    void DnsCache::Pimpl::inject( CURL *curl, List &resolveList )
+    {
+        char *url = nullptr;
+        curl_easy_getinfo( curl, CURLINFO_EFFECTIVE_URL, &url );
+
+        std::string host, port;
+        if( url == nullptr || !hostAndPortOfUrl( url, host, port ) ) {
+            return;
+        }
+
+        std::string resolve;
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+
+            auto it = entries.find( host );
+            if( it == entries.end() )
+            {
+                // cURL resolves it this time, the cache does it for the next transfers
+                entry( host );
+                changed.notify_one();
+                return;
+            }
+
+            Entry &cached = it->second;
+            cached.used = true;
+
+            if( cached.isStatic || Clock::now() < cached.expires ) {
+                resolve = cached.resolve;
+            }
+        }
+
+        // the previous injection (or an expired one) is replaced
+        List list;
+        list.append( ( "-" + host + ":" + port ).c_str() );
+
+        if( !resolve.empty() ) {
+            list.append( ( host + ":" + port + ":" + resolve ).c_str() );
+        }
+
+        if( curl_easy_setopt( curl, CURLOPT_RESOLVE, list.get() ) == CURLE_OK ) {
+            resolveList = std::move( list );
+        }
+    }
+
+    DnsCache::DnsCache( std::chrono::seconds ttl, size_t threads )
+        : _impl( new Pimpl( ttl, threads ) )
+    {
+    }
+
+    DnsCache::DnsCache( DnsCache &&other )
+    {
+        *this = std::move( other );
+    }
+
+    DnsCache::~DnsCache()
+    {
+    }
+
+    DnsCache &DnsCache::operator = ( DnsCache &&other )
+    {
+        if( this != &other ) {
+            _impl.reset();
+            _impl.swap( other._impl );
+        }
+
+        return *this;
+    }
+
+    void DnsCache::setResolver( Resolver resolver )
+    {
+        std::lock_guard<std::mutex> lock( _impl->mutex );
+        _impl->resolver = resolver ? resolver : Resolver( &resolveHost );
+    }
+
+    size_t DnsCache::warmUp( std::vector<std::string> const &hosts )
+    {
+        std::vector<std::string> names;
+        names.reserve( hosts.size() );
+
+        {
+            std::lock_guard<std::mutex> lock( _impl->mutex );
+
+            for( auto const &host: hosts )
+            {
+                std::string name = toLower( host );
+
+                // the background thread leaves it alone until it's resolved here
+                _impl->entry( name ).resolving = true;
+                names.push_back( name );
+            }
+        }
+
+        size_t resolved = _impl->resolveAll( names );
+
+        // marks them as used, so the background thread keeps them fresh (the failed ones are gone)
+        std::lock_guard<std::mutex> lock( _impl->mutex );
+        for( auto const &name: names )
+        {
+            auto it = _impl->entries.find( name );
+            if( it != _impl->entries.end() ) {
+                it->second.used = true;
+            }
+        }
+
+        _impl->changed.notify_one();
+        return resolved;
+    }
+
+    void DnsCache::add( std::string const &host, std::vector<std::string> const &addresses, std::chrono::seconds ttl )
+    {
+        std::lock_guard<std::mutex> lock( _impl->mutex );
+
+        auto &entry = _impl->entry( toLower( host ) );
+        _impl->store( entry, addresses, ttl );
+        entry.used = true;
+
+        _impl->changed.notify_one();
+    }
+
+    std::vector<std::string> DnsCache::lookup( std::string const &host ) const
+    {
+        std::lock_guard<std::mutex> lock( _impl->mutex );
+
+        auto it = _impl->entries.find( toLower( host ) );
+        if( it == _impl->entries.end() ) {
+            return std::vector<std::string>();
+        }
+
+        auto const &entry = it->second;
+        bool fresh = entry.isStatic || Pimpl::Clock::now() < entry.expires;
+
+        return fresh ? entry.addresses : std::vector<std::string>();
+    }
+
+    bool DnsCache::loadHosts( std::string const &path )
+    {
+        std::ifstream file( path );
+        if( !file ) {
+            return false;
+        }
+
+        std::unordered_map<std::string, std::vector<std::string>> hosts;
+        std::vector<std::string> order;
+
+        std::string line;
+        while( std::getline( file, line ) )
+        {
+            line = line.substr( 0, line.find( '#' ) );
+
+            std::istringstream fields( line );
+            std::string address, name;
+
+            if( !( fields >> address ) ) {
+                continue;
+            }
+
+            while( fields >> name )
+            {
+                name = toLower( name );
+                if( !hosts.count( name ) ) {
+                    order.push_back( name );
+                }
+
+                hosts[name].push_back( address );
+            }
+        }
+
+        for( auto const &name: order ) {
+            add( name, hosts[name] );
+        }
+
+        return !file.bad();
+    }
+
+    bool DnsCache::save( std::string const &path ) const
+    {
+        std::ofstream file( path, std::ios::trunc );
+        if( !file ) {
+            return false;
+        }
+
+        auto now = Pimpl::Clock::now();
+        auto unixNow = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch() ).count();
+
+        std::lock_guard<std::mutex> lock( _impl->mutex );
+
+        for( auto const &it: _impl->entries )
+        {
+            auto const &entry = it.second;
+            if( entry.addresses.empty() ) {
+                continue;
+            }
+
+            file << it.first << " ";
+
+            if( entry.isStatic ) {
+                file << "static";
+            } else {
+                file << unixNow + std::chrono::duration_cast<std::chrono::seconds>( entry.expires - now ).count();
+            }
+
+            for( size_t i = 0; i < entry.addresses.size(); ++i ) {
+                file << ( i ? "," : " " ) << entry.addresses[i];
+            }
+
+            file << "\n";
+        }
+
+        return bool( file.flush() );
+    }
+
+    bool DnsCache::load( std::string const &path )
+    {
+        std::ifstream file( path );
+        if( !file ) {
+            return false;
+        }
+
+        auto unixNow = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch() ).count();
+
+        std::lock_guard<std::mutex> lock( _impl->mutex );
+
+        std::string line;
+        while( std::getline( file, line ) )
+        {
+            std::istringstream fields( line );
+            std::string host, expiry, list;
+
+            if( !( fields >> host >> expiry >> list ) ) {
+                continue;
+            }
+
+            std::vector<std::string> addresses;
+            for( size_t start = 0; start <= list.size(); )
+            {
+                size_t end = std::min( list.find( ',', start ), list.size() );
+                if( end > start ) {
+                    addresses.push_back( list.substr( start, end - start ) );
+                }
+
+                start = end + 1;
+            }
+
+            auto &entry = _impl->entry( host );
+
+            if( expiry == "static" ) {
+                _impl->store( entry, addresses, std::chrono::seconds( 0 ) );
+                continue;
+            }
+
+            long long left = std::atoll( expiry.c_str() ) - unixNow;
+            if( left > 0 ) {
+                _impl->store( entry, addresses, std::chrono::seconds( left ) );
+            }
+
+            // kept fresh by the background thread as if it had been used
+            entry.used = true;
+        }
+
+        _impl->changed.notify_one();
+        return !file.bad();
+    }
+
+#ifdef __linux__
+
+    /* Definition of curlite::FileSink
+     */
+
+    struct FileSink::Pimpl
+    {
+        // O_DIRECT requires aligned buffers, offsets and sizes
+        static const size_t kAlignment = 4096;
+        static const size_t kDirectBufferSize = 1 << 20;
+
+        std::string     path;
+        std::string     tempPath;
+        int             fd;
+        int             flags;
+
+        curl_off_t      size;
+        curl_off_t      allocated;
+
+        char           *map;
+        size_t          mapSize;
+
+        char           *buffer;
+        size_t          buffered;
+
+        Pimpl();
+        ~Pimpl();
+
+        bool pwriteAll( char const *data, size_t length, curl_off_t offset );
+        bool flushBuffer( bool final );
+        void unmap();
+    };
+
+    FileSink::Pimpl::Pimpl()
+    {
+        fd = -1;
+        flags = 0;
+        size = 0;
+        allocated = 0;
+        map = nullptr;
+        mapSize = 0;
+        buffer = nullptr;
+        buffered = 0;
+    }
+
+    FileSink::Pimpl::~Pimpl()
+    {
+        unmap();
+        free( buffer );
+
+        if( fd >= 0 ) {
+            close( fd );
+            unlink( tempPath.c_str() );
+        }
+    }
+
+    bool FileSink::Pimpl::pwriteAll( char const *data, size_t length, curl_off_t offset )
+    {
+        while( length > 0 )
+        {
+            ssize_t written = pwrite( fd, data, length, offset );
+            if( written < 0 )
+            {
+                if( errno == EINTR ) {
+                    continue;
+                }
+
+                return false;
+            }
+
+            data += written;
+            length -= size_t( written );
+            offset += written;
+        }
+
+        return true;
+    }
+
+    bool FileSink::Pimpl::flushBuffer( bool final )
+    {
+        if( buffered == 0 ) {
+            return true;
+        }
+
+        // the tail is padded to the alignment, the file is truncated to the real size on commit
+        size_t length = buffered;
+        if( final ) {
+            length = ( buffered + kAlignment - 1 ) / kAlignment * kAlignment;
+            std::memset( buffer + buffered, 0, length - buffered );
+        }
+
+        if( !pwriteAll( buffer, length, size - curl_off_t( buffered ) ) ) {
+            return false;
+        }
+
+        buffered = 0;
+        return true;
+    }
+
+    void FileSink::Pimpl::unmap()
+    {
+        if( map ) {
+            munmap( map, mapSize );
+            map = nullptr;
+            mapSize = 0;
+        }
+    }
+
+    FileSink::FileSink( std::string const &path, int flags )
+        : _impl( new Pimpl() )
+    {
+        _impl->path = path;
+        _impl->flags = flags;
+
+        // temporary file must be on the same file system to be renamed atomically
+        std::vector<char> temp( path.begin(), path.end() );
+        std::string suffix = ".curlite.XXXXXX";
+        temp.insert( temp.end(), suffix.begin(), suffix.end() );
+        temp.push_back( '\0' );
+
+        _impl->fd = mkostemp( temp.data(), O_CLOEXEC );
+        if( _impl->fd < 0 ) {
+            throw Exception( "can't create temporary file" );
+        }
+
+        _impl->tempPath = temp.data();
+
+        if( flags & DirectIo )
+        {
+            if( posix_memalign( (void**) &_impl->buffer, Pimpl::kAlignment, Pimpl::kDirectBufferSize ) != 0 ) {
+                _impl->buffer = nullptr;
+            }
+
+            // not all file systems support O_DIRECT, in that case page cache is used
+            if( _impl->buffer && fcntl( _impl->fd, F_SETFL, fcntl( _impl->fd, F_GETFL ) | O_DIRECT ) != 0 ) {
+                free( _impl->buffer );
+                _impl->buffer = nullptr;
+            }
+        }
+    }
+
+    FileSink::FileSink( FileSink &&other )
+    {
+        *this = std::move( other );
+    }
+
+    FileSink::~FileSink()
+    {
+    }
+
+    FileSink &FileSink::operator = ( FileSink &&other )
+    {
+        if( this != &other ) {
+            _impl.reset();
+            _impl.swap( other._impl );
+        }
+
+        return *this;
+    }
+
+    std::string const &FileSink::path() const
+    {
+        return _impl->path;
+    }
+
+    curl_off_t FileSink::size() const
+    {
+        return _impl->size;
+    }
+
+    bool FileSink::reserve( curl_off_t size )
+    {
+        if( _impl->fd < 0 || size <= _impl->allocated ) {
+            return _impl->fd >= 0;
+        }
+
+        // file systems without fallocate() support still work, just without preallocation and mapping:
+        // a write to an unallocated page of the mapping raises SIGBUS, if the disk is full
+        if( fallocate( _impl->fd, 0, 0, size ) != 0 ) {
+            return true;
+        }
+
+        _impl->allocated = size;
+
+        if( ( _impl->flags & Mmap ) && _impl->map == nullptr && _impl->size == 0 && _impl->buffered == 0 )
+        {
+            void *map = mmap( nullptr, size_t( size ), PROT_WRITE, MAP_SHARED, _impl->fd, 0 );
+            if( map != MAP_FAILED )
+            {
+                _impl->map = (char*) map;
+                _impl->mapSize = size_t( size );
+                madvise( map, _impl->mapSize, MADV_SEQUENTIAL );
+
+                // mapped file goes through page cache anyway, and the rest can't be aligned for O_DIRECT
+                if( _impl->buffer ) {
+                    fcntl( _impl->fd, F_SETFL, fcntl( _impl->fd, F_GETFL ) & ~O_DIRECT );
+                    free( _impl->buffer );
+                    _impl->buffer = nullptr;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool FileSink::write( char const *data, size_t size )
+    {
+        auto impl = _impl.get();
+        if( impl->fd < 0 ) {
+            return false;
+        }
+
+        // mapped part of the file
+        if( impl->map && size_t( impl->size ) < impl->mapSize )
+        {
+            size_t length = std::min( size, impl->mapSize - size_t( impl->size ) );
+            std::memcpy( impl->map + impl->size, data, length );
+
+            impl->size += length;
+            data += length;
+            size -= length;
+        }
+
+        if( size == 0 ) {
+            return true;
+        }
+
+        if( impl->buffer == nullptr )
+        {
+            if( !impl->pwriteAll( data, size, impl->size ) ) {
+                return false;
+            }
+
+            impl->size += size;
+            return true;
+        }
+
+        // direct I/O goes through the aligned buffer
+        while( size > 0 )
+        {
+            size_t length = std::min( size, Pimpl::kDirectBufferSize - impl->buffered );
+            std::memcpy( impl->buffer + impl->buffered, data, length );
+
+            impl->buffered += length;
+            impl->size += length;
+            data += length;
+            size -= length;
+
+            if( impl->buffered == Pimpl::kDirectBufferSize && !impl->flushBuffer( false ) ) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool FileSink::writeAt( curl_off_t offset, char const *data, size_t size )
+    {
+        auto impl = _impl.get();
+        if( impl->fd < 0 || impl->buffer || offset < 0 ) {
+            return false;
+        }
+
+        curl_off_t end = offset + curl_off_t( size );
+
+        if( impl->map && size_t( offset ) < impl->mapSize )
+        {
+            size_t length = std::min( size, impl->mapSize - size_t( offset ) );
+            std::memcpy( impl->map + offset, data, length );
+
+            offset += length;
+            data += length;
+            size -= length;
+        }
+
+        if( size > 0 && !impl->pwriteAll( data, size, offset ) ) {
+            return false;
+        }
+
+        impl->size = std::max( impl->size, end );
+        return true;
+    }
+
+    namespace
+    {
+        // umask() can only be read by changing it, which races with other threads creating files
+        mode_t processUmask()
+        {
+            unsigned mask = 022;
+
+            if( FILE *status = fopen( "/proc/self/status", "re" ) )
+            {
+                char line[256];
+                while( fgets( line, sizeof( line ), status ) ) {
+                    if( sscanf( line, "Umask: %o", &mask ) == 1 ) {
+                        break;
+                    }
+                }
+
+                fclose( status );
+            }
+
+            return mode_t( mask );
+        }
+    }
+
+    bool FileSink::commit()
+    {
+        auto impl = _impl.get();
+        if( impl->fd < 0 ) {
+            return false;
+        }
+
+        // mkostemp() creates the file accessible only by the owner, the replaced file keeps its permissions
+        struct stat existing;
+        if( stat( impl->path.c_str(), &existing ) == 0 ) {
+            fchmod( impl->fd, existing.st_mode & 07777 );
+        } else {
+            fchmod( impl->fd, 0666 & ~processUmask() );
+        }
+
+        impl->unmap();
+
+        bool ok = impl->flushBuffer( true );
+
+        // drop preallocated space or padding beyond the real end of file
+        struct stat st;
+        if( ok && fstat( impl->fd, &st ) == 0 && st.st_size != impl->size ) {
+            ok = ftruncate( impl->fd, impl->size ) == 0;
+        }
+
+        ok = ok && fsync( impl->fd ) == 0;
+        ok = ok && rename( impl->tempPath.c_str(), impl->path.c_str() ) == 0;
+
+        if( !ok ) {
+            discard();
+            return false;
+        }
+
+        close( impl->fd );
+        impl->fd = -1;
+
+        return true;
+    }
+
+    void FileSink::discard()
+    {
+        auto impl = _impl.get();
+
+        impl->unmap();
+
+        if( impl->fd >= 0 ) {
+            close( impl->fd );
+            unlink( impl->tempPath.c_str() );
+            impl->fd = -1;
+        }
+    }
+
+    /* Definition of curlite::FileSource
+     */
+
+    struct FileSource::Pimpl
+    {
+        int             fd;
+        bool            ownDescriptor;
+
+        // file offsets, the upload starts at base (offset of the descriptor when it's passed in)
+        curl_off_t      base;
+        curl_off_t      size;
+        curl_off_t      position;
+
+        // where the upload by Easy::readFrom() starts, cURL rewinds the file to it
+        curl_off_t      uploadStart;
+
+        // pipes, sockets, ...: read sequentially, the size is unknown (-1)
+        bool            stream;
+
+        char           *map;
+
+        Pimpl();
+        ~Pimpl();
+
+        void open( int flags );
+        size_t readData( char *buffer, size_t length );
+        bool seekTo( curl_off_t offset, int origin, curl_off_t start );
+
+        // static cURL callbacks
+        static size_t read( char *data, size_t size, size_t n, void *userPtr );
+        static int seek( void *userPtr, curl_off_t offset, int origin );
+    };
+
+    FileSource::Pimpl::Pimpl()
+    {
+        fd = -1;
+        ownDescriptor = false;
+        base = 0;
+        size = 0;
+        position = 0;
+        uploadStart = 0;
+        stream = false;
+        map = nullptr;
+    }
+
+    FileSource::Pimpl::~Pimpl()
+    {
+        if( map ) {
+            munmap( map, size_t( size ) );
+        }
+
+        if( fd >= 0 && ownDescriptor ) {
+            close( fd );
+        }
+    }
+
+    void FileSource::Pimpl::open( int flags )
+    {
+        struct stat st;
+        if( fstat( fd, &st ) != 0 ) {
+            throw Exception( "can't get file size" );
+        }
+
+        // non-regular files (pipes, sockets) have no size and are not seekable
+        if( !S_ISREG( st.st_mode ) ) {
+            stream = true;
+            size = -1;
+            return;
+        }
+
+        size = st.st_size;
+
+        off_t offset = lseek( fd, 0, SEEK_CUR );
+        base = offset > 0 ? std::min<curl_off_t>( offset, size ) : 0;
+        position = base;
+        uploadStart = base;
+
+        posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+
+        if( ( flags & Mmap ) && size > 0 )
+        {
+            void *ptr = mmap( nullptr, size_t( size ), PROT_READ, MAP_SHARED, fd, 0 );
+            if( ptr != MAP_FAILED ) {
+                map = (char*) ptr;
+                madvise( map, size_t( size ), MADV_SEQUENTIAL );
+            }
+        }
+    }
+
+    size_t FileSource::Pimpl::readData( char *buffer, size_t length )
+    {
+        if( stream ) {
+            for(;;)
+            {
+                ssize_t count = ::read( fd, buffer, length );
+                if( count >= 0 ) {
+                    position += count;
+                    return size_t( count );
+                }
+
+                if( errno != EINTR ) {
+                    return size_t( -1 );
+                }
+            }
+        }
+
+        if( position >= size ) {
+            return 0;
+        }
+
+        length = size_t( std::min<curl_off_t>( length, size - position ) );
+
+        if( map ) {
+            std::memcpy( buffer, map + position, length );
+            position += length;
+            return length;
+        }
+
+        for(;;)
+        {
+            ssize_t count = pread( fd, buffer, length, position );
+            if( count >= 0 ) {
+                position += count;
+                return size_t( count );
+            }
+
+            if( errno != EINTR ) {
+                return size_t( -1 );
+            }
+        }
+    }
+
+    // SEEK_SET is relative to start, the position can't go before it
+    bool FileSource::Pimpl::seekTo( curl_off_t offset, int origin, curl_off_t start )
+    {
+        if( stream ) {
+            return false;
+        }
+
+        switch( origin )
+        {
+            case SEEK_SET: offset += start; break;
+            case SEEK_CUR: offset += position; break;
+            case SEEK_END: offset += size; break;
+            default: return false;
+        }
+
+        if( offset < start || offset > size ) {
+            return false;
+        }
+
+        position = offset;
+        return true;
+    }
+
+    size_t FileSource::Pimpl::read( char *data, size_t size, size_t n, void *userPtr )
+    {
+        size_t count = reinterpret_cast<FileSource::Pimpl*>( userPtr )->readData( data, size * n );
+        return count == size_t( -1 ) ? CURL_READFUNC_ABORT : count;
+    }
+
+    int FileSource::Pimpl::seek( void *userPtr, curl_off_t offset, int origin )
+    {
+        auto impl = reinterpret_cast<FileSource::Pimpl*>( userPtr );
+
+        // cURL may still get along without rewinding, e.g. by reading a stream up to the offset
+        if( impl->stream ) {
+            return CURL_SEEKFUNC_CANTSEEK;
+        }
+
+        // the declared size is what remained at the start of the upload, so the rewind goes back there
+        return impl->seekTo( offset, origin, impl->uploadStart ) ? CURL_SEEKFUNC_OK : CURL_SEEKFUNC_FAIL;
+    }
+
+    FileSource::FileSource( std::string const &path, int flags )
+        : _impl( new Pimpl() )
+    {
+        _impl->fd = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+        _impl->ownDescriptor = true;
+
+        if( _impl->fd < 0 ) {
+            throw Exception( "can't open file" );
+        }
+
+        _impl->open( flags );
+    }
+
+    FileSource::FileSource( int fd, bool ownDescriptor, int flags )
+        : _impl( new Pimpl() )
+    {
+        _impl->fd = fd;
+        _impl->ownDescriptor = ownDescriptor;
+        _impl->open( flags );
+    }
+
+    FileSource::FileSource( FileSource &&other )
+    {
+        *this = std::move( other );
+    }
+
+    FileSource::~FileSource()
+    {
+    }
+
+    FileSource &FileSource::operator = ( FileSource &&other )
+    {
+        if( this != &other ) {
+            _impl.reset();
+            _impl.swap( other._impl );
+        }
+
+        return *this;
+    }
+
+    curl_off_t FileSource::size() const
+    {
+        return _impl->stream ? -1 : _impl->size - _impl->base;
+    }
+
+    curl_off_t FileSource::remaining() const
+    {
+        return _impl->stream ? -1 : _impl->size - _impl->position;
+    }
+
+    curl_off_t FileSource::position() const
+    {
+        return _impl->position - _impl->base;
+    }
+
+    size_t FileSource::read( char *buffer, size_t size )
+    {
+        return _impl->readData( buffer, size );
+    }
+
+    bool FileSource::seek( curl_off_t offset, int origin )
+    {
+        return _impl->seekTo( offset, origin, _impl->base );
+    }
+
+    void Easy::readFrom( FileSource &file )
+    {
+        // cURL calls the file directly, so the handlers are not used anymore
+        resetCallback( CURLOPT_READFUNCTION );
+        _impl->onSeek = Event<SeekHandler>();
+
+        // the upload starts at the current position, which is also where cURL rewinds to
+        file._impl->uploadStart = file._impl->position;
+
+        setReadFunction( &FileSource::Pimpl::read, file._impl.get() );
+        set( CURLOPT_SEEKFUNCTION, &FileSource::Pimpl::seek );
+        set( CURLOPT_SEEKDATA, (void*) file._impl.get() );
+        set( CURLOPT_INFILESIZE_LARGE, file.remaining() );
+    }
+
+    bool Easy::operator << ( FileSource &file )
+    {
+        readFrom( file );
+        return perform();
+    }
+
+#endif
+
+    /* Definition of curlite::EasyPool
+     */
+
+    struct EasyPool::Pimpl
+    {
+        std::mutex          mutex;
+        std::vector<Easy>   idle;
+        size_t              capacity;
+        Share              *share;
+    };
+
+    EasyPool::EasyPool( size_t capacity, Share *share )
+        : _impl( new Pimpl() )
+    {
+        _impl->capacity = capacity;
+        _impl->share = share;
+    }
+
+    EasyPool::EasyPool( EasyPool &&other )
+    {
+        *this = std::move( other );
+    }
+
+    EasyPool::~EasyPool()
+    {
+    }
+
+    EasyPool &EasyPool::operator = ( EasyPool &&other )
+    {
+        if( this != &other ) {
+            _impl.reset();
+            _impl.swap( other._impl );
+        }
+
+        return *this;
+    }
+
+    Easy EasyPool::acquire()
+    {
+        {
+            std::lock_guard<std::mutex> lock( _impl->mutex );
+
+            if( !_impl->idle.empty() )
+            {
+                // the most recently used object has the best chance to have a live connection
+                Easy easy( std::move( _impl->idle.back() ) );
+                _impl->idle.pop_back();
+                return easy;
+            }
+        }
+
+        Easy easy;
+        if( _impl->share ) {
+            easy.set( CURLOPT_SHARE, *_impl->share );
+        }
+
+        return easy;
+    }
+
+    void EasyPool::release( Easy &&easy )
+    {
+        if( easy.get() == nullptr ) {
+            return;
+        }
+
+        easy.reset();
+        easy.setExceptionMode( true );
+        easy.setUserData( nullptr );
+
+        if( _impl->share ) {
+            easy.set( CURLOPT_SHARE, *_impl->share );
+        }
+
+        std::lock_guard<std::mutex> lock( _impl->mutex );
+
+        if( _impl->idle.size() < _impl->capacity ) {
+            _impl->idle.push_back( std::move( easy ) );
+        }
+    }
+
+    size_t EasyPool::size() const
+    {
+        std::lock_guard<std::mutex> lock( _impl->mutex );
+        return _impl->idle.size();
+    }
+
+    void EasyPool::clear()
+    {
+        std::vector<Easy> idle;
+
+        {
+            std::lock_guard<std::mutex> lock( _impl->mutex );
+            idle.swap( _impl->idle );
+        }
+    }
+
+    /* Definition of curlite::List
+     */
+
+    List::List( curl_slist *list )
+        : _list( list )
+    {
+    }
+
+    List::List( std::vector<std::string> const &values )
+        : _list( nullptr )
+    {
+        append( values );
+    }
+
+    List::~List()
+    {
+        if( auto ptr = release() ) {
+            curl_slist_free_all( ptr );
+        }
+    }
+
+    List::List( List &&other )
+        : _list( nullptr )
+    {
+        *this = std::move( other );
+    }
+
+    List &List::operator = ( List &&other )
+    {
+        if( this != &other )
+        {
+            if( auto ptr = release() ) {
+                curl_slist_free_all( ptr );
+            }
+            
+            std::swap( _list, other._list );
+        }
+
+        return *this;
+    }
+
+    curl_slist *List::get() const
+    {
+        return _list;
+    }
+
+    curl_slist *List::release()
+    {
+        curl_slist *list = nullptr;
+        std::swap( list, _list );
+        return list;
+    }
+
+    List &List::append( char const *s )
+    {
+        _list = curl_slist_append( _list, s );
+        return *this;
+    }
+
+    List &List::append( std::vector<std::string> const &values )
+    {
+        for( auto it = values.begin(); it != values.end(); ++it ) {
+            append( it->c_str() );
+        }
+
+        return *this;
+    }
+
+    List &List::operator << ( char const *s )
+    {
+        return append( s );
+    }
+
+    /* Definition of curlite::Form
+     */
+
+    Form::Form() : _first( nullptr ), _last( nullptr )
+    {
+    }
+
+    Form::Form( std::vector<curl_forms> const &forms )
+        : _first( nullptr ), _last( nullptr )
+    {
+        add( forms );
+    }
+
+    Form::Form( Form &&other )
+        : _first( nullptr ), _last( nullptr )
+    {
+        std::swap( _first, other._first );
+        std::swap( _last, other._last );
+    }
+
+    Form::~Form()
+    {
+        if( auto ptr = release().first ) {
+            curl_formfree( ptr );
+        }
+    }
+
+    Form &Form::operator = ( Form &&other )
+    {
+        if( this != &other )
+        {
+            if( auto ptr = release().first ) {
+                curl_formfree( ptr );
+            }
+            
+            std::swap( _first, other._first );
+            std::swap( _last, other._last );
+        }
+
+        return *this;
+    }
+
+    curl_httppost *Form::get() const
+    {
+        return _first;
+    }
+
+    std::pair<curl_httppost*, curl_httppost*> Form::release()
+    {
+        auto r = std::make_pair<curl_httppost*, curl_httppost*>( nullptr, nullptr );
+
+        std::swap( r.first, _first );
+        std::swap( r.second, _last );
+        
+        return r;
+    }
+
+    bool Form::add( std::vector<curl_forms> const &forms )
+    {
+        auto err = curl_formadd( &_first, &_last, CURLFORM_ARRAY, forms.data(), CURLFORM_END );
+        return err == CURL_FORMADD_OK;
+    }
+
+    /* Other functions
+     */
+
+    bool global_init( long flags )
+    {
+        return curl_global_init( flags ) == 0;
+    }
+
+    void global_cleanup()
+    {
+        curl_global_cleanup();
+    }
+
+    std::string version()
+    {
+        return std::string( curl_version() );
+    }
+
+    curl_version_info_data *versionInfo( CURLversion type )
+    {
+        return curl_version_info( type );
+    }
+
+    template <class Sink>
+    static void download( Easy &c, std::string const &url, Sink &sink, bool followRedirect, bool throwExceptions )
+    {
+        c.setExceptionMode( throwExceptions );
+        c.set( CURLOPT_URL, url );
+        c.set( CURLOPT_FOLLOWLOCATION, followRedirect );
+
+        c >> sink;
+    }
+
+    template <class Source>
+    static void upload( Easy &c,
+                        Source &source,
+                        std::string const &url,
+                        std::string const &username,
+                        std::string const &password,
+                        curl_off_t size,
+                        bool throwExceptions )
+    {
+        c.setExceptionMode( throwExceptions );
+        c.set( CURLOPT_URL, url );
+        c.set( CURLOPT_USERNAME, username );
+        c.set( CURLOPT_PASSWORD, password );
+        c.set( CURLOPT_INFILESIZE_LARGE, size );
+        c.set( CURLOPT_UPLOAD, true );
+
+        List headers;
+        if( size == -1 ) {
+            headers << "Transfer-Encoding: chunked";
+            headers << "Expect:";
+
+            // if it's not http(s) upload then the option will be ignored
+            c.set( CURLOPT_HTTPHEADER, headers.get() );
+        }
+
+        c << source;
+
+        // reset the option to avoid access violation (if a client reuses the Easy object)
+        c.set( CURLOPT_HTTPHEADER, nullptr );
+    }
+
+    Easy download( std::string const &url, std::ostream &ostr, bool followRedirect, bool throwExceptions )
+    {
+        Easy c;
+        download( c, url, ostr, followRedirect, throwExceptions );
+
+        return c;
+    }
+
+    Easy download( std::string const &url, std::string &body, bool followRedirect, bool throwExceptions )
+    {
+        Easy c;
+        download( c, url, body, followRedirect, throwExceptions );
+
+        return c;
+    }
+
+    Easy upload( std::istream &istr,
+                 std::string const &url,
+                 std::string const &username,
+                 std::string const &password,
+                 curl_off_t size,
+                 bool throwExceptions )
+    {
+        Easy c;
+        upload( c, istr, url, username, password, size, throwExceptions );
+
+        return c;
+    }
+
+#ifdef __linux__
+    Easy upload( FileSource &file,
+                 std::string const &url,
+                 std::string const &username,
+                 std::string const &password,
+                 bool throwExceptions )
+    {
+        Easy c;
+        upload( c, file, url, username, password, file.remaining(), throwExceptions );
+
+        return c;
+    }
+#endif
+
+    Easy download( EasyPool &pool, std::string const &url, std::ostream &ostr, bool followRedirect, bool throwExceptions )
+    {
+        Easy c = pool.acquire();
+        download( c, url, ostr, followRedirect, throwExceptions );
+
+        return c;
+    }
+
+    Easy download( EasyPool &pool, std::string const &url, std::string &body, bool followRedirect, bool throwExceptions )
+    {
+        Easy c = pool.acquire();
+        download( c, url, body, followRedirect, throwExceptions );
+
+        return c;
+    }
+
+    Easy upload( EasyPool &pool,
+                 std::istream &istr,
+                 std::string const &url,
+                 std::string const &username,
+                 std::string const &password,
+                 curl_off_t size,
+                 bool throwExceptions )
+    {
+        Easy c = pool.acquire();
+        upload( c, istr, url, username, password, size, throwExceptions );
+
+        return c;
+    }
+
+#ifdef __linux__
+    Easy upload( EasyPool &pool,
+                 FileSource &file,
+                 std::string const &url,
+                 std::string const &username,
+                 std::string const &password,
+                 bool throwExceptions )
+    {
+        Easy c = pool.acquire();
+        upload( c, file, url, username, password, file.remaining(), throwExceptions );
+
+        return c;
+    }
+#endif
+
+#ifdef __linux__
+
+    /* Segmented download
+     */
+
+    namespace
+    {
+        // segments are never split into parts smaller than this
+        const curl_off_t kMinSegmentSize = 256 * 1024;
+
+        struct Segment
+        {
+            curl_off_t  begin;
+            curl_off_t  end;
+            curl_off_t  position;
+            bool        rangeIgnored;
+            Easy       *easy;
+
+            Segment( curl_off_t begin, curl_off_t end )
+             : begin( begin ), end( end ), position( begin ), rangeIgnored( false ), easy( nullptr )
+            { }
+
+            curl_off_t remaining() const
+            {
+                return end > position ? end - position : 0;
+            }
+        };
+
+        bool fail( CURLcode code, bool throwExceptions )
+        {
+            if( throwExceptions ) {
+                throw Exception( curl_easy_strerror( code ) );
+            }
+
+            return false;
+        }
+
+        bool singleStreamDownload( std::string const &url, std::string const &path, bool throwExceptions )
+        {
+            FileSink file( path );
+
+            Easy c;
+            c.setExceptionMode( throwExceptions );
+            c.set( CURLOPT_URL, url );
+            c.set( CURLOPT_FOLLOWLOCATION, true );
+
+            return c >> file;
+        }
+
+        // returns false if the transfer of the segment can't be started
+        bool startSegment( Multi &multi, Segment &segment, Easy &&easy, std::string const &url, FileSink &file )
+        {
+            auto seg = &segment;
+
+            easy.setExceptionMode( false );
+            easy.setUserData( seg );
+            easy.set( CURLOPT_URL, url );
+            easy.set( CURLOPT_RANGE, std::to_string( seg->begin ) + "-" + std::to_string( seg->end - 1 ) );
+            easy.onWrite( [seg, &file] ( char *data, size_t size, size_t n, void * ) -> size_t
+            {
+                size_t length = size * n;
+
+                if( seg->position == seg->begin && seg->easy->getInfo<long>( CURLINFO_RESPONSE_CODE ) != 206 ) {
+                    seg->rangeIgnored = true;
+                    return 0;
+                }
+
+                // the tail of the segment could be taken over by another connection
+                size_t part = size_t( std::min<curl_off_t>( length, seg->remaining() ) );
+                if( part > 0 && !file.writeAt( seg->position, data, part ) ) {
+                    return 0;
+                }
+
+                seg->position += part;
+                return part == length ? length : 0;
+            } );
+
+            seg->easy = multi.add( std::move( easy ) );
+            return seg->easy != nullptr;
+        }
+    }
+
+    bool segmentedDownload( std::string const &url, std::string const &path, size_t segments, bool throwExceptions )
+    {
+        // probe the size and the support of byte ranges
+        Easy probe;
+        probe.setExceptionMode( false );
+        probe.set( CURLOPT_URL, url );
+        probe.set( CURLOPT_FOLLOWLOCATION, true );
+        probe.set( CURLOPT_NOBODY, true );
+
+        bool acceptRanges = false;
+        probe.onHeader_( [&acceptRanges] ( char *data, size_t size ) -> bool
+        {
+            std::string line( data, size );
+            std::transform( line.begin(), line.end(), line.begin(), ::tolower );
+
+            if( line.compare( 0, 14, "accept-ranges:" ) == 0 && line.find( "bytes" ) != std::string::npos ) {
+                acceptRanges = true;
+            }
+
+            return true;
+        } );
+
+        probe.perform();
+
+        curl_off_t length = contentLengthOf( probe.get() );
+
+        long responseCode = probe.getInfo<long>( CURLINFO_RESPONSE_CODE );
+        std::string effectiveUrl = probe.getInfo<std::string>( CURLINFO_EFFECTIVE_URL, url );
+
+        segments = size_t( std::min<curl_off_t>( segments, length / kMinSegmentSize ) );
+
+        if( !probe || responseCode != 200 || !acceptRanges || segments < 2 ) {
+            return singleStreamDownload( url, path, throwExceptions );
+        }
+
+        FileSink file( path );
+        file.reserve( length );
+
+        Multi multi;
+        multi.setExceptionMode( false );
+
+        // std::list keeps pointers valid, handlers refer to the segments
+        std::list<Segment> parts;
+        CURLcode result = CURLE_OK;
+        bool rangeIgnored = false;
+
+        for( size_t i = 0; i < segments && result == CURLE_OK; ++i )
+        {
+            parts.emplace_back( length * curl_off_t( i ) / curl_off_t( segments ),
+                                length * curl_off_t( i + 1 ) / curl_off_t( segments ) );
+
+            if( !startSegment( multi, parts.back(), Easy(), effectiveUrl, file ) ) {
+                result = CURLE_FAILED_INIT;
+            }
+        }
+
+        while( multi.running() > 0 && result == CURLE_OK && !rangeIgnored )
+        {
+            size_t stillRunning = multi.perform();
+            if( !multi ) {
+                result = CURLE_FAILED_INIT;
+                break;
+            }
+
+            while( Easy *easy = multi.next() )
+            {
+                auto seg = reinterpret_cast<Segment*>( easy->userData() );
+
+                // a segment, which was taken over by another connection, fails with CURLE_WRITE_ERROR
+                if( seg->rangeIgnored ) {
+                    rangeIgnored = true;
+                } else if( seg->remaining() > 0 ) {
+                    result = easy->error() != CURLE_OK ? easy->error() : CURLE_PARTIAL_FILE;
+                }
+
+                Easy done = multi.remove( easy );
+                seg->easy = nullptr;
+
+                if( result != CURLE_OK || rangeIgnored ) {
+                    break;
+                }
+
+                // take over the second half of the largest remaining segment
+                Segment *slowest = nullptr;
+                for( auto it = parts.begin(); it != parts.end(); ++it )
+                {
+                    if( it->easy && ( !slowest || it->remaining() > slowest->remaining() ) ) {
+                        slowest = &*it;
+                    }
+                }
+
+                if( slowest && slowest->remaining() >= 2 * kMinSegmentSize )
+                {
+                    curl_off_t middle = slowest->position + slowest->remaining() / 2;
+
+                    parts.emplace_back( middle, slowest->end );
+                    slowest->end = middle;
+
+                    done.reset();
+                    if( !startSegment( multi, parts.back(), std::move( done ), effectiveUrl, file ) ) {
+                        result = CURLE_FAILED_INIT;
+                        break;
+                    }
+                }
+            }
+
+            if( stillRunning > 0 && result == CURLE_OK && !rangeIgnored && !multi.poll() ) {
+                result = CURLE_FAILED_INIT;
+            }
+        }
+
+        if( rangeIgnored ) {
+            file.discard();
+            return singleStreamDownload( url, path, throwExceptions );
+        }
+
+        // the file has holes, unless every segment has been received completely
+        for( auto it = parts.begin(); it != parts.end() && result == CURLE_OK; ++it ) {
+            if( it->remaining() > 0 ) {
+                result = CURLE_PARTIAL_FILE;
+            }
+        }
+
+        // the destination file is left as it was
+        if( result != CURLE_OK ) {
+            file.discard();
+            return fail( result, throwExceptions );
+        }
+
+        if( !file.commit() ) {
+            return fail( CURLE_WRITE_ERROR, throwExceptions );
+        }
+
+        return true;
+    }
+
+#endif
+
+#ifdef __linux__
+
+    /* Resumable download
+     */
+
+    namespace
+    {
+        // received data is flushed to disk and the checkpoint is saved every time this amount of data is received
+        const curl_off_t kCheckpointInterval = 4 << 20;
+
+        struct Checkpoint
+        {
+            std::string                                         url;
+            std::string                                         validator;
+            curl_off_t                                          length;
+            std::vector<std::pair<curl_off_t, curl_off_t>>      ranges;
+
+            Checkpoint() : length( -1 ) { }
+
+            // size of the completed data from the beginning of the file
+            curl_off_t completed() const
+            {
+                curl_off_t end = 0;
+                for( auto it = ranges.begin(); it != ranges.end(); ++it )
+                {
+                    if( it->first <= end ) {
+                        end = std::max( end, it->second );
+                    }
+                }
+
+                return end;
+            }
+
+            bool load( std::string const &path )
+            {
+                std::ifstream ifs( path );
+                std::string key, line;
+
+                if( !std::getline( ifs, line ) || line != "curlite-checkpoint 1" ) {
+                    return false;
+                }
+
+                while( ifs >> key && std::getline( ifs >> std::ws, line ) )
+                {
+                    std::istringstream value( line );
+
+                    if( key == "url" ) {
+                        url = line;
+                    } else if( key == "validator" ) {
+                        validator = line;
+                    } else if( key == "length" ) {
+                        value >> length;
+                    } else if( key == "range" ) {
+                        curl_off_t begin = 0, end = 0;
+                        if( value >> begin >> end ) {
+                            ranges.push_back( std::make_pair( begin, end ) );
+                        }
+                    }
+                }
+
+                return !url.empty();
+            }
+
+            // the file is replaced atomically, so a crash leaves either old or new checkpoint
+            bool save( std::string const &path ) const
+            {
+                std::string temp = path + ".tmp";
+
+                {
+                    std::ofstream ofs( temp, std::ios::trunc );
+                    ofs << "curlite-checkpoint 1\n"
+                        << "url " << url << "\n"
+                        << "validator " << validator << "\n"
+                        << "length " << length << "\n";
+
+                    for( auto it = ranges.begin(); it != ranges.end(); ++it ) {
+                        ofs << "range " << it->first << " " << it->second << "\n";
+                    }
+
+                    if( !ofs.flush() ) {
+                        return false;
+                    }
+                }
+
+                return rename( temp.c_str(), path.c_str() ) == 0;
+            }
+        };
+
+        struct ResumeState
+        {
+            int             fd;
+            bool            http;
+            curl_off_t      resumeFrom;
+            curl_off_t      offset;
+            curl_off_t      checkpointed;
+            bool            started;
+            bool            changed;
+
+            Checkpoint      checkpoint;
+            std::string     checkpointPath;
+
+            // validators and the first byte (Content-Range) of the last received response
+            std::string     etag;
+            std::string     lastModified;
+            curl_off_t      rangeStart;
+
+            void save()
+            {
+                fdatasync( fd );
+
+                checkpoint.ranges.assign( 1, std::make_pair( curl_off_t( 0 ), offset ) );
+                checkpoint.save( checkpointPath );
+                checkpointed = offset;
+            }
+
+            // the saved checkpoint describes the old data, it's removed until the next save()
+            void restart()
+            {
+                if( ftruncate( fd, 0 ) == 0 ) {
+                    offset = 0;
+                }
+
+                checkpoint.ranges.clear();
+                unlink( checkpointPath.c_str() );
+            }
+        };
+
+        std::string trimHeaderValue( std::string const &line, size_t from )
+        {
+            size_t begin = line.find_first_not_of( " \t", from );
+            size_t end = line.find_last_not_of( " \t\r\n" );
+
+            return begin == std::string::npos || end < begin ? std::string() : line.substr( begin, end - begin + 1 );
+        }
+    }
+
+    Easy resumableDownload( std::string const &url, std::string const &path, bool followRedirect, bool throwExceptions )
+    {
+        ResumeState state;
+        state.http = url.compare( 0, 4, "http" ) == 0;
+        state.checkpointPath = path + ".checkpoint";
+        state.started = false;
+        state.changed = false;
+
+        state.rangeStart = -1;
+
+        std::string partPath = path + ".part";
+
+        Easy c;
+        c.setExceptionMode( false );
+
+        state.fd = open( partPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+        if( state.fd < 0 ) {
+            c.setExceptionMode( throwExceptions );
+            c.handleError( CURLE_WRITE_ERROR );
+            return c;
+        }
+
+        // data beyond the checkpoint may not have reached the disk, it's never trusted
+        Checkpoint saved;
+        if( saved.load( state.checkpointPath ) && saved.url == url && !saved.validator.empty() ) {
+            state.checkpoint = saved;
+        }
+
+        state.checkpoint.url = url;
+        state.resumeFrom = state.checkpoint.completed();
+
+        // the last byte is requested again if everything is received, a range past the end would fail with 416
+        if( state.checkpoint.length > 0 && state.resumeFrom >= state.checkpoint.length ) {
+            state.resumeFrom = state.checkpoint.length - 1;
+        }
+
+        struct stat st;
+        if( fstat( state.fd, &st ) != 0 || st.st_size < state.resumeFrom ) {
+            state.resumeFrom = 0;
+        }
+
+        if( ftruncate( state.fd, state.resumeFrom ) != 0 ) {
+            state.resumeFrom = 0;
+        }
+
+        state.offset = state.resumeFrom;
+        state.checkpointed = state.resumeFrom;
+
+        c.set( CURLOPT_URL, url );
+        c.set( CURLOPT_FOLLOWLOCATION, followRedirect );
+        c.set( CURLOPT_FAILONERROR, true );
+        c.set( CURLOPT_FILETIME, true );
+
+        List headers;
+        if( state.resumeFrom > 0 )
+        {
+            if( state.http ) {
+                // If-Range makes the server send the whole resource (200) if it has changed
+                headers << ( "If-Range: " + state.checkpoint.validator ).c_str();
+                c.set( CURLOPT_HTTPHEADER, headers.get() );
+                c.set( CURLOPT_RANGE, std::to_string( state.resumeFrom ) + "-" );
+            } else {
+                c.set( CURLOPT_RESUME_FROM_LARGE, state.resumeFrom );
+            }
+        }
+
+        auto pstate = &state;
+        auto easy = &c;
+
+        c.onHeader_( [pstate] ( char *data, size_t size ) -> bool
+        {
+            std::string line( data, size );
+            std::string lower( line );
+            std::transform( lower.begin(), lower.end(), lower.begin(), ::tolower );
+
+            // every response (e.g. after a redirect) has its own validators
+            if( lower.compare( 0, 5, "http/" ) == 0 ) {
+                pstate->etag.clear();
+                pstate->lastModified.clear();
+                pstate->rangeStart = -1;
+            } else if( lower.compare( 0, 5, "etag:" ) == 0 ) {
+                pstate->etag = trimHeaderValue( line, 5 );
+            } else if( lower.compare( 0, 14, "last-modified:" ) == 0 ) {
+                pstate->lastModified = trimHeaderValue( line, 14 );
+            } else if( lower.compare( 0, 14, "content-range:" ) == 0 ) {
+                std::string value = trimHeaderValue( lower, 14 );
+                char *end = nullptr;
+
+                if( value.compare( 0, 6, "bytes " ) == 0 ) {
+                    curl_off_t start = std::strtoll( value.c_str() + 6, &end, 10 );
+                    pstate->rangeStart = end != value.c_str() + 6 && *end == '-' ? start : -1;
+                }
+            }
+
+            return true;
+        } );
+
+        c.onWrite( [pstate, easy] ( char *data, size_t size, size_t n, void * ) -> size_t
+        {
+            auto &state = *pstate;
+
+            if( !state.started )
+            {
+                state.started = true;
+
+                std::string validator;
+                if( state.http ) {
+                    // weak ETags can't be used in If-Range
+                    bool strongEtag = !state.etag.empty() && state.etag.compare( 0, 2, "W/" ) != 0;
+                    validator = strongEtag ? state.etag : state.lastModified;
+                } else {
+                    long filetime = easy->getInfo<long>( CURLINFO_FILETIME, -1 );
+                    validator = filetime >= 0 ? "filetime " + std::to_string( filetime ) : "";
+                }
+
+                if( state.resumeFrom > 0 )
+                {
+                    bool partial = state.http ? easy->getInfo<long>( CURLINFO_RESPONSE_CODE ) == 206
+                                              : validator == state.checkpoint.validator;
+
+                    // a server may ignore If-Range or send another range, its data doesn't belong at the offset
+                    bool mismatch = state.http && partial &&
+                                    ( validator != state.checkpoint.validator || state.rangeStart != state.resumeFrom );
+
+                    if( ( !partial && !state.http ) || mismatch ) {
+                        // the resource has changed and it's too late to ask for the whole one
+                        state.changed = true;
+                        return 0;
+                    }
+
+                    if( !partial ) {
+                        state.restart();
+                    }
+                }
+
+                curl_off_t length = contentLengthOf( easy->get() );
+
+                state.checkpoint.validator = validator;
+                state.checkpoint.length = length >= 0 ? state.offset + length : -1;
+                state.save();
+            }
+
+            size_t length = size * n;
+            for( size_t written = 0; written < length; )
+            {
+                ssize_t count = pwrite( state.fd, data + written, length - written, state.offset );
+                if( count < 0 ) {
+                    if( errno == EINTR ) {
+                        continue;
+                    }
+
+                    return 0;
+                }
+
+                written += size_t( count );
+                state.offset += count;
+            }
+
+            if( state.offset - state.checkpointed >= kCheckpointInterval && !state.checkpoint.validator.empty() ) {
+                state.save();
+            }
+
+            return length;
+        } );
+
+        c.perform();
+
+        // the range isn't satisfiable if the resource has shrunk since the checkpoint
+        if( state.http && state.resumeFrom > 0 && !state.started &&
+            c.getInfo<long>( CURLINFO_RESPONSE_CODE ) == 416 )
+        {
+            state.changed = true;
+        }
+
+        if( state.changed )
+        {
+            // the resource has changed, download it again from the beginning
+            state.restart();
+            state.resumeFrom = 0;
+            state.started = false;
+            state.changed = false;
+            state.checkpoint.validator.clear();
+            state.checkpoint.length = -1;
+
+            if( state.http ) {
+                c.set( CURLOPT_RANGE, nullptr );
+                c.set( CURLOPT_HTTPHEADER, nullptr );
+            } else {
+                c.set( CURLOPT_RESUME_FROM_LARGE, curl_off_t( 0 ) );
+            }
+
+            c.perform();
+        }
+
+        bool completed = c && ( state.checkpoint.length < 0 || state.offset == state.checkpoint.length );
+        CURLcode err = c.error();
+
+        // the header list and the state (captured by the handlers) die with this scope,
+        // the transfer error is saved above and restored below
+        c.set( CURLOPT_HTTPHEADER, nullptr );
+        c.onHeader_( nullptr );
+        c.onWrite( nullptr );
+
+        if( completed && fsync( state.fd ) == 0 && rename( partPath.c_str(), path.c_str() ) == 0 ) {
+            close( state.fd );
+            unlink( state.checkpointPath.c_str() );
+        } else {
+            if( !state.checkpoint.validator.empty() ) {
+                state.save();
+            }
+
+            close( state.fd );
+
+            // the data is received, but it can't be moved into place
+            if( completed ) {
+                err = CURLE_WRITE_ERROR;
+            } else if( err == CURLE_OK ) {
+                err = CURLE_PARTIAL_FILE;
+            }
+        }
+
+        c.setExceptionMode( throwExceptions );
+        c.handleError( err );
+
+        return c;
+    }
+
+#endif
+
+    /* Batch download
+     */
+
+    namespace
+    {
+        struct WorkQueue
+        {
+            std::mutex          mutex;
+            std::deque<size_t>  items;
+
+            // the owner takes items from the front, thieves from the back
+            bool pop( size_t &index, bool steal )
+            {
+                std::lock_guard<std::mutex> lock( mutex );
+
+                if( items.empty() ) {
+                    return false;
+                }
+
+                if( steal ) {
+                    index = items.back();
+                    items.pop_back();
+                } else {
+                    index = items.front();
+                    items.pop_front();
+                }
+
+                return true;
+            }
+        };
+
+        struct BatchDownload
+        {
+            std::vector<DownloadItem> const            &items;
+            DownloadOptions const                      &options;
+            std::vector<DownloadResult>                 results;
+            std::vector<std::unique_ptr<WorkQueue>>     queues;
+
+            std::mutex                                  errorMutex;
+            std::exception_ptr                          error;
+
+            BatchDownload( std::vector<DownloadItem> const &items, DownloadOptions const &options )
+             : items( items ), options( options )
+            { }
+
+            bool cancelled() const
+            {
+                return options.cancel && options.cancel->load();
+            }
+
+            bool take( size_t self, size_t &index )
+            {
+                if( queues[self]->pop( index, false ) ) {
+                    return true;
+                }
+
+                for( size_t i = 1; i < queues.size(); ++i )
+                {
+                    if( queues[(self + i) % queues.size()]->pop( index, true ) ) {
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            void work( size_t self );
+            void finish( Easy &easy, CURLcode error );
+        };
+
+        void BatchDownload::finish( Easy &easy, CURLcode error )
+        {
+            auto result = reinterpret_cast<DownloadResult*>( easy.userData() );
+            result->error = error;
+            result->responseCode = easy.getInfo<long>( CURLINFO_RESPONSE_CODE );
+
+            if( options.onDone ) {
+                options.onDone( size_t( result - results.data() ), *result );
+            }
+        }
+
+        void BatchDownload::work( size_t self )
+        {
+            Multi multi;
+            multi.setExceptionMode( false );
+
+            std::vector<Easy> idle;
+            std::vector<Easy*> active;
+            bool exhausted = false;
+
+            // with no slots at all the items would be left untouched
+            const size_t concurrency = std::max<size_t>( options.concurrency, 1 );
+
+            for(;;)
+            {
+                bool stop = cancelled();
+
+                // fill free slots, there is no need to ask for more work once all the queues are empty
+                while( !stop && !exhausted && active.size() < concurrency )
+                {
+                    size_t index = 0;
+                    if( !take( self, index ) ) {
+                        exhausted = true;
+                        break;
+                    }
+
+                    Easy easy( idle.empty() ? Easy() : std::move( idle.back() ) );
+                    if( !idle.empty() ) {
+                        idle.pop_back();
+                    }
+
+                    auto sink = items[index].sink;
+                    auto result = &results[index];
+
+                    easy.setExceptionMode( false );
+                    easy.setUserData( result );
+                    easy.set( CURLOPT_URL, items[index].url );
+                    easy.set( CURLOPT_FOLLOWLOCATION, options.followRedirect );
+                    easy.onWrite( [sink, result] ( char *data, size_t size, size_t n, void * ) -> size_t
+                    {
+                        if( sink && !sink->write( data, size * n ) ) {
+                            return 0;
+                        }
+
+                        result->size += size * n;
+                        return size * n;
+                    } );
+
+                    if( options.configure ) {
+                        options.configure( easy );
+                    }
+
+                    if( auto added = multi.add( std::move( easy ) ) ) {
+                        active.push_back( added );
+                        continue;
+                    }
+
+                    // the transfer can't start, it is reported as done rather than left for a cancelled one
+                    finish( easy, easy.error() != CURLE_OK ? easy.error() : CURLE_FAILED_INIT );
+
+                    easy.reset();
+                    idle.push_back( std::move( easy ) );
+                }
+
+                if( active.empty() ) {
+                    break;
+                }
+
+                if( stop )
+                {
+                    for( auto it = active.begin(); it != active.end(); ++it ) {
+                        multi.remove( *it );
+                    }
+
+                    break;
+                }
+
+                size_t stillRunning = multi.perform();
+
+                while( Easy *easy = multi.next() )
+                {
+                    finish( *easy, easy->error() );
+
+                    active.erase( std::find( active.begin(), active.end(), easy ) );
+
+                    Easy done = multi.remove( easy );
+                    done.reset();
+                    idle.push_back( std::move( done ) );
+                }
+
+                if( stillRunning > 0 ) {
+                    multi.poll( 100 );
+                }
+            }
+        }
+    }
+
+    std::vector<DownloadResult> downloadAll( std::vector<DownloadItem> const &items, DownloadOptions const &options )
+    {
+        BatchDownload batch( items, options );
+
+        DownloadResult initial = { CURLE_ABORTED_BY_CALLBACK, 0, 0 };
+        batch.results.assign( items.size(), initial );
+
+        size_t threads = options.threads ? options.threads : std::thread::hardware_concurrency();
+        threads = std::max<size_t>( 1, std::min( threads, items.size() ) );
+
+        for( size_t i = 0; i < threads; ++i ) {
+            batch.queues.emplace_back( new WorkQueue() );
+        }
+
+        for( size_t i = 0; i < items.size(); ++i ) {
+            batch.queues[i % threads]->items.push_back( i );
+        }
+
+        auto worker = [&batch] ( size_t self )
+        {
+            try {
+                batch.work( self );
+            } catch( ... ) {
+                std::lock_guard<std::mutex> lock( batch.errorMutex );
+                batch.error = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for( size_t i = 1; i < threads; ++i ) {
+            pool.emplace_back( worker, i );
+        }
+
+        // the calling thread is a worker too
+        worker( 0 );
+
+        for( auto it = pool.begin(); it != pool.end(); ++it ) {
+            it->join();
+        }
+
+        if( batch.error ) {
+            std::rethrow_exception( batch.error );
+        }
 
-        return std::move( c );
+        return batch.results;
     }
 
 } // end of namespace <curlite>
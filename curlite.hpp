@@ -31,10 +31,28 @@
 #include <curl/curl.h>
 #include <stdexcept>
 #include <functional>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <new>
+#include <atomic>
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <chrono>
+#include <future>
+
+// C++20 coroutines (see curlite::Task and curlite::Client)
+#if defined( __cpp_impl_coroutine ) && __has_include( <coroutine> )
+    #include <coroutine>
+    #include <exception>
+    #include <optional>
+    #include <tuple>
+    #include <utility>
+    #define CURLITE_COROUTINES
+#endif
 
 // cURL version check
 #if LIBCURL_VERSION_MAJOR < 7 || LIBCURL_VERSION_MINOR < 32
@@ -63,6 +81,88 @@ namespace curlite
     typedef Handler<curl_ssl_ctx_callback>::type     SslContextHandler;
     typedef Handler<curl_formget_callback>::type     FormGetHandler;
 
+    class Share;
+    class Headers;
+    class Framer;
+    class Digest;
+    class RateLimiter;
+    class Metrics;
+    class WireCapture;
+    class DnsCache;
+    class FileSink;
+    class FileSource;
+
+    /* Storage for a callable of arbitrary type, used by the templated handlers of Easy
+     *
+     * Small callables (e.g. lambdas with a few captures) are constructed in the internal buffer,
+     * larger ones are allocated on the heap.
+     */
+
+    class CallbackSlot
+    {
+        static const size_t kBufferSize = 64;
+
+        alignas( std::max_align_t ) unsigned char _buffer[kBufferSize];
+        void *_callable;
+        void (*_destroy)( void * );
+
+        CallbackSlot( CallbackSlot const &other );
+        void operator = ( CallbackSlot const &other );
+
+    public:
+        CallbackSlot();
+        ~CallbackSlot();
+
+        /* Destroy the stored callable (if any) and store a new one.
+         * Returns pointer to the stored callable.
+         */
+
+        template <class Callable>
+        typename std::decay<Callable>::type *emplace( Callable &&f );
+
+        /* Destroy the stored callable
+         */
+
+        void reset();
+    };
+
+    /* Static cURL callbacks specialized for the type of callable
+     * The callable is passed as the user pointer and its call can be inlined.
+     */
+
+    template <class Callable>
+    struct InlineCallback
+    {
+        static size_t data( char *data, size_t size, size_t n, void *userPtr )
+        {
+            return ( *static_cast<Callable*>( userPtr ) )( data, size, n, nullptr );
+        }
+
+        static size_t simplifiedWrite( char *data, size_t size, size_t n, void *userPtr )
+        {
+            return ( *static_cast<Callable*>( userPtr ) )( data, size * n ) ? size * n : 0;
+        }
+
+        static size_t simplifiedRead( char *data, size_t size, size_t n, void *userPtr )
+        {
+            return ( *static_cast<Callable*>( userPtr ) )( data, size * n ) ? size * n : CURL_READFUNC_ABORT;
+        }
+    };
+
+    // true if the callable can be invoked as Result (Args...) and it's not HandlerType itself
+    template <class Callable, class HandlerType, class Result, class... Args>
+    struct IsInlineCallback : std::integral_constant<bool,
+        !std::is_same<typename std::decay<Callable>::type, HandlerType>::value &&
+        std::is_invocable_r<Result, typename std::decay<Callable>::type &, Args...>::value> { };
+
+    template <class Callable, class HandlerType>
+    using EnableIfDataCallback = typename std::enable_if<
+        IsInlineCallback<Callable, HandlerType, size_t, char *, size_t, size_t, void *>::value>::type;
+
+    template <class Callable, class HandlerType>
+    using EnableIfSimplifiedCallback = typename std::enable_if<
+        IsInlineCallback<Callable, HandlerType, bool, char *, size_t>::value>::type;
+
     /* Base class of all curlite exceptions
      */
 
@@ -73,6 +173,62 @@ namespace curlite
         { }
     };
 
+    /* Outcome of an operation of the non-throwing API (see Easy::trySet(), Easy::tryPerform(), ...)
+     *
+     * Holds the error code and the value, which is default-constructed if there is an error.
+     * Nothing is allocated and nothing is thrown on the error path.
+     */
+
+    template <class ValueType>
+    class Result
+    {
+        CURLcode    _error;
+        ValueType   _value;
+
+    public:
+        Result( CURLcode error, ValueType const &value = ValueType() )
+            : _error( error ), _value( error == CURLE_OK ? value : ValueType() )
+        { }
+
+        /* Returns true if there was no error
+         */
+
+        explicit operator bool() const { return _error == CURLE_OK; }
+
+        CURLcode error() const { return _error; }
+
+        /* Returns static string describing the error
+         */
+
+        const char *message() const { return curl_easy_strerror( _error ); }
+
+        ValueType const &value() const { return _value; }
+        ValueType const &operator * () const { return _value; }
+        ValueType const *operator -> () const { return &_value; }
+
+        ValueType valueOr( ValueType const &defaultValue ) const { return _error == CURLE_OK ? _value : defaultValue; }
+    };
+
+    template <>
+    class Result<void>
+    {
+        CURLcode    _error;
+
+    public:
+        Result( CURLcode error ) : _error( error ) { }
+
+        explicit operator bool() const { return _error == CURLE_OK; }
+
+        CURLcode error() const { return _error; }
+        const char *message() const { return curl_easy_strerror( _error ); }
+    };
+
+    /* Typed keys of options and information, see the namespaces below
+     */
+
+    namespace opt  { template <CURLoption Key, class ValueType> struct Option; }
+    namespace info { template <CURLINFO Key, class ValueType> struct Info; }
+
     /* The class implements easy interface of cURL
      * 
      * Example:
@@ -97,6 +253,32 @@ namespace curlite
 
         bool handleError( CURLcode code );
 
+        // saves the error of the last operation, never throws
+        CURLcode storeError( CURLcode code );
+
+        // removes the handler of the callback option, returns the slot for the templated handler
+        CallbackSlot &resetCallback( CURLoption function );
+
+        // install data callbacks, the data is routed through the digests if there are any
+        void setWriteFunction( curl_write_callback function, void *data );
+        void setReadFunction( curl_read_callback function, void *data );
+
+        // CURLOPT_WRITEFUNCTION, CURLOPT_WRITEDATA, ... set directly by the user
+        CURLcode setDataOption( CURLoption key, void *data, curl_write_callback function );
+        CURLcode applyDataFunctions();
+
+        // CURLOPT_DEBUGFUNCTION serves both onDebug() and the wire capture
+        CURLcode applyDebugFunction();
+
+        friend class Multi;
+        friend class AsyncClient;
+        friend class Client;
+        friend class RateLimiter;
+        friend class Scheduler;
+
+        // reports errors of the file operations through the returned object
+        friend Easy resumableDownload( std::string const &url, std::string const &path, bool followRedirect, bool throwExceptions );
+
     public:
         // Simplified handlers for most frequent cases
         typedef std::function<bool (char *, size_t)> SimplifiedDataHandler;
@@ -167,6 +349,7 @@ namespace curlite
         bool set( CURLoption key, int value );
         bool set( CURLoption key, bool value );
         bool set( CURLoption key, std::string const &value );
+        bool set( CURLoption key, Share const &value );
 
         /* Request internal information from cURL session
          * See curl_easy_getinfo() for details.
@@ -175,7 +358,59 @@ namespace curlite
         template <class ValueType>
         ValueType getInfo( CURLINFO key, ValueType const &defaultValue = ValueType() );
 
-        /* Reset all options of cURL session to their defaults.
+        /* Set option and request information by typed keys
+         *
+         * Example:
+         *     easy.set( curlite::opt::url, "http://example.com" );
+         *     easy.set( curlite::opt::timeout_ms, 5000 );
+         *     long code = easy.getInfo( curlite::info::response_code );
+         *
+         * The type of the value is checked by the compiler, so there are no checks at runtime
+         * and cURL is called directly.
+         */
+
+        template <CURLoption Key, class ValueType>
+        bool set( opt::Option<Key, ValueType> key, typename opt::Option<Key, ValueType>::type value );
+
+        template <CURLoption Key>
+        bool set( opt::Option<Key, const char *> key, std::string const &value );
+
+        template <CURLINFO Key, class ValueType>
+        ValueType getInfo( info::Info<Key, ValueType> key,
+                           typename info::Info<Key, ValueType>::type const &defaultValue = ValueType() );
+
+        /* Non-throwing versions of set(), getInfo(), perform(), send() and recv()
+         *
+         * They never throw, whatever the exception mode is, and return the error code along with
+         * the value. Nothing is allocated on the error path, so they suit the workloads where
+         * failures are frequent (e.g. crawling). The error is also available through Easy::error().
+         */
+
+        template <class ValueType>
+        Result<void> trySet( CURLoption key, ValueType value );
+
+        Result<void> trySet( CURLoption key, int value );
+        Result<void> trySet( CURLoption key, bool value );
+        Result<void> trySet( CURLoption key, std::string const &value );
+
+        template <class ValueType>
+        Result<ValueType> tryGetInfo( CURLINFO key );
+
+        template <CURLoption Key, class ValueType>
+        Result<void> trySet( opt::Option<Key, ValueType> key, typename opt::Option<Key, ValueType>::type value );
+
+        template <CURLoption Key>
+        Result<void> trySet( opt::Option<Key, const char *> key, std::string const &value );
+
+        template <CURLINFO Key, class ValueType>
+        Result<ValueType> tryGetInfo( info::Info<Key, ValueType> key );
+
+        Result<void> tryPerform();
+        Result<size_t> trySend( const char *buffer, size_t bufferSize );
+        Result<size_t> tryRecv( char *buffer, size_t bufferSize );
+
+        /* Reset all options of cURL session to their defaults and remove all the handlers.
+         * Live connections, DNS cache and TLS sessions are kept.
          */
 
         void reset();
@@ -201,6 +436,129 @@ namespace curlite
 
         bool operator >> ( std::ostream &stream );
 
+        /* Perform a blocking file download to a string or a vector.
+         * Capacity is reserved once from Content-Length (if known), so the body isn't copied on growth.
+         */
+
+        bool operator >> ( std::string &body );
+        bool operator >> ( std::vector<char> &body );
+
+        /* Set write handler which stores the body to a string, vector or caller-supplied buffer.
+         * The destination is cleared immediately, Content-Length is used to reserve its capacity.
+         *
+         * If the body doesn't fit into the buffer, the transfer fails with CURLE_WRITE_ERROR.
+         * The number of bytes stored in the buffer is written to bytesWritten.
+         */
+
+        void writeTo( std::string &body );
+        void writeTo( std::vector<char> &body );
+        void writeTo( char *buffer, size_t bufferSize, size_t &bytesWritten );
+
+        /* Set header handler which collects the response headers (see Headers for details).
+         * The headers are cleared immediately.
+         */
+
+        void collectHeaders( Headers &headers );
+
+        /* Set write handler which splits the body into records (see Framer for details).
+         */
+
+        void writeTo( Framer &framer );
+
+        /* Perform a blocking download of a stream of records.
+         * Fails if the stream ends in the middle of a record.
+         */
+
+        bool operator >> ( Framer &framer );
+
+        /* Compute a digest of the downloaded (or uploaded) data during the transfer
+         *
+         * Every chunk is hashed right after the handler has accepted it, while it's still in cache,
+         * so there is no need to read the data again. The digest works with any curlite handler
+         * or CURLOPT_WRITEFUNCTION/CURLOPT_WRITEDATA pair (set before or after this call) and must
+         * outlive the transfer.
+         * The upload digest isn't rewound, if cURL rewinds the upload (e.g. after a redirect).
+         */
+
+        void digestDownload( Digest &digest );
+        void digestUpload( Digest &digest );
+
+        /* Stop computing the digests
+         */
+
+        void clearDigests();
+
+        /* Limit the bandwidth of the transfer by the shared budget (see RateLimiter for details)
+         */
+
+        void throttle( RateLimiter &limiter, size_t transferClass = 0 );
+
+        /* Stop limiting the bandwidth
+         */
+
+        void unthrottle();
+
+        /* Record the timings, sizes and connection reuse of every completed transfer (by perform()
+         * or by a multi session) into the metrics (see Metrics for details). The metrics must outlive
+         * the transfer.
+         */
+
+        void collectMetrics( Metrics &metrics );
+
+        /* Stop recording the metrics
+         */
+
+        void clearMetrics();
+
+        /* Record the debug events of the transfer (type, time and the truncated data) into the flight
+         * recorder (see WireCapture for details). Works together with onDebug(). The recorder must
+         * outlive the transfer.
+         */
+
+        void captureWire( WireCapture &capture );
+
+        /* Stop recording the debug events
+         */
+
+        void clearWireCapture();
+
+        /* Take the addresses of the host from the cache (through CURLOPT_RESOLVE) when the transfer
+         * starts, instead of resolving them (see DnsCache for details). Replaces CURLOPT_RESOLVE
+         * set by the user. The cache must outlive the Easy object.
+         */
+
+        void useDnsCache( DnsCache &cache );
+
+        /* Stop using the cache
+         */
+
+        void clearDnsCache();
+
+#ifdef __linux__
+        /* Set write handler which stores the body to a file (see FileSink for details).
+         */
+
+        void writeTo( FileSink &file );
+
+        /* Perform a blocking file download to a file and commit it on success.
+         */
+
+        bool operator >> ( FileSink &file );
+
+        /* Set read and seek handlers which take the upload data from a file (see FileSource for details).
+         * The upload starts at the current position of the file, and a rewind by cURL (e.g. after
+         * a redirect) goes back to it. CURLOPT_INFILESIZE_LARGE is set to the remaining size of
+         * the file (-1 if it's unknown).
+         */
+
+        void readFrom( FileSource &file );
+
+        /* Perform a blocking file upload from a file
+         */
+
+        bool operator << ( FileSource &file );
+#endif
+
         /* Returns url-encoded version of input string
          */
 
@@ -251,6 +609,32 @@ namespace curlite
 
         void onSslContext( SslContextHandler f = SslContextHandler(), void *data = nullptr );
         void onDebug( DebugHandler f = DebugHandler(), void *data = nullptr );
+
+        /* Set handlers specialized for the type of callable (e.g. a lambda)
+         *
+         * cURL calls the callable through a static function generated for its type, instead of
+         * going through one or two std::function objects, so the call can be inlined. It makes
+         * a difference for the data handlers, which are called for every chunk of a transfer.
+         * The last argument of the usual "curl" handlers is always nullptr.
+         */
+
+        template <class Callable, class = EnableIfSimplifiedCallback<Callable, SimplifiedDataHandler>>
+        void onRead_( Callable &&f );
+
+        template <class Callable, class = EnableIfSimplifiedCallback<Callable, SimplifiedDataHandler>>
+        void onWrite_( Callable &&f );
+
+        template <class Callable, class = EnableIfSimplifiedCallback<Callable, SimplifiedDataHandler>>
+        void onHeader_( Callable &&f );
+
+        template <class Callable, class = EnableIfDataCallback<Callable, ReadHandler>>
+        void onRead( Callable &&f );
+
+        template <class Callable, class = EnableIfDataCallback<Callable, WriteHandler>>
+        void onWrite( Callable &&f );
+
+        template <class Callable, class = EnableIfDataCallback<Callable, WriteHandler>>
+        void onHeader( Callable &&f );
     };
 
 
@@ -287,13 +671,27 @@ namespace curlite
     template <> struct OptionTypeCode<curl_conv_callback>        : OptionFunctionPtrCode { };
     template <> struct OptionTypeCode<curl_ssl_ctx_callback>     : OptionFunctionPtrCode { };
     template <> struct OptionTypeCode<curl_formget_callback>     : OptionFunctionPtrCode { };
+    template <> struct OptionTypeCode<curl_socket_callback>      : OptionFunctionPtrCode { };
+    template <> struct OptionTypeCode<curl_multi_timer_callback> : OptionFunctionPtrCode { };
     template <> struct OptionTypeCode<std::nullptr_t>            : OptionNullPtrCode { };
+
+    // any other function pointer passes the compile time check, cURL calls it with the signature
+    // documented for the option (trySet() checks the signature of the data callbacks)
+    template <class Return, class... Args> struct OptionTypeCode<Return(*)(Args...)>          : OptionFunctionPtrCode { };
+    template <class Return, class... Args> struct OptionTypeCode<Return(*)(Args...) noexcept> : OptionFunctionPtrCode { };
+
     // disable specialization if curl_off_t and long is the same
     template <> struct OptionTypeCode<std::conditional<std::is_same<long, curl_off_t>::value, void, curl_off_t>::type> : OptionOffsetCode { };
 
 
     template <class ValueType>
     bool Easy::set( CURLoption key, ValueType value )
+    {
+        return handleError( trySet( key, value ).error() );
+    }
+
+    template <class ValueType>
+    Result<void> Easy::trySet( CURLoption key, ValueType value )
     {
         static_assert( int(OptionTypeCode<ValueType>::value) != int(OptionInvalidCode::value), "the type is not supported by curl_easy_setopt" );
 
@@ -303,14 +701,33 @@ namespace curlite
         auto keyTypeCode = key / kCurlOptTypeInterval * kCurlOptTypeInterval;
         bool isValueAllowedNullPtr = std::is_same<ValueType, std::nullptr_t>::value &&
                                      keyTypeCode != CURLOPTTYPE_LONG;
+        // curl_off_t may be the same type as long (e.g. on LP64 platforms)
+        bool isValueAllowedOffset = std::is_same<ValueType, curl_off_t>::value &&
+                                    keyTypeCode == CURLOPTTYPE_OFF_T;
 
-        if( OptionTypeCode<ValueType>::value != keyTypeCode && !isValueAllowedNullPtr ) {
+        if( OptionTypeCode<ValueType>::value != keyTypeCode && !isValueAllowedNullPtr && !isValueAllowedOffset ) {
             err = CURLE_BAD_FUNCTION_ARGUMENT;
+        } else if( key == CURLOPT_WRITEFUNCTION || key == CURLOPT_READFUNCTION ) {
+            // the data callbacks are tracked by their option, digests are tapped in front of them
+            if constexpr( std::is_convertible<ValueType, curl_write_callback>::value ||
+                          std::is_convertible<ValueType, curl_read_callback>::value ) {
+                err = setDataOption( key, nullptr, (curl_write_callback) value );
+            } else {
+                err = CURLE_BAD_FUNCTION_ARGUMENT;
+            }
+        } else if( key == CURLOPT_WRITEDATA || key == CURLOPT_READDATA ) {
+            void *data = nullptr;
+
+            if constexpr( std::is_pointer<ValueType>::value && !std::is_function<typename std::remove_pointer<ValueType>::type>::value ) {
+                data = const_cast<void *>( static_cast<const void *>( value ) );
+            }
+
+            err = setDataOption( key, data, nullptr );
         } else {
             err = curl_easy_setopt( get(), key, value );
         }
 
-        return handleError( err );
+        return storeError( err );
     }
 
     inline bool Easy::set( CURLoption key, int value )
@@ -328,77 +745,2318 @@ namespace curlite
         return set( key, value.c_str() );
     }
 
+    inline Result<void> Easy::trySet( CURLoption key, int value )
+    {
+        return trySet( key, static_cast<long>( value ) );
+    }
+
+    inline Result<void> Easy::trySet( CURLoption key, bool value )
+    {
+        return trySet( key, static_cast<long>( value ) );
+    }
+
+    inline Result<void> Easy::trySet( CURLoption key, std::string const &value )
+    {
+        return trySet( key, value.c_str() );
+    }
+
     // -- getInfo() stuff
     template <class Type> struct InfoTypeCode             { enum { value = -1              }; };
     template <> struct InfoTypeCode<char*>                { enum { value = CURLINFO_STRING }; };
     template <> struct InfoTypeCode<long>                 { enum { value = CURLINFO_LONG   }; };
     template <> struct InfoTypeCode<double>               { enum { value = CURLINFO_DOUBLE }; };
     template <> struct InfoTypeCode<curl_slist*>          { enum { value = CURLINFO_SLIST  }; };
-    template <> struct InfoTypeCode<curl_certinfo*>       { enum { value = CURLINFO_SLIST  }; };
-    template <> struct InfoTypeCode<curl_tlssessioninfo*> { enum { value = CURLINFO_SLIST  }; };
+#ifdef CURLINFO_OFF_T
+    template <> struct InfoTypeCode<long long>            { enum { value = CURLINFO_OFF_T  }; };
+#endif
+    // CURLINFO_PTR is the same as CURLINFO_SLIST, the structures have codes of their own
+    template <> struct InfoTypeCode<curl_certinfo*>       { enum { value = -2              }; };
+    template <> struct InfoTypeCode<curl_tlssessioninfo*> { enum { value = -3              }; };
+
+    // returns the type code of the information, the keys of the structures are told from the lists
+#if defined( __GNUC__ )
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#endif
+    constexpr int infoTypeCode( CURLINFO key )
+    {
+        if( key == CURLINFO_CERTINFO ) {
+            return InfoTypeCode<curl_certinfo*>::value;
+        }
+#if LIBCURL_VERSION_NUM >= 0x072200
+        if( key == CURLINFO_TLS_SESSION ) {
+            return InfoTypeCode<curl_tlssessioninfo*>::value;
+        }
+#endif
+#if LIBCURL_VERSION_NUM >= 0x073000
+        if( key == CURLINFO_TLS_SSL_PTR ) {
+            return InfoTypeCode<curl_tlssessioninfo*>::value;
+        }
+#endif
+        return key & CURLINFO_TYPEMASK;
+    }
+#if defined( __GNUC__ )
+#pragma GCC diagnostic pop
+#endif
 
     template <class ValueType>
     ValueType Easy::getInfo( CURLINFO key, ValueType const &defaultValue )
     {
-        ValueType value;
+        auto result = tryGetInfo<ValueType>( key );
+        return handleError( result.error() ) ? result.value() : defaultValue;
+    }
+
+    template <>
+    inline std::string Easy::getInfo( CURLINFO key, std::string const &defaultValue )
+    {
+        const char* value = getInfo<char*>( key, nullptr );
+        return value ? value : defaultValue;
+    }
+
+    template <class ValueType>
+    Result<ValueType> Easy::tryGetInfo( CURLINFO key )
+    {
+        ValueType value = ValueType();
         auto err = CURLE_OK;
 
         static_assert( InfoTypeCode<ValueType>::value != -1, "the type is not supported by curl_easy_getinfo" );
 
-        if( InfoTypeCode<ValueType>::value != (key & CURLINFO_TYPEMASK) ) {
+        int typeCode = infoTypeCode( key );
+
+#ifdef CURLINFO_OFF_T
+        // curl_off_t is the same type as long on LP64 platforms, so it can't have its own code
+        if( std::is_same<ValueType, curl_off_t>::value && typeCode == CURLINFO_OFF_T ) {
+            typeCode = InfoTypeCode<ValueType>::value;
+        }
+#endif
+
+        if( InfoTypeCode<ValueType>::value != typeCode ) {
             err = CURLE_BAD_FUNCTION_ARGUMENT;
         } else {
             err = curl_easy_getinfo( get(), key, &value );
         }
 
-        return handleError( err ) ? value : defaultValue;
+        return Result<ValueType>( storeError( err ), value );
     }
 
     template <>
-    inline std::string Easy::getInfo( CURLINFO key, std::string const &defaultValue )
+    inline Result<std::string> Easy::tryGetInfo( CURLINFO key )
     {
-        const char* value = getInfo<char*>( key, nullptr );
-        return value ? value : defaultValue;
+        auto result = tryGetInfo<char*>( key );
+        return Result<std::string>( result.error(), result.value() ? result.value() : "" );
     }
 
-    std::ostream &operator << ( std::ostream &stream, Easy &curlite );
-    std::istream &operator >> ( std::istream &stream, Easy &curlite );
+    // -- typed keys stuff
 
-    /* Wrapper arround curl list (curl_slist)
-     * 
-     * Example:
-     *     List list ({{
-     *         "pragma:"
-     *     }});
-     */
+    // returns true if the value type fits the type code of an option (e.g. CURLOPTTYPE_LONG)
+    template <class ValueType>
+    constexpr bool isOptionType( int typeCode )
+    {
+        if( typeCode == CURLOPTTYPE_OFF_T ) {
+            return std::is_same<ValueType, curl_off_t>::value;
+        }
+#ifdef CURLOPTTYPE_BLOB
+        if( typeCode == CURLOPTTYPE_BLOB ) {
+            return std::is_same<ValueType, curl_blob*>::value;
+        }
+#endif
+        return int( OptionTypeCode<ValueType>::value ) == typeCode;
+    }
 
-    class List
+    // returns true if the value type fits the type code of information (e.g. CURLINFO_LONG)
+    template <class ValueType>
+    constexpr bool isInfoType( int typeCode )
     {
-        curl_slist *_list;
+#ifdef CURLINFO_OFF_T
+        if( typeCode == CURLINFO_OFF_T ) {
+            return std::is_same<ValueType, curl_off_t>::value;
+        }
+#endif
+#ifdef CURLINFO_SOCKET
+        if( typeCode == CURLINFO_SOCKET ) {
+            return std::is_same<ValueType, curl_socket_t>::value;
+        }
+#endif
+        return int( InfoTypeCode<ValueType>::value ) == typeCode;
+    }
 
-        List( List const &other );
-        void operator = ( List const &other );
-    public:
-        List( curl_slist *list = nullptr );
-        List( std::vector<std::string> const &values );
-        List( List &&other );
+    /* Typed keys of the options
+     * The names are the names of CURLOPT_* constants in lower case.
+     */
 
-        ~List();
+    namespace opt
+    {
+        template <CURLoption Key, class ValueType>
+        struct Option
+        {
+            static_assert( isOptionType<ValueType>( Key / kCurlOptTypeInterval * kCurlOptTypeInterval ),
+                           "the type doesn't match the option" );
+
+            typedef ValueType type;
+        };
+
+        // behavior
+        constexpr Option<CURLOPT_VERBOSE, long>                    verbose {};
+        constexpr Option<CURLOPT_NOSIGNAL, long>                   nosignal {};
+        constexpr Option<CURLOPT_NOPROGRESS, long>                 noprogress {};
+
+        // network
+        constexpr Option<CURLOPT_URL, const char *>                url {};
+        constexpr Option<CURLOPT_PROXY, const char *>              proxy {};
+        constexpr Option<CURLOPT_NOPROXY, const char *>            noproxy {};
+        constexpr Option<CURLOPT_PORT, long>                       port {};
+        constexpr Option<CURLOPT_TCP_NODELAY, long>                tcp_nodelay {};
+        constexpr Option<CURLOPT_TCP_KEEPALIVE, long>              tcp_keepalive {};
+        constexpr Option<CURLOPT_BUFFERSIZE, long>                 buffersize {};
+
+        // authentication
+        constexpr Option<CURLOPT_USERPWD, const char *>            userpwd {};
+        constexpr Option<CURLOPT_USERNAME, const char *>           username {};
+        constexpr Option<CURLOPT_PASSWORD, const char *>           password {};
+
+        // HTTP
+        constexpr Option<CURLOPT_FOLLOWLOCATION, long>             followlocation {};
+        constexpr Option<CURLOPT_MAXREDIRS, long>                  maxredirs {};
+        constexpr Option<CURLOPT_USERAGENT, const char *>          useragent {};
+        constexpr Option<CURLOPT_REFERER, const char *>            referer {};
+        constexpr Option<CURLOPT_ACCEPT_ENCODING, const char *>    accept_encoding {};
+        constexpr Option<CURLOPT_HTTPHEADER, curl_slist *>         httpheader {};
+        constexpr Option<CURLOPT_HTTPGET, long>                    httpget {};
+        constexpr Option<CURLOPT_POST, long>                       post {};
+        constexpr Option<CURLOPT_POSTFIELDS, const char *>         postfields {};
+        constexpr Option<CURLOPT_POSTFIELDSIZE_LARGE, curl_off_t>  postfieldsize_large {};
+        constexpr Option<CURLOPT_COPYPOSTFIELDS, const char *>     copypostfields {};
+        constexpr Option<CURLOPT_CUSTOMREQUEST, const char *>      customrequest {};
+        constexpr Option<CURLOPT_HTTP_VERSION, long>               http_version {};
+        constexpr Option<CURLOPT_COOKIE, const char *>             cookie {};
+        constexpr Option<CURLOPT_COOKIEFILE, const char *>         cookiefile {};
+        constexpr Option<CURLOPT_COOKIEJAR, const char *>          cookiejar {};
+        constexpr Option<CURLOPT_FAILONERROR, long>                failonerror {};
+#if LIBCURL_VERSION_NUM >= 0x072b00
+        constexpr Option<CURLOPT_PIPEWAIT, long>                   pipewait {};
+#endif
 
-        List &operator = ( List &&other );
+        // transfer
+        constexpr Option<CURLOPT_NOBODY, long>                     nobody {};
+        constexpr Option<CURLOPT_UPLOAD, long>                     upload {};
+        constexpr Option<CURLOPT_INFILESIZE_LARGE, curl_off_t>     infilesize_large {};
+        constexpr Option<CURLOPT_RANGE, const char *>              range {};
+        constexpr Option<CURLOPT_RESUME_FROM_LARGE, curl_off_t>    resume_from_large {};
+        constexpr Option<CURLOPT_MAXFILESIZE_LARGE, curl_off_t>    maxfilesize_large {};
+        constexpr Option<CURLOPT_MAX_SEND_SPEED_LARGE, curl_off_t> max_send_speed_large {};
+        constexpr Option<CURLOPT_MAX_RECV_SPEED_LARGE, curl_off_t> max_recv_speed_large {};
+        constexpr Option<CURLOPT_FILETIME, long>                   filetime {};
+
+        // timeouts
+        constexpr Option<CURLOPT_TIMEOUT, long>                    timeout {};
+        constexpr Option<CURLOPT_TIMEOUT_MS, long>                 timeout_ms {};
+        constexpr Option<CURLOPT_CONNECTTIMEOUT, long>             connecttimeout {};
+        constexpr Option<CURLOPT_CONNECTTIMEOUT_MS, long>          connecttimeout_ms {};
+        constexpr Option<CURLOPT_LOW_SPEED_LIMIT, long>            low_speed_limit {};
+        constexpr Option<CURLOPT_LOW_SPEED_TIME, long>             low_speed_time {};
+
+        // connections
+        constexpr Option<CURLOPT_MAXCONNECTS, long>                maxconnects {};
+        constexpr Option<CURLOPT_FRESH_CONNECT, long>              fresh_connect {};
+        constexpr Option<CURLOPT_FORBID_REUSE, long>               forbid_reuse {};
+        constexpr Option<CURLOPT_RESOLVE, curl_slist *>            resolve {};
+        constexpr Option<CURLOPT_DNS_CACHE_TIMEOUT, long>          dns_cache_timeout {};
+        constexpr Option<CURLOPT_IPRESOLVE, long>                  ipresolve {};
+
+        // TLS
+        constexpr Option<CURLOPT_SSL_VERIFYPEER, long>             ssl_verifypeer {};
+        constexpr Option<CURLOPT_SSL_VERIFYHOST, long>             ssl_verifyhost {};
+        constexpr Option<CURLOPT_CAINFO, const char *>             cainfo {};
+        constexpr Option<CURLOPT_CAPATH, const char *>             capath {};
+        constexpr Option<CURLOPT_SSLCERT, const char *>            sslcert {};
+        constexpr Option<CURLOPT_SSLKEY, const char *>             sslkey {};
+        constexpr Option<CURLOPT_CERTINFO, long>                   certinfo {};
+    }
 
-        /* Returns pointer to the managed curl_slist object or nullptr.
-         */
+    /* Typed keys of the information
+     * The names are the names of CURLINFO_* constants in lower case.
+     */
 
-        curl_slist *get() const;
+    namespace info
+    {
+        template <CURLINFO Key, class ValueType>
+        struct Info
+        {
+            static_assert( isInfoType<ValueType>( infoTypeCode( Key ) ), "the type doesn't match the information" );
+
+            typedef ValueType type;
+        };
+
+        constexpr Info<CURLINFO_EFFECTIVE_URL, char *>               effective_url {};
+        constexpr Info<CURLINFO_RESPONSE_CODE, long>                 response_code {};
+        constexpr Info<CURLINFO_HTTP_CONNECTCODE, long>              http_connectcode {};
+        constexpr Info<CURLINFO_CONTENT_TYPE, char *>                content_type {};
+        constexpr Info<CURLINFO_FILETIME, long>                      filetime {};
+        constexpr Info<CURLINFO_REDIRECT_COUNT, long>                redirect_count {};
+        constexpr Info<CURLINFO_REDIRECT_URL, char *>                redirect_url {};
+        constexpr Info<CURLINFO_PRIMARY_IP, char *>                  primary_ip {};
+        constexpr Info<CURLINFO_PRIMARY_PORT, long>                  primary_port {};
+        constexpr Info<CURLINFO_LOCAL_IP, char *>                    local_ip {};
+        constexpr Info<CURLINFO_LOCAL_PORT, long>                    local_port {};
+        constexpr Info<CURLINFO_NUM_CONNECTS, long>                  num_connects {};
+        constexpr Info<CURLINFO_OS_ERRNO, long>                      os_errno {};
+        constexpr Info<CURLINFO_SSL_VERIFYRESULT, long>              ssl_verifyresult {};
+        constexpr Info<CURLINFO_HEADER_SIZE, long>                   header_size {};
+        constexpr Info<CURLINFO_REQUEST_SIZE, long>                  request_size {};
+        constexpr Info<CURLINFO_COOKIELIST, curl_slist *>            cookielist {};
+        constexpr Info<CURLINFO_SSL_ENGINES, curl_slist *>           ssl_engines {};
+        constexpr Info<CURLINFO_CERTINFO, curl_certinfo *>           certinfo {};
+
+        constexpr Info<CURLINFO_TOTAL_TIME, double>                  total_time {};
+        constexpr Info<CURLINFO_NAMELOOKUP_TIME, double>             namelookup_time {};
+        constexpr Info<CURLINFO_CONNECT_TIME, double>                connect_time {};
+        constexpr Info<CURLINFO_APPCONNECT_TIME, double>             appconnect_time {};
+        constexpr Info<CURLINFO_PRETRANSFER_TIME, double>            pretransfer_time {};
+        constexpr Info<CURLINFO_STARTTRANSFER_TIME, double>          starttransfer_time {};
+        constexpr Info<CURLINFO_REDIRECT_TIME, double>               redirect_time {};
+
+        // deprecated in favour of the *_t versions below
+#if defined( __GNUC__ )
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#endif
+        constexpr Info<CURLINFO_SIZE_DOWNLOAD, double>               size_download {};
+        constexpr Info<CURLINFO_SIZE_UPLOAD, double>                 size_upload {};
+        constexpr Info<CURLINFO_SPEED_DOWNLOAD, double>              speed_download {};
+        constexpr Info<CURLINFO_SPEED_UPLOAD, double>                speed_upload {};
+        constexpr Info<CURLINFO_CONTENT_LENGTH_DOWNLOAD, double>     content_length_download {};
+        constexpr Info<CURLINFO_CONTENT_LENGTH_UPLOAD, double>       content_length_upload {};
+#if defined( __GNUC__ )
+#pragma GCC diagnostic pop
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072d00
+        constexpr Info<CURLINFO_ACTIVESOCKET, curl_socket_t>         activesocket {};
+#endif
+#if LIBCURL_VERSION_NUM >= 0x073000
+        constexpr Info<CURLINFO_TLS_SSL_PTR, curl_tlssessioninfo *>  tls_ssl_ptr {};
+#endif
+#if LIBCURL_VERSION_NUM >= 0x073200
+        constexpr Info<CURLINFO_HTTP_VERSION, long>                  http_version {};
+#endif
+#if LIBCURL_VERSION_NUM >= 0x073700
+        constexpr Info<CURLINFO_SIZE_DOWNLOAD_T, curl_off_t>         size_download_t {};
+        constexpr Info<CURLINFO_SIZE_UPLOAD_T, curl_off_t>           size_upload_t {};
+        constexpr Info<CURLINFO_SPEED_DOWNLOAD_T, curl_off_t>        speed_download_t {};
+        constexpr Info<CURLINFO_SPEED_UPLOAD_T, curl_off_t>          speed_upload_t {};
+        constexpr Info<CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, curl_off_t> content_length_download_t {};
+        constexpr Info<CURLINFO_CONTENT_LENGTH_UPLOAD_T, curl_off_t> content_length_upload_t {};
+#endif
+#if LIBCURL_VERSION_NUM >= 0x073d00
+        constexpr Info<CURLINFO_TOTAL_TIME_T, curl_off_t>            total_time_t {};
+        constexpr Info<CURLINFO_NAMELOOKUP_TIME_T, curl_off_t>       namelookup_time_t {};
+        constexpr Info<CURLINFO_CONNECT_TIME_T, curl_off_t>          connect_time_t {};
+        constexpr Info<CURLINFO_APPCONNECT_TIME_T, curl_off_t>       appconnect_time_t {};
+        constexpr Info<CURLINFO_PRETRANSFER_TIME_T, curl_off_t>      pretransfer_time_t {};
+        constexpr Info<CURLINFO_STARTTRANSFER_TIME_T, curl_off_t>    starttransfer_time_t {};
+        constexpr Info<CURLINFO_REDIRECT_TIME_T, curl_off_t>         redirect_time_t {};
+#endif
+    }
 
-        /* Release the ownership of the managed curl_httppost object if any.
-         *
-         * Returns pointer to the managed curl_slist object or nullptr.
-         */
-        curl_slist *release();
+    template <CURLoption Key, class ValueType>
+    bool Easy::set( opt::Option<Key, ValueType>, typename opt::Option<Key, ValueType>::type value )
+    {
+        return handleError( curl_easy_setopt( get(), Key, value ) );
+    }
 
-        /* Add new item to the list. 
+    template <CURLoption Key>
+    bool Easy::set( opt::Option<Key, const char *>, std::string const &value )
+    {
+        return handleError( curl_easy_setopt( get(), Key, value.c_str() ) );
+    }
+
+    template <CURLoption Key, class ValueType>
+    Result<void> Easy::trySet( opt::Option<Key, ValueType>, typename opt::Option<Key, ValueType>::type value )
+    {
+        return storeError( curl_easy_setopt( get(), Key, value ) );
+    }
+
+    template <CURLoption Key>
+    Result<void> Easy::trySet( opt::Option<Key, const char *>, std::string const &value )
+    {
+        return storeError( curl_easy_setopt( get(), Key, value.c_str() ) );
+    }
+
+    template <CURLINFO Key, class ValueType>
+    ValueType Easy::getInfo( info::Info<Key, ValueType>, typename info::Info<Key, ValueType>::type const &defaultValue )
+    {
+        ValueType value = ValueType();
+        return handleError( curl_easy_getinfo( get(), Key, &value ) ) ? value : defaultValue;
+    }
+
+    template <CURLINFO Key, class ValueType>
+    Result<ValueType> Easy::tryGetInfo( info::Info<Key, ValueType> )
+    {
+        ValueType value = ValueType();
+        auto err = curl_easy_getinfo( get(), Key, &value );
+        return Result<ValueType>( storeError( err ), value );
+    }
+
+    // -- templated handlers stuff
+    template <class Callable>
+    typename std::decay<Callable>::type *CallbackSlot::emplace( Callable &&f )
+    {
+        typedef typename std::decay<Callable>::type Type;
+
+        reset();
+
+        if constexpr( sizeof( Type ) <= kBufferSize && alignof( Type ) <= alignof( std::max_align_t ) ) {
+            _callable = new ( _buffer ) Type( std::forward<Callable>( f ) );
+            _destroy = [] ( void *callable ) { static_cast<Type*>( callable )->~Type(); };
+        } else {
+            _callable = new Type( std::forward<Callable>( f ) );
+            _destroy = [] ( void *callable ) { delete static_cast<Type*>( callable ); };
+        }
+
+        return static_cast<Type*>( _callable );
+    }
+
+    template <class Callable, class>
+    void Easy::onRead_( Callable &&f )
+    {
+        auto callable = resetCallback( CURLOPT_READFUNCTION ).emplace( std::forward<Callable>( f ) );
+
+        setReadFunction( &InlineCallback<typename std::decay<Callable>::type>::simplifiedRead, callable );
+    }
+
+    template <class Callable, class>
+    void Easy::onWrite_( Callable &&f )
+    {
+        auto callable = resetCallback( CURLOPT_WRITEFUNCTION ).emplace( std::forward<Callable>( f ) );
+
+        setWriteFunction( &InlineCallback<typename std::decay<Callable>::type>::simplifiedWrite, callable );
+    }
+
+    template <class Callable, class>
+    void Easy::onHeader_( Callable &&f )
+    {
+        auto callable = resetCallback( CURLOPT_HEADERFUNCTION ).emplace( std::forward<Callable>( f ) );
+
+        set( CURLOPT_HEADERFUNCTION, &InlineCallback<typename std::decay<Callable>::type>::simplifiedWrite );
+        set( CURLOPT_HEADERDATA, (void*) callable );
+    }
+
+    template <class Callable, class>
+    void Easy::onRead( Callable &&f )
+    {
+        auto callable = resetCallback( CURLOPT_READFUNCTION ).emplace( std::forward<Callable>( f ) );
+
+        setReadFunction( &InlineCallback<typename std::decay<Callable>::type>::data, callable );
+    }
+
+    template <class Callable, class>
+    void Easy::onWrite( Callable &&f )
+    {
+        auto callable = resetCallback( CURLOPT_WRITEFUNCTION ).emplace( std::forward<Callable>( f ) );
+
+        setWriteFunction( &InlineCallback<typename std::decay<Callable>::type>::data, callable );
+    }
+
+    template <class Callable, class>
+    void Easy::onHeader( Callable &&f )
+    {
+        auto callable = resetCallback( CURLOPT_HEADERFUNCTION ).emplace( std::forward<Callable>( f ) );
+
+        set( CURLOPT_HEADERFUNCTION, &InlineCallback<typename std::decay<Callable>::type>::data );
+        set( CURLOPT_HEADERDATA, (void*) callable );
+    }
+
+    std::ostream &operator << ( std::ostream &stream, Easy &curlite );
+    std::istream &operator >> ( std::istream &stream, Easy &curlite );
+
+    /* The class implements multi interface of cURL
+     *
+     * Multi takes ownership of the added Easy objects and runs all of them
+     * concurrently on the calling thread. Connections are reused across transfers.
+     *
+     * Example:
+     *     curlite::Multi multi;
+     *
+     *     for( auto &url : urls ) {
+     *         curlite::Easy easy;
+     *         easy.set( CURLOPT_URL, url );
+     *         multi.add( std::move( easy ) );
+     *     }
+     *
+     *     multi.run( [&multi] ( curlite::Easy &easy ) {
+     *         std::cout << easy.getInfo<std::string>( CURLINFO_EFFECTIVE_URL ) << ": "
+     *                   << ( easy ? "ok" : easy.errorString() ) << std::endl;
+     *         multi.remove( &easy );
+     *     } );
+     */
+
+    class Multi
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        Multi( Multi const &other );
+        void operator = ( Multi const &other );
+
+        bool handleError( CURLMcode code );
+
+    public:
+        typedef std::function<void (Easy &)> CompletionHandler;
+
+        Multi();
+        Multi( Multi &&other );
+        virtual ~Multi();
+
+        Multi &operator = ( Multi &&other );
+
+        /* Returns true if there was no error during last operation
+         * Equivalent of (error() == CURLM_OK)
+         */
+
+        operator bool() const;
+
+        /* Release the ownership of the managed CURLM object if any.
+         * All the owned Easy objects are detached from it and destroyed.
+         *
+         * Returns pointer to the managed CURLM object or nullptr.
+         */
+
+        CURLM *release();
+
+        /* Returns pointer to the managed CURLM object
+         */
+
+        CURLM *get() const;
+
+        /* Set current exception mode.
+         * Pass true to throw exceptions on error, false otherwise.
+         */
+
+        void setExceptionMode( bool throwExceptions );
+
+        /* Returns true if exceptions are "on"
+         */
+
+        bool exceptionMode() const;
+
+        /* Returns last cURL multi error code
+         */
+
+        CURLMcode error() const;
+
+        /* Returns a string describing last cURL multi error
+         */
+
+        std::string errorString() const;
+
+        /* Set options for the cURL multi session
+         * See curl_multi_setopt() for details.
+         */
+
+        template <class ValueType>
+        bool set( CURLMoption opt, ValueType value );
+
+        bool set( CURLMoption key, int value );
+        bool set( CURLMoption key, bool value );
+
+        /* Take ownership of the Easy object and start its transfer.
+         *
+         * Returns pointer to the owned Easy object or nullptr on error.
+         * The pointer stays valid until the object is removed or Multi is destroyed.
+         */
+
+        Easy *add( Easy &&easy );
+
+        /* Stop the transfer (if it's still running) and give the ownership
+         * of the Easy object back to the caller.
+         */
+
+        Easy remove( Easy *easy );
+
+        /* Returns the number of owned Easy objects
+         */
+
+        size_t size() const;
+
+        /* Returns the number of transfers which are still running
+         */
+
+        size_t running() const;
+
+        /* Read/write available data on all the transfers without blocking.
+         * See curl_multi_perform() for details.
+         *
+         * Returns the number of transfers which are still running.
+         */
+
+        size_t perform();
+
+        /* Inform cURL about activity on the socket (or about timeout if socket is CURL_SOCKET_TIMEOUT).
+         * See curl_multi_socket_action() for details.
+         *
+         * Returns the number of transfers which are still running.
+         */
+
+        size_t socketAction( curl_socket_t socket, int events );
+
+        /* Wait for activity on any of the transfers or for the timeout expiration.
+         * See curl_multi_poll() for details.
+         */
+
+        bool poll( int timeoutMs = 1000 );
+
+        /* Wake up a thread which is blocked inside of poll().
+         * See curl_multi_wakeup() for details.
+         */
+
+        bool wakeup();
+
+        /* Resume the transfers paused by their rate limiters, which have the tokens again.
+         * It's done by perform() and poll(), custom loops built on socketAction() call it themselves.
+         *
+         * Returns the number of milliseconds until the next paused transfer may be resumed,
+         * 0 if some transfers have just been resumed (and must be performed right away) or -1.
+         */
+
+        int resumeThrottled();
+
+        /* Returns next completed transfer or nullptr if there is none.
+         *
+         * The completed Easy object is detached from the multi session, but is still owned by Multi.
+         * Result of the transfer is available through Easy::error() and Easy::operator bool().
+         * Failed transfer never throws an exception, so one failure doesn't break others.
+         */
+
+        Easy *next();
+
+        /* Perform all the transfers until they are completed.
+         * The handler is invoked for each completed transfer, it's safe to call remove() inside of it.
+         */
+
+        bool run( CompletionHandler onDone = CompletionHandler() );
+    };
+
+#ifdef __linux__
+
+    /* Event-driven transfer engine built on curl_multi_socket_action() and epoll
+     *
+     * Unlike Multi::perform(), each wakeup handles only the sockets which are actually
+     * ready, so the cost doesn't grow with the number of idle connections.
+     * All the transfers run on the thread which calls run()/runOnce().
+     *
+     * Example:
+     *     curlite::EventLoop loop;
+     *
+     *     for( auto &url : urls ) {
+     *         curlite::Easy easy;
+     *         easy.set( CURLOPT_URL, url );
+     *         loop.add( std::move( easy ) );
+     *     }
+     *
+     *     loop.run( [&loop] ( curlite::Easy &easy ) {
+     *         loop.remove( &easy );
+     *     } );
+     */
+
+    class EventLoop
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        EventLoop( EventLoop const &other );
+        void operator = ( EventLoop const &other );
+
+    public:
+        EventLoop();
+        EventLoop( EventLoop &&other );
+        virtual ~EventLoop();
+
+        EventLoop &operator = ( EventLoop &&other );
+
+        /* Returns the underlying Multi object (to set options, check errors, etc.)
+         */
+
+        Multi &multi();
+
+        /* Take ownership of the Easy object and start its transfer.
+         * See Multi::add() for details.
+         */
+
+        Easy *add( Easy &&easy );
+
+        /* Stop the transfer and give the ownership of the Easy object back to the caller.
+         * See Multi::remove() for details.
+         */
+
+        Easy remove( Easy *easy );
+
+        /* Returns the number of transfers which are still running
+         */
+
+        size_t running() const;
+
+        /* Wait up to timeoutMs milliseconds (-1 means "until something happens") for
+         * socket activity or cURL timeout, and process it.
+         * The handler is invoked for each completed transfer.
+         */
+
+        bool runOnce( int timeoutMs = -1, Multi::CompletionHandler const &onDone = Multi::CompletionHandler() );
+
+        /* Process events until all the transfers are completed.
+         */
+
+        bool run( Multi::CompletionHandler onDone = Multi::CompletionHandler() );
+
+        /* Interrupt waiting inside of runOnce(). The only method which is safe to call from other threads.
+         */
+
+        bool wakeup();
+    };
+
+#endif
+
+    /* Runs transfers on a background thread
+     *
+     * submit() may be called from any number of threads: the Easy object is passed to the
+     * transfer thread through a lock-free queue, which is woken up only when it's idle.
+     * All the transfers share a single multi session (EventLoop on Linux), so a blocked request
+     * thread is no longer needed for every transfer in flight.
+     *
+     * Failed transfers don't throw, their result is available through Easy::error().
+     * Transfers which are still pending when AsyncClient is destroyed are completed with
+     * CURLE_ABORTED_BY_CALLBACK.
+     *
+     * Example:
+     *     curlite::AsyncClient client;
+     *
+     *     curlite::Easy easy;
+     *     easy.set( CURLOPT_URL, "http://example.com" );
+     *
+     *     auto result = client.submit( std::move( easy ) );
+     *     ...
+     *     curlite::Easy done = result.get();
+     */
+
+    class AsyncClient
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        AsyncClient( AsyncClient const &other );
+        void operator = ( AsyncClient const &other );
+
+    public:
+        AsyncClient();
+        AsyncClient( AsyncClient &&other );
+        virtual ~AsyncClient();
+
+        AsyncClient &operator = ( AsyncClient &&other );
+
+        /* Start the transfer on the background thread.
+         * The future gives the Easy object back once the transfer is completed.
+         */
+
+        std::future<Easy> submit( Easy &&easy );
+
+        /* Start the transfer on the background thread and call the handler once it's completed.
+         * The handler is invoked on the transfer thread, so it must be short and must not block.
+         */
+
+        void submit( Easy &&easy, Multi::CompletionHandler onDone );
+
+        /* Returns the number of submitted transfers which aren't completed yet
+         */
+
+        size_t pending() const;
+    };
+
+    /* Queue of transfers in front of the multi session, which limits the number of transfers
+     * in flight per host and in total
+     *
+     * Queued transfers are started in the order of their priority: a bulk transfer is started
+     * only if there is no interactive or normal one, which may start. Hosts with transfers of
+     * the same priority take turns, so one host doesn't hold back the others.
+     * A freed slot is given to the next transfer in constant time.
+     *
+     * The host is taken from CURLOPT_URL of the submitted Easy object. All the transfers run
+     * on the thread which calls run()/runOnce().
+     *
+     * Example:
+     *     curlite::Scheduler scheduler( 64, 4 );
+     *
+     *     for( auto &url : urls ) {
+     *         curlite::Easy easy;
+     *         easy.set( CURLOPT_URL, url );
+     *         scheduler.submit( std::move( easy ), curlite::Scheduler::Bulk );
+     *     }
+     *
+     *     scheduler.run( [&scheduler] ( curlite::Easy &easy ) {
+     *         scheduler.remove( &easy );
+     *     } );
+     */
+
+    class Scheduler
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        Scheduler( Scheduler const &other );
+        void operator = ( Scheduler const &other );
+
+    public:
+        enum Priority
+        {
+            Interactive,
+            Normal,
+            Bulk
+        };
+
+        Scheduler( size_t maxTotal = 64, size_t maxPerHost = 6 );
+        Scheduler( Scheduler &&other );
+        virtual ~Scheduler();
+
+        Scheduler &operator = ( Scheduler &&other );
+
+        /* Returns the underlying Multi object (to set options, check errors, etc.)
+         */
+
+        Multi &multi();
+
+        /* Change the limit of transfers in flight for the host (e.g. "example.com" or "example.com:8080")
+         */
+
+        void setHostLimit( std::string const &host, size_t limit );
+
+        /* Take ownership of the Easy object and queue its transfer.
+         * The transfer is started right away if the limits allow.
+         */
+
+        void submit( Easy &&easy, Priority priority = Normal );
+
+        /* Give the ownership of the completed (or running) Easy object back to the caller.
+         * See Multi::remove() for details.
+         */
+
+        Easy remove( Easy *easy );
+
+        /* Returns the number of transfers which wait for a slot
+         */
+
+        size_t queued() const;
+
+        /* Returns the number of transfers in flight
+         */
+
+        size_t running() const;
+
+        /* Wait up to timeoutMs milliseconds (-1 means "until something happens") for transfer
+         * activity and start the queued transfers in place of the completed ones.
+         * The handler is invoked for each completed transfer. A transfer which the multi session
+         * has refused to start is completed with CURLE_FAILED_INIT.
+         */
+
+        bool runOnce( int timeoutMs = -1, Multi::CompletionHandler const &onDone = Multi::CompletionHandler() );
+
+        /* Process events until all the queued and running transfers are completed
+         */
+
+        bool run( Multi::CompletionHandler onDone = Multi::CompletionHandler() );
+    };
+
+#ifdef CURLITE_COROUTINES
+
+    template <class T>
+    class Task;
+
+    /* Parts of the Task promise, which don't depend on the result type
+     */
+
+    struct TaskPromiseBase
+    {
+        // resumes the coroutine which awaits the task (if any) by symmetric transfer
+        struct FinalAwaiter
+        {
+            bool await_ready() const noexcept { return false; }
+            void await_resume() const noexcept { }
+
+            template <class Promise>
+            std::coroutine_handle<> await_suspend( std::coroutine_handle<Promise> handle ) noexcept
+            {
+                auto continuation = handle.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+        };
+
+        std::coroutine_handle<> continuation;
+        std::exception_ptr error;
+
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        FinalAwaiter final_suspend() const noexcept { return {}; }
+
+        void unhandled_exception() noexcept { error = std::current_exception(); }
+    };
+
+    template <class T>
+    struct TaskPromise : TaskPromiseBase
+    {
+        std::optional<T> value;
+
+        Task<T> get_return_object() noexcept;
+
+        template <class Value>
+        void return_value( Value &&result ) { value.emplace( std::forward<Value>( result ) ); }
+
+        T result()
+        {
+            if( error ) {
+                std::rethrow_exception( error );
+            }
+
+            return std::move( *value );
+        }
+    };
+
+    template <>
+    struct TaskPromise<void> : TaskPromiseBase
+    {
+        Task<void> get_return_object() noexcept;
+
+        void return_void() noexcept { }
+
+        void result()
+        {
+            if( error ) {
+                std::rethrow_exception( error );
+            }
+        }
+    };
+
+    /* Coroutine, which returns a value of type T
+     *
+     * The task is lazy: its body starts when the task is awaited (or passed to Client::run()/spawn())
+     * and the awaiting coroutine is resumed right after the task is completed.
+     * Exceptions thrown by the body are rethrown from co_await.
+     *
+     * Example:
+     *     curlite::Task<std::string> fetchPage( curlite::Client &client, std::string url )
+     *     {
+     *         curlite::Easy easy;
+     *         std::string page;
+     *
+     *         easy.set( CURLOPT_URL, url );
+     *         easy.writeTo( page );
+     *
+     *         co_await client.fetch( easy );
+     *         co_return page;
+     *     }
+     */
+
+    template <class T = void>
+    class Task
+    {
+    public:
+        typedef TaskPromise<T> promise_type;
+
+    private:
+        std::coroutine_handle<promise_type> _handle;
+
+        Task( Task const &other );
+        void operator = ( Task const &other );
+
+        friend struct TaskPromise<T>;
+        friend class Client;
+
+        explicit Task( std::coroutine_handle<promise_type> handle ) noexcept
+            : _handle( handle )
+        { }
+
+        // run the body until its first suspension, the task must not be awaited afterwards
+        void start()
+        {
+            _handle.resume();
+        }
+
+    public:
+        struct Awaiter
+        {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() const noexcept
+            {
+                return !handle || handle.done();
+            }
+
+            std::coroutine_handle<> await_suspend( std::coroutine_handle<> awaiting ) noexcept
+            {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+
+            T await_resume()
+            {
+                return handle.promise().result();
+            }
+        };
+
+        Task() noexcept
+        { }
+
+        Task( Task &&other ) noexcept
+            : _handle( std::exchange( other._handle, nullptr ) )
+        { }
+
+        ~Task()
+        {
+            if( _handle ) {
+                _handle.destroy();
+            }
+        }
+
+        Task &operator = ( Task &&other ) noexcept
+        {
+            if( this != &other )
+            {
+                if( _handle ) {
+                    _handle.destroy();
+                }
+
+                _handle = std::exchange( other._handle, nullptr );
+            }
+
+            return *this;
+        }
+
+        /* Returns true if the body has finished (returned a value or thrown an exception)
+         */
+
+        bool done() const noexcept
+        {
+            return _handle && _handle.done();
+        }
+
+        /* Returns the value of the finished task or rethrows its exception
+         */
+
+        T result()
+        {
+            return _handle.promise().result();
+        }
+
+        Awaiter operator co_await() const noexcept
+        {
+            return Awaiter { _handle };
+        }
+
+        /* Returns awaitable, which waits for the task to finish without taking its result
+         */
+
+        auto finished() const noexcept
+        {
+            struct Ready : Awaiter
+            {
+                void await_resume() const noexcept { }
+            };
+
+            return Ready { { _handle } };
+        }
+    };
+
+    template <class T>
+    Task<T> TaskPromise<T>::get_return_object() noexcept
+    {
+        return Task<T>( std::coroutine_handle<TaskPromise<T>>::from_promise( *this ) );
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object() noexcept
+    {
+        return Task<void>( std::coroutine_handle<TaskPromise<void>>::from_promise( *this ) );
+    }
+
+    /* Shared state of the tasks started by whenAll()
+     * All the tasks run on the same thread, so the counter isn't atomic.
+     *
+     * The counter owns the coroutines which wait for the tasks, they are destroyed with it:
+     * after all the tasks are finished or, if whenAll() is destroyed before that, together
+     * with the tasks.
+     */
+
+    struct WhenAllCounter
+    {
+        size_t pending;
+        std::coroutine_handle<> continuation;
+        std::vector<std::coroutine_handle<>> starters;
+
+        WhenAllCounter() noexcept
+            : pending( 0 )
+        { }
+
+        WhenAllCounter( WhenAllCounter const &other ) = delete;
+        void operator = ( WhenAllCounter const &other ) = delete;
+
+        ~WhenAllCounter()
+        {
+            for( auto starter : starters ) {
+                starter.destroy();
+            }
+        }
+    };
+
+    // coroutine, which waits for a single task of whenAll() and stays suspended at the end
+    struct WhenAllStarter
+    {
+        struct promise_type
+        {
+            WhenAllCounter *counter;
+
+            // the counter is taken from the arguments of startWhenAll()
+            template <class Task>
+            promise_type( Task const &, WhenAllCounter &counter ) noexcept
+                : counter( &counter )
+            { }
+
+            struct FinalAwaiter
+            {
+                bool await_ready() const noexcept { return false; }
+                void await_resume() const noexcept { }
+
+                std::coroutine_handle<> await_suspend( std::coroutine_handle<promise_type> handle ) noexcept
+                {
+                    WhenAllCounter *counter = handle.promise().counter;
+                    return --counter->pending == 0 ? counter->continuation : std::noop_coroutine();
+                }
+            };
+
+            // the space is reserved by WhenAllAwaiter, so push_back() doesn't throw
+            WhenAllStarter get_return_object() noexcept
+            {
+                counter->starters.push_back( std::coroutine_handle<promise_type>::from_promise( *this ) );
+                return {};
+            }
+
+            std::suspend_never initial_suspend() const noexcept { return {}; }
+            FinalAwaiter final_suspend() const noexcept { return {}; }
+
+            void return_void() noexcept { }
+            void unhandled_exception() noexcept { }
+        };
+    };
+
+    template <class T>
+    WhenAllStarter startWhenAll( Task<T> const &task, WhenAllCounter & )
+    {
+        co_await task.finished();
+    }
+
+    // starts the tasks and suspends the awaiting coroutine until all of them are finished
+    template <class Start>
+    struct WhenAllAwaiter
+    {
+        size_t count;
+        Start start;
+        WhenAllCounter counter;
+
+        bool await_ready() const noexcept
+        {
+            return count == 0;
+        }
+
+        bool await_suspend( std::coroutine_handle<> awaiting )
+        {
+            // one extra reference, so the tasks which finish right away don't resume us from here
+            counter.pending = count + 1;
+            counter.continuation = awaiting;
+            counter.starters.reserve( count );
+
+            start( counter );
+            return --counter.pending > 0;
+        }
+
+        void await_resume() const noexcept { }
+    };
+
+    template <class Start>
+    WhenAllAwaiter<Start> makeWhenAllAwaiter( size_t count, Start start )
+    {
+        return WhenAllAwaiter<Start> { count, std::move( start ), WhenAllCounter() };
+    }
+
+    /* Run the tasks concurrently and wait for all of them.
+     *
+     * Returns the results in the order of the tasks. If some tasks throw, all of them
+     * are still completed and the exception of the first failed task is rethrown.
+     */
+
+    template <class... T>
+    Task<std::tuple<T...>> whenAll( Task<T>... tasks )
+    {
+        static_assert( !( std::is_void<T>::value || ... ), "use whenAll( std::vector<Task<void>> ) for tasks without a result" );
+
+        co_await makeWhenAllAwaiter( sizeof...( T ), [&] ( WhenAllCounter &counter ) {
+            ( startWhenAll( tasks, counter ), ... );
+        } );
+
+        // braced initialization evaluates the results from left to right
+        co_return std::tuple<T...> { tasks.result()... };
+    }
+
+    template <class T>
+    Task<typename std::conditional<std::is_void<T>::value, void, std::vector<T>>::type> whenAll( std::vector<Task<T>> tasks )
+    {
+        co_await makeWhenAllAwaiter( tasks.size(), [&] ( WhenAllCounter &counter ) {
+            for( auto &task : tasks ) {
+                startWhenAll( task, counter );
+            }
+        } );
+
+        if constexpr( std::is_void<T>::value )
+        {
+            for( auto &task : tasks ) {
+                task.result();
+            }
+        }
+        else
+        {
+            std::vector<T> results;
+            results.reserve( tasks.size() );
+
+            for( auto &task : tasks ) {
+                results.push_back( task.result() );
+            }
+
+            co_return results;
+        }
+    }
+
+    /* Runs coroutines, which await transfers, on the current thread
+     *
+     * Transfers are driven by a single curl_multi session (EventLoop on Linux), so thousands of
+     * logical flows cost neither a thread nor a stack each. Use one Client per thread to spread
+     * the flows over several cores. A Client must be used only by the thread which runs it.
+     * Requires C++20, both for the library and for the application.
+     *
+     * Example:
+     *     curlite::Task<> flow( curlite::Client &client )
+     *     {
+     *         curlite::Easy login;
+     *         login.set( CURLOPT_URL, "https://example.com/login" );
+     *
+     *         if( !co_await client.fetch( login ) ) {
+     *             co_return;
+     *         }
+     *
+     *         std::vector<curlite::Task<std::string>> pages;
+     *         for( auto &url : urls ) {
+     *             pages.push_back( fetchPage( client, url ) );
+     *         }
+     *
+     *         auto results = co_await curlite::whenAll( std::move( pages ) );
+     *     }
+     *
+     *     curlite::Client client;
+     *     client.run( flow( client ) );
+     */
+
+    class Client
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        Client( Client const &other );
+        void operator = ( Client const &other );
+
+    public:
+        /* Awaitable transfer of an Easy object (see fetch())
+         */
+
+        class Transfer
+        {
+            Pimpl *_client;
+            Easy *_easy;
+            std::coroutine_handle<> _awaiting;
+
+            friend class Client;
+
+            Transfer( Pimpl *client, Easy &easy );
+
+        public:
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend( std::coroutine_handle<> awaiting );
+            Easy &await_resume() const noexcept { return *_easy; }
+        };
+
+        Client();
+        Client( Client &&other );
+        virtual ~Client();
+
+        Client &operator = ( Client &&other );
+
+        /* Returns the underlying Multi object (to set options, check errors, etc.)
+         */
+
+        Multi &multi();
+
+        /* Start the transfer and suspend the awaiting coroutine until it's completed.
+         *
+         * The Easy object is handed over to the multi session during the transfer (its options and
+         * handlers stay in place) and is given back before the coroutine is resumed.
+         * co_await returns the same Easy object, check Easy::error() for the result of the transfer.
+         */
+
+        Transfer fetch( Easy &easy );
+
+        /* Start the task and keep it until it's finished. The exception of the task
+         * is rethrown from run().
+         */
+
+        void spawn( Task<void> task );
+
+        /* Returns the number of transfers which are still running
+         */
+
+        size_t running() const;
+
+        /* Wait up to timeoutMs milliseconds (-1 means "until something happens") for transfer
+         * activity and resume the coroutines whose transfers are completed.
+         */
+
+        bool runOnce( int timeoutMs = -1 );
+
+        /* Process events until all the spawned tasks are finished
+         */
+
+        bool run();
+
+        /* Run the task until it's finished and return its result.
+         * Spawned tasks run at the same time.
+         */
+
+        template <class T>
+        T run( Task<T> task );
+    };
+
+    template <class T>
+    T Client::run( Task<T> task )
+    {
+        task.start();
+
+        while( !task.done() )
+        {
+            if( running() == 0 ) {
+                throw Exception( "the task waits for something which doesn't run on the client" );
+            }
+
+            if( !runOnce() ) {
+                throw Exception( "the client event loop has failed" );
+            }
+        }
+
+        return task.result();
+    }
+
+#endif
+
+    template <class ValueType>
+    bool Multi::set( CURLMoption key, ValueType value )
+    {
+        static_assert( int(OptionTypeCode<ValueType>::value) != int(OptionInvalidCode::value), "the type is not supported by curl_multi_setopt" );
+
+        auto err = CURLM_OK;
+
+        // realtime argument check
+        auto keyTypeCode = key / kCurlOptTypeInterval * kCurlOptTypeInterval;
+        bool isValueAllowedNullPtr = std::is_same<ValueType, std::nullptr_t>::value &&
+                                     keyTypeCode != CURLOPTTYPE_LONG;
+        // curl_off_t may be the same type as long (e.g. on LP64 platforms)
+        bool isValueAllowedOffset = std::is_same<ValueType, curl_off_t>::value &&
+                                    keyTypeCode == CURLOPTTYPE_OFF_T;
+
+        if( OptionTypeCode<ValueType>::value != keyTypeCode && !isValueAllowedNullPtr && !isValueAllowedOffset ) {
+            err = CURLM_UNKNOWN_OPTION;
+        } else {
+            err = curl_multi_setopt( get(), key, value );
+        }
+
+        return handleError( err );
+    }
+
+    inline bool Multi::set( CURLMoption key, int value )
+    {
+        return set( key, static_cast<long>( value ) );
+    }
+
+    inline bool Multi::set( CURLMoption key, bool value )
+    {
+        return set( key, static_cast<long>( value ) );
+    }
+
+    /* The class implements share interface of cURL
+     *
+     * Easy objects attached to the same Share use common DNS cache, TLS session cache,
+     * connection cache, etc. Every kind of shared data is protected by its own
+     * reader/writer lock, so Easy objects may run on different threads.
+     *
+     * Note: cURL doesn't support sharing the connection cache (CURL_LOCK_DATA_CONNECT) between
+     * threads running transfers concurrently, share it only among Easy objects of one thread.
+     * The size of shared connection cache is limited by CURLOPT_MAXCONNECTS of the Easy
+     * objects (5 by default).
+     *
+     * Note: Easy objects should be detached or destroyed before the Share. Otherwise cURL
+     * refuses to clean the share up and it's leaked together with its locks.
+     *
+     * Example:
+     *     curlite::Share share ({
+     *         CURL_LOCK_DATA_DNS,
+     *         CURL_LOCK_DATA_SSL_SESSION
+     *     });
+     *
+     *     // on any thread
+     *     curlite::Easy easy;
+     *     easy.set( CURLOPT_SHARE, share );
+     */
+
+    class Share
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        Share( Share const &other );
+        void operator = ( Share const &other );
+
+        bool handleError( CURLSHcode code );
+        void cleanup();
+
+    public:
+        Share( std::vector<curl_lock_data> const &data = std::vector<curl_lock_data>() );
+        Share( Share &&other );
+        virtual ~Share();
+
+        Share &operator = ( Share &&other );
+
+        /* Returns true if there was no error during last operation
+         * Equivalent of (error() == CURLSHE_OK)
+         */
+
+        operator bool() const;
+
+        /* Release the ownership of the managed CURLSH object if any.
+         *
+         * Note: lock functions of the released object refer to this instance, so it must outlive them.
+         *
+         * Returns pointer to the managed CURLSH object or nullptr.
+         */
+
+        CURLSH *release();
+
+        /* Returns pointer to the managed CURLSH object
+         */
+
+        CURLSH *get() const;
+
+        /* Set current exception mode.
+         * Pass true to throw exceptions on error, false otherwise.
+         */
+
+        void setExceptionMode( bool throwExceptions );
+
+        /* Returns true if exceptions are "on"
+         */
+
+        bool exceptionMode() const;
+
+        /* Returns last cURL share error code
+         */
+
+        CURLSHcode error() const;
+
+        /* Returns a string describing last cURL share error
+         */
+
+        std::string errorString() const;
+
+        /* Start/stop sharing particular kind of data (CURL_LOCK_DATA_*)
+         * See CURLSHOPT_SHARE and CURLSHOPT_UNSHARE for details.
+         */
+
+        bool share( curl_lock_data data );
+        bool unshare( curl_lock_data data );
+    };
+
+    inline bool Easy::set( CURLoption key, Share const &value )
+    {
+        return set( key, (void*) value.get() );
+    }
+
+    /* Response headers of a transfer
+     *
+     * Header lines are appended to a single buffer as they arrive and indexed on the first
+     * lookup, all the returned strings point into the buffer (they are valid until the headers
+     * change). The buffer starts over with every response, so after redirects it holds the
+     * headers of the last one. Obsolete folded lines are not supported.
+     *
+     * Example:
+     *     curlite::Headers headers;
+     *
+     *     curlite::Easy easy;
+     *     easy.set( CURLOPT_URL, "http://example.com" );
+     *     easy.collectHeaders( headers );
+     *     easy.perform();
+     *
+     *     std::cout << headers.contentType() << " " << headers.get( "Server" ) << std::endl;
+     */
+
+    class Headers
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        Headers( Headers const &other );
+        void operator = ( Headers const &other );
+
+    public:
+        Headers();
+        Headers( Headers &&other );
+        virtual ~Headers();
+
+        Headers &operator = ( Headers &&other );
+
+        /* Append a header line (as it's passed to the header handler)
+         * A status line starts the headers of a new response.
+         */
+
+        void append( const char *data, size_t size );
+
+        /* Remove all the headers
+         */
+
+        void clear();
+
+        /* Returns the raw header block of the response
+         */
+
+        std::string_view raw() const;
+
+        /* Returns the status line without CRLF (e.g. "HTTP/1.1 200 OK")
+         */
+
+        std::string_view statusLine() const;
+
+        /* Returns the status code from the status line or 0
+         */
+
+        long status() const;
+
+        /* Returns the number of header fields
+         */
+
+        size_t size() const;
+
+        /* Returns name and value of the field by its index
+         */
+
+        std::string_view name( size_t index ) const;
+        std::string_view value( size_t index ) const;
+
+        /* Returns value of the first field with the name (case-insensitive), empty if there is none
+         */
+
+        std::string_view get( std::string_view name ) const;
+
+        /* Returns true if there is a field with the name (case-insensitive)
+         */
+
+        bool has( std::string_view name ) const;
+
+        /* Shortcuts for the frequent fields, they don't search the headers.
+         * contentLength() returns -1 if the field is missing or invalid.
+         */
+
+        curl_off_t contentLength() const;
+        std::string_view contentType() const;
+        std::string_view etag() const;
+    };
+
+    /* Base class of the framers, which split a streaming body into records
+     *
+     * The body is fed chunk by chunk, and every complete record is passed to the handler.
+     * A record contained in a single chunk is passed as a view into the chunk, without copying.
+     * Only a record split between chunks is gathered in an internal buffer, which is reused.
+     * The views are valid only during the call of the handler.
+     */
+
+    class Framer
+    {
+    public:
+        // returns false to stop the transfer
+        typedef std::function<bool (std::string_view record)> RecordHandler;
+
+        virtual ~Framer();
+
+        /* Process the next chunk of the stream.
+         * Returns false if the stream is malformed or the handler has stopped it.
+         */
+
+        virtual bool feed( const char *data, size_t size ) = 0;
+
+        /* Process the end of the stream.
+         * Returns false if the stream ends in the middle of a record.
+         */
+
+        virtual bool finish() = 0;
+
+        /* Drop the buffered data and start over (e.g. before reconnecting)
+         */
+
+        virtual void reset() = 0;
+    };
+
+    /* Framer of newline-delimited records (NDJSON, JSON Lines, logs, ...)
+     *
+     * Records are separated by LF or CRLF, empty lines are skipped. The last record
+     * doesn't need the trailing newline, it's passed by finish().
+     *
+     * Example:
+     *     curlite::LineFramer lines( [] ( std::string_view record ) {
+     *         std::cout << record << std::endl;
+     *         return true;
+     *     } );
+     *
+     *     easy >> lines;
+     */
+
+    class LineFramer : public Framer
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        LineFramer( LineFramer const &other );
+        void operator = ( LineFramer const &other );
+
+    public:
+        /*     onRecord           handler of the records
+         *     maxRecordSize      longer records fail the stream
+         */
+
+        LineFramer( RecordHandler onRecord, size_t maxRecordSize = 16 << 20 );
+        LineFramer( LineFramer &&other );
+        virtual ~LineFramer();
+
+        LineFramer &operator = ( LineFramer &&other );
+
+        bool feed( const char *data, size_t size ) override;
+        bool finish() override;
+        void reset() override;
+    };
+
+    /* Event of a server-sent events stream (text/event-stream)
+     */
+
+    struct ServerSentEvent
+    {
+        std::string_view    type;       // "message" unless the event field is set
+        std::string_view    data;       // data lines joined with LF
+        std::string_view    id;         // the last event ID of the stream
+        long                retry;      // reconnection time in ms or -1
+    };
+
+    /* Framer of server-sent events (text/event-stream)
+     *
+     * Lines are separated by LF, CRLF or a lone CR, an empty line dispatches
+     * the event. Comments and unknown fields are ignored, events without data are not dispatched.
+     * UTF-8 BOM at the beginning of the stream is skipped, even if it's split between chunks.
+     * Data of a single line is passed without copying, if the event doesn't span chunks.
+     */
+
+    class EventStreamFramer : public Framer
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        EventStreamFramer( EventStreamFramer const &other );
+        void operator = ( EventStreamFramer const &other );
+
+    public:
+        // returns false to stop the transfer
+        typedef std::function<bool (ServerSentEvent const &event)> EventHandler;
+
+        /*     onEvent            handler of the events
+         *     maxEventSize       longer lines or data fail the stream
+         */
+
+        EventStreamFramer( EventHandler onEvent, size_t maxEventSize = 16 << 20 );
+        EventStreamFramer( EventStreamFramer &&other );
+        virtual ~EventStreamFramer();
+
+        EventStreamFramer &operator = ( EventStreamFramer &&other );
+
+        /* Returns the last event ID, e.g. for the Last-Event-ID header of the reconnection
+         */
+
+        std::string const &lastEventId() const;
+
+        bool feed( const char *data, size_t size ) override;
+        bool finish() override;
+        void reset() override;
+    };
+
+    /* Framer of length-prefixed records
+     *
+     * Every record is preceded by its size as a 4-byte big-endian unsigned integer.
+     */
+
+    class LengthPrefixFramer : public Framer
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        LengthPrefixFramer( LengthPrefixFramer const &other );
+        void operator = ( LengthPrefixFramer const &other );
+
+    public:
+        /*     onRecord           handler of the records
+         *     maxRecordSize      larger records fail the stream
+         */
+
+        LengthPrefixFramer( RecordHandler onRecord, size_t maxRecordSize = 16 << 20 );
+        LengthPrefixFramer( LengthPrefixFramer &&other );
+        virtual ~LengthPrefixFramer();
+
+        LengthPrefixFramer &operator = ( LengthPrefixFramer &&other );
+
+        bool feed( const char *data, size_t size ) override;
+        bool finish() override;
+        void reset() override;
+    };
+
+    /* Streaming digest of the transferred data (see Easy::digestDownload())
+     *
+     * CRC32C uses SSE4.2 (or ARMv8 CRC) instructions and SHA-256 uses SHA extensions,
+     * when the processor supports them. xxHash64 (seed 0) is the fastest, if the other
+     * side can provide it.
+     *
+     * Example:
+     *     curlite::Digest sha( curlite::Digest::Sha256 );
+     *     curlite::Headers headers;
+     *
+     *     easy.collectHeaders( headers );
+     *     easy.digestDownload( sha );
+     *     easy >> file;
+     *
+     *     if( !sha.matches( headers ) && !sha.matches( expectedSha256 ) ) {
+     *         // corrupted download
+     *     }
+     */
+
+    class Digest
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        Digest( Digest const &other );
+        void operator = ( Digest const &other );
+
+    public:
+        enum Algorithm
+        {
+            Crc32c,
+            Sha256,
+            XxHash64
+        };
+
+        Digest( Algorithm algorithm );
+        Digest( Digest &&other );
+        virtual ~Digest();
+
+        Digest &operator = ( Digest &&other );
+
+        Algorithm algorithm() const;
+
+        /* Hash the next part of the data
+         */
+
+        void update( const char *data, size_t size );
+
+        /* Start over
+         */
+
+        void reset();
+
+        /* Returns the number of bytes hashed so far
+         */
+
+        curl_off_t size() const;
+
+        /* Returns the digest of the data hashed so far (big-endian for CRC32C and xxHash64)
+         */
+
+        std::vector<unsigned char> value() const;
+        std::string hex() const;
+        std::string base64() const;
+
+        /* Returns true if the digest matches the expected one, given as hex or base64
+         */
+
+        bool matches( std::string_view expected ) const;
+
+        /* Returns true if the response headers have the digest for the algorithm and it matches.
+         * Content-Digest and Repr-Digest (RFC 9530), Digest (RFC 3230) and x-goog-hash are checked.
+         */
+
+        bool matches( Headers const &headers ) const;
+    };
+
+    /* Shared bandwidth budget of many transfers (see Easy::throttle())
+     *
+     * Separate token buckets limit downloads and uploads. A transfer which runs out of tokens
+     * is paused (CURL_WRITEFUNC_PAUSE / CURL_READFUNC_PAUSE) and resumed by its multi session
+     * once the tokens are refilled, so the aggregate rate follows the budget without a fixed
+     * per-transfer cap. Blocking transfers (Easy::perform()) just wait inside the data callback.
+     *
+     * Transfers are grouped into classes, which share the budget in proportion to their weights
+     * (start-time fair queuing) when there are more transfers than tokens. Class 0 has weight 1.
+     * Fair sharing applies to the transfers of one multi session, different sessions
+     * (e.g. several threads) share the budget as they come.
+     *
+     * The limiter is thread-safe and must outlive the transfers which use it.
+     *
+     * Example:
+     *     curlite::RateLimiter link( 10 << 20, 2 << 20 );    // 10 MB/s down, 2 MB/s up
+     *     size_t bulk = link.addClass( 1 );
+     *     size_t interactive = link.addClass( 4 );
+     *
+     *     easy.throttle( link, bulk );
+     *     multi.add( std::move( easy ) );
+     */
+
+    class RateLimiter
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        RateLimiter( RateLimiter const &other );
+        void operator = ( RateLimiter const &other );
+
+        friend class Easy;
+        friend class Multi;
+
+    public:
+        enum Direction
+        {
+            Download,
+            Upload
+        };
+
+        /* Rates are in bytes per second, 0 means unlimited
+         */
+
+        RateLimiter( curl_off_t downloadRate, curl_off_t uploadRate = 0 );
+        RateLimiter( RateLimiter &&other );
+        virtual ~RateLimiter();
+
+        RateLimiter &operator = ( RateLimiter &&other );
+
+        /* Change the rate (0 means unlimited) and the bucket size (the largest burst after idle time,
+         * 0 selects 50 ms of the rate, but at least 16 KB). Running transfers follow the new rate.
+         */
+
+        void setRate( Direction direction, curl_off_t bytesPerSecond, curl_off_t burst = 0 );
+
+        curl_off_t rate( Direction direction ) const;
+
+        /* Add a class of transfers with the given weight.
+         * Returns the class id to pass to Easy::throttle().
+         */
+
+        size_t addClass( unsigned weight );
+
+        /* Returns the number of bytes passed through the limiter so far
+         */
+
+        curl_off_t transferred( Direction direction ) const;
+    };
+
+    /* Timing histograms and connection reuse counters of completed transfers
+     *
+     * Every transfer is recorded into a series, which is keyed by host and status class ("2xx",
+     * "4xx", "error" if the transfer failed, ...). Each thread records into its own copy of the
+     * series, so recording takes no locks and no atomic read-modify-write operations; the copies
+     * are summed, when the metrics are read. The histograms are log-linear with 16 sub-buckets
+     * per power of two (values are accurate to ~6%).
+     *
+     * Timings follow libcurl: each of them is measured from the start of the transfer, so
+     * e.g. Connect includes NameLookup.
+     *
+     * Example:
+     *     curlite::Metrics metrics;
+     *
+     *     easy.collectMetrics( metrics );
+     *     easy.perform();
+     *
+     *     std::cout << metrics.prometheus();
+     */
+
+    class Metrics
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        Metrics( Metrics const &other );
+        void operator = ( Metrics const &other );
+
+        friend class Easy;
+        friend class Multi;
+
+    public:
+        enum Timing
+        {
+            NameLookup,
+            Connect,
+            AppConnect,
+            PreTransfer,
+            StartTransfer,
+            Total
+        };
+
+        Metrics();
+        Metrics( Metrics &&other );
+        virtual ~Metrics();
+
+        Metrics &operator = ( Metrics &&other );
+
+        /* Record the completed transfer by hand (Easy::collectMetrics() does it automatically)
+         */
+
+        void record( Easy const &easy );
+
+        /* Returns the number of recorded transfers
+         */
+
+        uint64_t transfers() const;
+
+        /* Returns the number of new connections and the number of transfers which reused a connection
+         */
+
+        uint64_t connections() const;
+        uint64_t reusedConnections() const;
+
+        /* Returns the q-quantile (0..1) of the timing over all hosts in seconds
+         */
+
+        double quantile( Timing timing, double q ) const;
+
+        /* Returns the metrics in Prometheus text exposition format
+         */
+
+        std::string prometheus( std::string const &prefix = "curlite" ) const;
+    };
+
+    /* Always-on flight recorder of the debug events (see Easy::captureWire())
+     *
+     * Each thread writes into its own preallocated ring of fixed-size slots: the event type,
+     * the time, the transfer and the first maxPayload bytes of the data, without formatting,
+     * locks or allocations (except the first event of the thread, which allocates its ring).
+     * When a ring is full the oldest events are overwritten. Every transfer gets its own id
+     * when it starts, also the transfers of a reused Easy object.
+     *
+     * The values of the Authorization, Proxy-Authorization, Cookie and Set-Cookie headers are
+     * replaced with '*' before they are recorded, unless redactCredentials( false ) is called.
+     *
+     * Recording turns on CURLOPT_VERBOSE, which costs more than the recording itself: on loopback
+     * a small request takes 4-8% longer (see "wire" in benchmarks/loopback_suite.cpp).
+     *
+     * The recorded events can be dumped at any time from any thread, or automatically when
+     * a transfer fails. The dump is a compact binary file, tools/wire_decode.cpp prints it:
+     *
+     *     header:  "CURLWIRE", uint32 version (1), uint32 maxPayload, int64 start time
+     *              (nanoseconds since the Unix epoch), uint64 number of events
+     *     event:   uint64 nanoseconds since the start, uint32 transfer, uint8 curl_infotype,
+     *              uint8 reserved, uint16 stored size, uint64 original size, stored bytes
+     *
+     * Integers are little-endian, events are ordered by time.
+     *
+     * Example:
+     *     curlite::WireCapture wire;
+     *     wire.dumpOnError( "/var/log/app/wire.bin" );
+     *
+     *     easy.captureWire( wire );
+     */
+
+    class WireCapture
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        WireCapture( WireCapture const &other );
+        void operator = ( WireCapture const &other );
+
+        friend class Easy;
+
+    public:
+        WireCapture( size_t bytesPerThread = 1 << 20, size_t maxPayload = 104 );
+        WireCapture( WireCapture &&other );
+        virtual ~WireCapture();
+
+        WireCapture &operator = ( WireCapture &&other );
+
+        /* Dump the events into the file when a transfer fails (an empty path turns it off)
+         */
+
+        void dumpOnError( std::string const &path );
+
+        /* Hide the values of the headers with credentials (the default) or record them as they are
+         */
+
+        void redactCredentials( bool redact );
+
+        /* Write the recorded events, returns false on I/O error
+         */
+
+        bool dump( std::ostream &stream ) const;
+        bool dump( std::string const &path ) const;
+
+        /* Returns the number of events recorded so far (including the overwritten ones)
+         */
+
+        uint64_t events() const;
+    };
+
+    /* Cache of resolved host addresses, shared by any number of Easy objects (see Easy::useDnsCache())
+     *
+     * warmUp() resolves a list of hosts in parallel ahead of time. When a transfer starts,
+     * the fresh addresses of its host are injected through CURLOPT_RESOLVE, so the transfer
+     * doesn't wait for the resolver. Hosts which aren't cached yet are resolved by cURL as usual
+     * and queued for the cache.
+     *
+     * An entry lives for its TTL. The default resolver uses getaddrinfo(), which doesn't report
+     * TTLs, so they come from the cache (or from a custom resolver, which may set them per host).
+     * A background thread resolves the entries in use again shortly before they expire, the entries
+     * which nobody uses are dropped when they expire. A host which can't be resolved is retried
+     * until its addresses expire and then dropped (at once, if it has none), until a transfer
+     * needs it again.
+     *
+     * save() and load() keep the cache in a text file ("host expiry-unix-time address,address"
+     * per line), so a restarted process starts warm. loadHosts() adds static entries from a file
+     * in /etc/hosts format (for tests with fixtures).
+     *
+     * Example:
+     *     curlite::DnsCache dns;
+     *     dns.load( "/var/cache/app/dns.txt" );
+     *     dns.warmUp( { "api.example.com", "cdn.example.com" } );
+     *
+     *     easy.useDnsCache( dns );
+     *     ...
+     *     dns.save( "/var/cache/app/dns.txt" );
+     */
+
+    class DnsCache
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        DnsCache( DnsCache const &other );
+        void operator = ( DnsCache const &other );
+
+        friend class Easy;
+
+    public:
+        /* Returns the addresses of the host (an empty list on failure), ttl may be changed
+         * from the default one
+         */
+
+        typedef std::function<std::vector<std::string> ( std::string const &host, std::chrono::seconds &ttl )> Resolver;
+
+        DnsCache( std::chrono::seconds ttl = std::chrono::seconds( 60 ), size_t threads = 8 );
+        DnsCache( DnsCache &&other );
+        virtual ~DnsCache();
+
+        DnsCache &operator = ( DnsCache &&other );
+
+        /* Replace getaddrinfo() with the resolver (e.g. a stub in tests)
+         */
+
+        void setResolver( Resolver resolver );
+
+        /* Resolve the hosts in parallel and wait for the result.
+         * Returns the number of hosts which were resolved.
+         */
+
+        size_t warmUp( std::vector<std::string> const &hosts );
+
+        /* Add the addresses of the host, ttl 0 makes a static entry which never expires
+         */
+
+        void add( std::string const &host, std::vector<std::string> const &addresses,
+                  std::chrono::seconds ttl = std::chrono::seconds( 0 ) );
+
+        /* Returns the cached addresses of the host, if they haven't expired
+         */
+
+        std::vector<std::string> lookup( std::string const &host ) const;
+
+        /* Add static entries from the file in /etc/hosts format, returns false if it can't be read
+         */
+
+        bool loadHosts( std::string const &path );
+
+        /* Write the cache into the file or merge the entries from the file into the cache,
+         * returns false on I/O error. Expired entries of the file are queued for resolving.
+         */
+
+        bool save( std::string const &path ) const;
+        bool load( std::string const &path );
+    };
+
+#ifdef __linux__
+
+    /* Destination file of a download
+     *
+     * Data is written with pwrite() (or memcpy() to the mapped file) into a temporary file
+     * next to the destination, the file is preallocated if the size is known in advance.
+     * commit() atomically renames the temporary file to the destination, otherwise the
+     * temporary file is removed in destructor.
+     *
+     * Example:
+     *     curlite::FileSink file( "linux.tar.xz" );
+     *
+     *     curlite::Easy easy;
+     *     easy.set( CURLOPT_URL, "https://example.com/linux.tar.xz" );
+     *     easy >> file;
+     */
+
+    class FileSink
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        FileSink( FileSink const &other );
+        void operator = ( FileSink const &other );
+
+    public:
+        enum Flags
+        {
+            // write via memory mapping when the size is known in advance
+            Mmap        = 1 << 0,
+
+            // bypass page cache (O_DIRECT), useful for very large files which won't be read soon
+            DirectIo    = 1 << 1
+        };
+
+        /*     path               destination file
+         *     flags              combination of Flags
+         */
+
+        FileSink( std::string const &path, int flags = 0 );
+        FileSink( FileSink &&other );
+        virtual ~FileSink();
+
+        FileSink &operator = ( FileSink &&other );
+
+        /* Returns path of the destination file
+         */
+
+        std::string const &path() const;
+
+        /* Returns the number of bytes written so far
+         */
+
+        curl_off_t size() const;
+
+        /* Preallocate space for the whole file (fallocate), called automatically
+         * with Content-Length when the first chunk of the body arrives.
+         */
+
+        bool reserve( curl_off_t size );
+
+        /* Append data to the file
+         */
+
+        bool write( char const *data, size_t size );
+
+        /* Write data at a particular offset of the file (not supported with DirectIo).
+         * The size of the file grows to the end of the written data, if needed.
+         */
+
+        bool writeAt( curl_off_t offset, char const *data, size_t size );
+
+        /* Flush the data to disk and atomically replace the destination file.
+         */
+
+        bool commit();
+
+        /* Remove the temporary file. Called automatically, if the file isn't committed.
+         */
+
+        void discard();
+    };
+
+#endif
+
+#ifdef __linux__
+
+    /* Source file of an upload
+     *
+     * Data is read with pread() (or copied from the mapped file) straight into the cURL buffer,
+     * without stream buffers and std::function handlers in between. The file supports seeking,
+     * so cURL may rewind it after a redirect or an authentication round without reading it again.
+     * A descriptor of a pipe or a socket is read sequentially, its size is unknown (-1) and
+     * the upload is sent without a length (chunked over HTTP/1.1).
+     *
+     * Example:
+     *     curlite::FileSource file( "file.txt" );
+     *
+     *     curlite::Easy easy;
+     *     easy.set( CURLOPT_URL, "ftp://example.com/file.txt" );
+     *     easy.set( CURLOPT_UPLOAD, true );
+     *     easy << file;
+     */
+
+    class FileSource
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        FileSource( FileSource const &other );
+        void operator = ( FileSource const &other );
+
+        friend class Easy;
+
+    public:
+        enum Flags
+        {
+            // read via memory mapping instead of pread()
+            Mmap        = 1 << 0
+        };
+
+        /*     path               file to upload
+         *     fd                 descriptor of the file to upload, only the data from its current offset
+         *                        is uploaded (positions and size below are relative to the offset)
+         *     ownDescriptor      close the descriptor in destructor, if true
+         *     flags              combination of Flags
+         */
+
+        FileSource( std::string const &path, int flags = 0 );
+        FileSource( int fd, bool ownDescriptor = false, int flags = 0 );
+        FileSource( FileSource &&other );
+        virtual ~FileSource();
+
+        FileSource &operator = ( FileSource &&other );
+
+        /* Returns total size of the data to upload, -1 if it's unknown (pipe, socket)
+         */
+
+        curl_off_t size() const;
+
+        /* Returns size of the data from current position to the end, -1 if it's unknown
+         */
+
+        curl_off_t remaining() const;
+
+        /* Returns current read position
+         */
+
+        curl_off_t position() const;
+
+        /* Read up to size bytes from current position.
+         * Returns the number of bytes actually read, 0 at the end of file or (size_t) -1 on error.
+         */
+
+        size_t read( char *buffer, size_t size );
+
+        /* Change current position, origin is SEEK_SET, SEEK_CUR or SEEK_END.
+         */
+
+        bool seek( curl_off_t offset, int origin = SEEK_SET );
+    };
+
+#endif
+
+    /* Thread-safe pool of reusable Easy objects
+     *
+     * Returned objects are reset, but keep their connections, DNS cache and TLS sessions,
+     * so the next transfer to the same host skips TCP and TLS handshakes.
+     *
+     * Example:
+     *     curlite::EasyPool pool;
+     *
+     *     // on any thread
+     *     auto easy = curlite::download( pool, "http://example.com", std::cout );
+     *     pool.release( std::move( easy ) );
+     */
+
+    class EasyPool
+    {
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _impl;
+
+        EasyPool( EasyPool const &other );
+        void operator = ( EasyPool const &other );
+
+    public:
+        /*     capacity           maximum number of idle objects kept by the pool
+         *     share              if not null, every acquired object is attached to it
+         */
+
+        EasyPool( size_t capacity = 16, Share *share = nullptr );
+        EasyPool( EasyPool &&other );
+        virtual ~EasyPool();
+
+        EasyPool &operator = ( EasyPool &&other );
+
+        /* Returns an idle object or a new one, if there is no idle objects.
+         */
+
+        Easy acquire();
+
+        /* Reset the object and keep it for later use.
+         * The object is destroyed if the pool is full.
+         */
+
+        void release( Easy &&easy );
+
+        /* Returns the number of idle objects
+         */
+
+        size_t size() const;
+
+        /* Destroy all the idle objects
+         */
+
+        void clear();
+    };
+
+    /* Wrapper arround curl list (curl_slist)
+     * 
+     * Example:
+     *     List list ({{
+     *         "pragma:"
+     *     }});
+     */
+
+    class List
+    {
+        curl_slist *_list;
+
+        List( List const &other );
+        void operator = ( List const &other );
+    public:
+        List( curl_slist *list = nullptr );
+        List( std::vector<std::string> const &values );
+        List( List &&other );
+
+        ~List();
+
+        List &operator = ( List &&other );
+
+        /* Returns pointer to the managed curl_slist object or nullptr.
+         */
+
+        curl_slist *get() const;
+
+        /* Release the ownership of the managed curl_httppost object if any.
+         *
+         * Returns pointer to the managed curl_slist object or nullptr.
+         */
+        curl_slist *release();
+
+        /* Add new item to the list. 
          */
 
         List &append( char const *s );
@@ -484,11 +3142,12 @@ namespace curlite
     /* Download resource at a particular URL
      *
      *     url                resource to download
-     *     ostr               stream to write the resource data to
+     *     ostr/body          stream or string to write the resource data to
      *     followRedirect     internally sets CURLOPT_FOLLOWLOCATION option to 1, if true
      */
 
     Easy download( std::string const &url, std::ostream &ostr, bool followRedirect = true, bool throwExceptions = true );
+    Easy download( std::string const &url, std::string &body, bool followRedirect = true, bool throwExceptions = true );
 
     /* Upload resource to a particular URL
      *
@@ -506,7 +3165,156 @@ namespace curlite
                  curl_off_t size = -1,
                  bool throwExceptions = true );
 
+#ifdef __linux__
+    /* Upload file to a particular URL. The size of the upload is taken from the file.
+     */
+
+    Easy upload( FileSource &file,
+                 std::string const &url,
+                 std::string const &username = "",
+                 std::string const &password = "",
+                 bool throwExceptions = true );
+#endif
+
+    /* Same as download() and upload() above, but the Easy object is taken from the pool.
+     * Pass the returned object back with EasyPool::release() to reuse its connection.
+     */
+
+    Easy download( EasyPool &pool, std::string const &url, std::ostream &ostr, bool followRedirect = true, bool throwExceptions = true );
+    Easy download( EasyPool &pool, std::string const &url, std::string &body, bool followRedirect = true, bool throwExceptions = true );
+
+    Easy upload( EasyPool &pool,
+                 std::istream &istr,
+                 std::string const &url,
+                 std::string const &username = "",
+                 std::string const &password = "",
+                 curl_off_t size = -1,
+                 bool throwExceptions = true );
+
+#ifdef __linux__
+    Easy upload( EasyPool &pool,
+                 FileSource &file,
+                 std::string const &url,
+                 std::string const &username = "",
+                 std::string const &password = "",
+                 bool throwExceptions = true );
+#endif
+
+
+
+#ifdef __linux__
+    /* Download a single resource over several connections at once
+     *
+     *     url                resource to download
+     *     path               file to save the resource to
+     *     segments           number of simultaneous connections
+     *
+     * The size of the resource is probed with HEAD request first. If the server supports
+     * byte ranges, the resource is split into segments which are downloaded concurrently
+     * and written at their offsets. When a segment is completed, its connection takes over
+     * the second half of the largest remaining segment, so slow connections don't delay
+     * the whole download. Otherwise, the resource is downloaded as a single stream.
+     *
+     * The file is replaced atomically only if the download succeeds (see FileSink): every
+     * segment has to be received completely, otherwise the download fails and the destination
+     * file is left as it was.
+     */
+
+    bool segmentedDownload( std::string const &url, std::string const &path, size_t segments = 4, bool throwExceptions = true );
+#endif
+
+#ifdef __linux__
+    /* Download resource to a file, resuming previously interrupted download if possible
+     *
+     *     url                resource to download
+     *     path               file to save the resource to
+     *     followRedirect     internally sets CURLOPT_FOLLOWLOCATION option to 1, if true
+     *
+     * Received data is kept in "<path>.part" and the progress is periodically saved to the
+     * sidecar file "<path>.checkpoint" (completed byte ranges and the validator of the resource,
+     * i.e. ETag or Last-Modified). Next call continues from the last checkpoint using
+     * Range and If-Range headers (CURLOPT_RESUME_FROM_LARGE and file time for non-HTTP protocols),
+     * so the data is appended only if the resource hasn't changed. Otherwise the download starts over.
+     * It also starts over if a partial response has another validator or doesn't start where
+     * the received data ends (Content-Range), or if the range isn't satisfiable (416).
+     *
+     * On success the partial file is renamed to path and the checkpoint is removed.
+     * An incomplete download is reported as CURLE_PARTIAL_FILE (unless the transfer has
+     * failed with another error), the failure to open or move the file as CURLE_WRITE_ERROR.
+     */
+
+    Easy resumableDownload( std::string const &url, std::string const &path, bool followRedirect = true, bool throwExceptions = true );
+#endif
+
+    /* Item of a batch download
+     *
+     *     url                resource to download
+     *     sink               stream to write the resource data to (data is discarded if null)
+     */
+
+    struct DownloadItem
+    {
+        std::string     url;
+        std::ostream   *sink;
+    };
+
+    /* Result of a single item of a batch download
+     *
+     *     error              result of the transfer, CURLE_ABORTED_BY_CALLBACK if it was cancelled,
+     *                        the error of the Easy object or CURLE_FAILED_INIT if it couldn't start
+     *     responseCode       last received response code (CURLINFO_RESPONSE_CODE)
+     *     size               number of bytes written to the sink
+     */
+
+    struct DownloadResult
+    {
+        CURLcode        error;
+        long            responseCode;
+        curl_off_t      size;
+    };
+
+    /* Parameters of a batch download
+     *
+     *     threads            number of worker threads, 0 means one per core
+     *     concurrency        maximum number of simultaneous transfers per thread, 0 is taken as 1
+     *     followRedirect     internally sets CURLOPT_FOLLOWLOCATION option to 1, if true
+     *     cancel             if not null, setting it to true stops all the transfers
+     *     configure          if set, called for each Easy object before its transfer (e.g. to set timeouts)
+     *     onDone             if set, called on a worker thread for each completed item
+     */
+
+    struct DownloadOptions
+    {
+        size_t                                                  threads;
+        size_t                                                  concurrency;
+        bool                                                    followRedirect;
+        std::atomic<bool> const                                *cancel;
+        std::function<void (Easy &)>                            configure;
+        std::function<void (size_t, DownloadResult const &)>    onDone;
+
+        DownloadOptions()
+         : threads( 0 ), concurrency( 8 ), followRedirect( true ), cancel( nullptr )
+        { }
+    };
+
+    /* Download a batch of resources as fast as possible
+     *
+     * Items are spread over worker threads, each thread runs several transfers at once
+     * and reuses its own Easy objects. Idle threads steal work from busy ones, so the load
+     * stays balanced when resources have very different sizes.
+     *
+     * Returns results in the same order as items.
+     *
+     * Example:
+     *     std::ostringstream a, b;
+     *     auto results = curlite::downloadAll( {
+     *         { "http://example.com/a", &a },
+     *         { "http://example.com/b", &b }
+     *     } );
+     */
 
+    std::vector<DownloadResult> downloadAll( std::vector<DownloadItem> const &items,
+                                             DownloadOptions const &options = DownloadOptions() );
 
 } // end of namespace
 
@@ -0,0 +1,88 @@
+/*
+ * examples/coroutines.cpp
+ *
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2014 Ivan Grynko
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <iostream>
+#include <curlite.hpp>
+
+// requires C++20 (e.g. -std=c++20), both for curlite.cpp and for this file
+
+curlite::Task<size_t> pageSize( curlite::Client &client, std::string url )
+{
+    curlite::Easy easy;
+    easy.set( CURLOPT_URL, url );
+    easy.set( CURLOPT_FOLLOWLOCATION, true );
+
+    // discard the data, only its size is reported
+    easy.onWrite_( [] ( char *, size_t ) -> bool { return true; } );
+
+    // the coroutine is suspended until the transfer is completed, the thread serves other transfers
+    co_await client.fetch( easy );
+
+    if( !easy ) {
+        throw curlite::Exception( easy.errorString().c_str() );
+    }
+
+    co_return size_t( easy.getInfo<curl_off_t>( CURLINFO_SIZE_DOWNLOAD_T ) );
+}
+
+curlite::Task<> crawl( curlite::Client &client )
+{
+    // the first request must succeed before the rest are started
+    std::cout << "example.com: " << co_await pageSize( client, "http://example.com" ) << " bytes" << std::endl;
+
+    std::vector<std::string> urls ({
+        "http://example.org",
+        "http://example.net"
+    });
+
+    std::vector<curlite::Task<size_t>> tasks;
+    for( auto it = urls.begin(); it != urls.end(); ++it ) {
+        tasks.push_back( pageSize( client, *it ) );
+    }
+
+    // all of them run concurrently
+    auto sizes = co_await curlite::whenAll( std::move( tasks ) );
+
+    for( size_t i = 0; i < urls.size(); ++i ) {
+        std::cout << urls[i] << ": " << sizes[i] << " bytes" << std::endl;
+    }
+}
+
+int main()
+{
+    try
+    {
+        curlite::Client client;
+        client.run( crawl( client ) );
+    }
+    catch( std::exception &e ) {
+        std::cerr << "Got an exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * examples/download_to_file.cpp
+ *
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2014 Ivan Grynko
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <iostream>
+#include <curlite.hpp>
+
+int main()
+{
+    try
+    {
+        curlite::Easy easy;
+        easy.set( CURLOPT_URL, "http://example.com" );
+        easy.set( CURLOPT_FOLLOWLOCATION, true );
+
+        // data goes to a temporary file, which replaces data.html only if the download succeeds
+        curlite::FileSink file( "data.html", curlite::FileSink::Mmap );
+
+        easy >> file;
+
+        std::cout << "Saved " << file.size() << " bytes to " << file.path() << std::endl;
+    }
+    catch( std::exception &e ) {
+        std::cerr << "Got an exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * examples/multi_download.cpp
+ *
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2014 Ivan Grynko
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <iostream>
+#include <curlite.hpp>
+
+int main()
+{
+    try
+    {
+        curlite::Multi multi;
+
+        std::vector<std::string> urls ({
+            "http://example.com",
+            "http://example.org",
+            "http://example.net"
+        });
+
+        for( auto it = urls.begin(); it != urls.end(); ++it )
+        {
+            curlite::Easy easy;
+            easy.set( CURLOPT_URL, *it );
+            easy.set( CURLOPT_FOLLOWLOCATION, true );
+
+            // discard the data, only its size is reported
+            easy.onWrite_( [] ( char *, size_t ) -> bool { return true; } );
+
+            multi.add( std::move( easy ) );
+        }
+
+        // all the transfers run concurrently on the current thread
+        multi.run( [&multi] ( curlite::Easy &easy )
+        {
+            std::cout << easy.getInfo<std::string>( CURLINFO_EFFECTIVE_URL ) << ": ";
+
+            if( easy ) {
+                std::cout << easy.getInfo<curl_off_t>( CURLINFO_SIZE_DOWNLOAD_T ) << " bytes" << std::endl;
+            } else {
+                std::cout << easy.errorString() << std::endl;
+            }
+
+            multi.remove( &easy );
+        });
+    }
+    catch( std::exception &e ) {
+        std::cerr << "Got an exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
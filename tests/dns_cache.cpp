@@ -0,0 +1,217 @@
+/*
+ * tests/dns_cache.cpp
+ *
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2014 Ivan Grynko
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/* curlite::DnsCache with a stub resolver and a hosts file fixture
+ *
+ * Usage: dns_cache
+ *
+ * No real DNS is queried: names are resolved by a stub, which counts the lookups, or taken
+ * from a fixture in /etc/hosts format, and a transfer reaches the loopback server through
+ * a name known only to the cache. Takes a few seconds, the TTLs are one second. POSIX only.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+#include <curlite.hpp>
+
+#include "../tools/loopback_server.hpp"
+
+namespace
+{
+    using curlite::tools::LoopbackServer;
+
+    int failures = 0;
+
+    void check( bool condition, char const *what )
+    {
+        if( !condition ) {
+            std::cerr << "FAILED: " << what << std::endl;
+            failures++;
+        }
+    }
+
+    // resolves "*.test" names from the table and counts the lookups of every name
+    struct StubResolver
+    {
+        std::mutex mutex;
+        std::map<std::string, std::vector<std::string>> table;
+        std::map<std::string, size_t> lookups;
+
+        curlite::DnsCache::Resolver resolver()
+        {
+            return [this] ( std::string const &host, std::chrono::seconds & ) {
+                std::lock_guard<std::mutex> lock( mutex );
+                lookups[host]++;
+
+                auto it = table.find( host );
+                return it != table.end() ? it->second : std::vector<std::string>();
+            };
+        }
+
+        size_t count( std::string const &host )
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            return lookups[host];
+        }
+    };
+
+    void testWarmUp()
+    {
+        StubResolver stub;
+        stub.table["a.test"] = { "10.0.0.1", "10.0.0.2" };
+        stub.table["b.test"] = { "fd00::1" };
+
+        curlite::DnsCache dns( std::chrono::seconds( 1 ) );
+        dns.setResolver( stub.resolver() );
+
+        check( dns.warmUp( { "a.test", "B.test", "missing.test" } ) == 2, "warm-up resolves the known hosts" );
+        check( dns.lookup( "a.test" ) == stub.table["a.test"], "warmed-up host has its addresses" );
+        check( dns.lookup( "b.test" ) == stub.table["b.test"], "host names are case-insensitive" );
+        check( dns.lookup( "missing.test" ).empty(), "unknown host has no addresses" );
+
+        // the unknown host isn't retried without a transfer which needs it, the warmed-up one is
+        // refreshed once, but nobody uses it afterwards, so it's dropped when it expires
+        std::this_thread::sleep_for( std::chrono::milliseconds( 2500 ) );
+
+        check( stub.count( "missing.test" ) == 1, "unknown host is resolved only once" );
+        check( stub.count( "a.test" ) == 2, "warmed-up host is refreshed before it expires" );
+        check( dns.lookup( "a.test" ).empty(), "unused host expires" );
+
+        std::this_thread::sleep_for( std::chrono::milliseconds( 2500 ) );
+
+        check( stub.count( "a.test" ) == 2, "expired unused host isn't resolved anymore" );
+        check( stub.count( "missing.test" ) == 1, "unknown host isn't resolved anymore" );
+    }
+
+    void testHostsFixture( LoopbackServer &server, std::string const &path )
+    {
+        {
+            std::ofstream hosts( path, std::ios::trunc );
+            hosts << "# fixture\n"
+                  << "127.0.0.1   loopback.test   Alias.test\n"
+                  << "fd00::2     alias.test      # comment\n";
+        }
+
+        curlite::DnsCache dns;
+        dns.setResolver( [] ( std::string const &, std::chrono::seconds & ) { return std::vector<std::string>(); } );
+
+        check( dns.loadHosts( path ), "hosts file is loaded" );
+        check( dns.lookup( "loopback.test" ) == std::vector<std::string> { "127.0.0.1" }, "host of the fixture" );
+        check( dns.lookup( "alias.test" ) == std::vector<std::string> { "127.0.0.1", "fd00::2" }, "alias of the fixture" );
+        check( !dns.loadHosts( path + ".missing" ), "missing hosts file is reported" );
+
+        // the name exists only in the cache
+        curlite::Easy easy;
+        std::string body;
+
+        easy.setExceptionMode( false );
+        easy.useDnsCache( dns );
+        easy.set( CURLOPT_URL, "http://loopback.test:" + std::to_string( server.port() ) + "/bytes/100" );
+        easy.set( CURLOPT_TIMEOUT_MS, 5000L );
+
+        check( ( easy >> body ) && body.size() == 100, "transfer uses the address of the fixture" );
+    }
+
+    void testPersistence( std::string const &path )
+    {
+        StubResolver stub;
+        stub.table["a.test"] = { "10.0.0.1" };
+
+        {
+            curlite::DnsCache dns( std::chrono::seconds( 60 ) );
+            dns.setResolver( stub.resolver() );
+            dns.warmUp( { "a.test" } );
+            dns.add( "static.test", { "10.0.0.9" } );
+
+            check( dns.save( path ), "cache is saved" );
+        }
+
+        StubResolver offline;
+        curlite::DnsCache dns;
+        dns.setResolver( offline.resolver() );
+
+        check( dns.load( path ), "cache is loaded" );
+        check( dns.lookup( "a.test" ) == std::vector<std::string> { "10.0.0.1" }, "saved host is loaded" );
+        check( dns.lookup( "static.test" ) == std::vector<std::string> { "10.0.0.9" }, "static host is loaded" );
+        check( offline.count( "a.test" ) == 0, "fresh loaded host isn't resolved" );
+
+        // an expired entry of the file is resolved again instead of being used
+        {
+            std::ofstream file( path, std::ios::trunc );
+            file << "old.test " << std::time( nullptr ) - 10 << " 10.0.0.3\n";
+        }
+
+        StubResolver moved;
+        moved.table["old.test"] = { "10.0.0.4" };
+
+        curlite::DnsCache reloaded;
+        reloaded.setResolver( moved.resolver() );
+        reloaded.load( path );
+
+        for( int i = 0; i < 100 && reloaded.lookup( "old.test" ).empty(); ++i ) {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        }
+
+        check( reloaded.lookup( "old.test" ) == std::vector<std::string> { "10.0.0.4" }, "expired loaded host is resolved again" );
+    }
+}
+
+int main()
+{
+    std::string path = "/tmp/curlite_dns_" + std::to_string( getpid() );
+
+    try
+    {
+        LoopbackServer server;
+
+        testWarmUp();
+        testHostsFixture( server, path );
+        testPersistence( path );
+    }
+    catch( std::exception &e ) {
+        std::cerr << "Got an exception: " << e.what() << std::endl;
+        failures++;
+    }
+
+    std::remove( path.c_str() );
+
+    if( failures > 0 ) {
+        return 1;
+    }
+
+    std::cout << "dns_cache: ok" << std::endl;
+    return 0;
+}
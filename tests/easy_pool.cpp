@@ -0,0 +1,198 @@
+/*
+ * tests/easy_pool.cpp
+ *
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2014 Ivan Grynko
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/* Reuse of Easy objects through curlite::EasyPool against the loopback server
+ *
+ * Usage: easy_pool
+ *
+ * An object released in the middle of a paused transfer has to come back from the pool
+ * without the pause and the rate limiter of its previous user, and an object released after
+ * a transfer without the handlers and the digests of its previous user. POSIX only.
+ */
+
+#include <iostream>
+#include <string>
+#include <curlite.hpp>
+
+#include "../tools/loopback_server.hpp"
+
+namespace
+{
+    using curlite::tools::LoopbackServer;
+
+    int failures = 0;
+
+    void check( bool condition, char const *what )
+    {
+        if( !condition ) {
+            std::cerr << "FAILED: " << what << std::endl;
+            failures++;
+        }
+    }
+
+    // runs the transfer to the end, returns the completed object
+    curlite::Easy runTransfer( curlite::Multi &multi, curlite::Easy &&easy )
+    {
+        curlite::Easy *running = multi.add( std::move( easy ) );
+        while( multi.next() != running ) {
+            multi.perform();
+            multi.poll( 100 );
+        }
+
+        return multi.remove( running );
+    }
+
+    size_t countBytes( char *, size_t size, size_t n, void *userPtr )
+    {
+        *static_cast<size_t*>( userPtr ) += size * n;
+        return size * n;
+    }
+
+    void testReleasePaused( LoopbackServer &server )
+    {
+        const size_t bytes = 256 << 10;
+
+        curlite::EasyPool pool( 1 );
+        curlite::Multi multi;
+        curlite::RateLimiter limiter( 1 << 20 );
+
+        // the first user pauses the transfer and gives the object back in the middle of it
+        {
+            curlite::Easy easy = pool.acquire();
+            easy.set( CURLOPT_URL, server.url( bytes ) );
+            easy.throttle( limiter, limiter.addClass( 1 ) );
+            easy.onWrite_( [] ( char *, size_t ) { return true; } );
+
+            curlite::Easy *running = multi.add( std::move( easy ) );
+            multi.perform();
+            running->pause( CURLPAUSE_ALL );
+            multi.perform();
+
+            pool.release( multi.remove( running ) );
+        }
+
+        check( pool.size() == 1, "paused object is kept by the pool" );
+
+        // the next user throttles it again, so the limiter pauses and resumes the transfer
+        curlite::Easy easy = pool.acquire();
+        check( pool.size() == 0, "pooled object is acquired" );
+
+        size_t received = 0;
+        easy.setExceptionMode( false );
+        easy.set( CURLOPT_URL, server.url( bytes ) );
+        easy.set( CURLOPT_TIMEOUT_MS, 10000L );
+        easy.throttle( limiter );
+        easy.onWrite_( [&received] ( char *, size_t size ) {
+            received += size;
+            return true;
+        } );
+
+        easy = runTransfer( multi, std::move( easy ) );
+
+        check( easy.error() == CURLE_OK, "reused object completes its transfer" );
+        check( received == bytes, "reused object receives the whole body" );
+
+        pool.release( std::move( easy ) );
+
+        // and without a limiter at all
+        easy = pool.acquire();
+        received = 0;
+        easy.setExceptionMode( false );
+        easy.set( CURLOPT_URL, server.url( bytes ) );
+        easy.set( CURLOPT_TIMEOUT_MS, 10000L );
+        easy.onWrite_( [&received] ( char *, size_t size ) {
+            received += size;
+            return true;
+        } );
+
+        check( easy.perform() && received == bytes, "reused object completes a blocking transfer" );
+    }
+
+    void testReleaseHandlers( LoopbackServer &server )
+    {
+        const size_t bytes = 64 << 10;
+
+        curlite::EasyPool pool( 1 );
+        curlite::Digest digest( curlite::Digest::Crc32c );
+        size_t stale = 0;
+
+        // the first user leaves its handlers and a digest on the object
+        {
+            curlite::Easy easy = pool.acquire();
+            easy.set( CURLOPT_URL, server.url( bytes ) );
+            easy.onWrite_( [&stale] ( char *, size_t size ) {
+                stale += size;
+                return true;
+            } );
+            easy.onHeader_( [&stale] ( char *, size_t size ) {
+                stale += size;
+                return true;
+            } );
+            easy.digestDownload( digest );
+            easy.perform();
+
+            pool.release( std::move( easy ) );
+        }
+
+        size_t staleBefore = stale;
+        curl_off_t digestedBefore = digest.size();
+
+        // the next user only sets a plain write function, none of the old handlers may see its transfer
+        curlite::Easy easy = pool.acquire();
+        size_t received = 0;
+
+        easy.setExceptionMode( false );
+        easy.set( CURLOPT_URL, server.url( bytes ) );
+        easy.set( CURLOPT_WRITEFUNCTION, &countBytes );
+        easy.set( CURLOPT_WRITEDATA, (void*) &received );
+
+        check( easy.perform() && received == bytes, "reused object completes its transfer" );
+        check( stale == staleBefore, "handlers of the previous user aren't called" );
+        check( digest.size() == digestedBefore, "digest of the previous user isn't updated" );
+    }
+}
+
+int main()
+{
+    try
+    {
+        LoopbackServer server;
+        testReleasePaused( server );
+        testReleaseHandlers( server );
+    }
+    catch( std::exception &e ) {
+        std::cerr << "Got an exception: " << e.what() << std::endl;
+        failures++;
+    }
+
+    if( failures > 0 ) {
+        return 1;
+    }
+
+    std::cout << "easy_pool: ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * tests/framers.cpp
+ *
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2014 Ivan Grynko
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/* Framers fed with the same stream split at every position
+ *
+ * Usage: framers
+ *
+ * Every split has to produce the same records as the whole stream fed at once.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <curlite.hpp>
+
+namespace
+{
+    int failures = 0;
+
+    void check( bool condition, std::string const &what )
+    {
+        if( !condition ) {
+            std::cerr << "FAILED: " << what << std::endl;
+            failures++;
+        }
+    }
+
+    // feeds the stream in two chunks split at the position (the whole stream if it's the end)
+    template <class Framer>
+    bool feedSplit( Framer &framer, std::string const &stream, size_t split )
+    {
+        return framer.feed( stream.data(), split ) &&
+               framer.feed( stream.data() + split, stream.size() - split ) &&
+               framer.finish();
+    }
+
+    void testEventStream()
+    {
+        const std::string bom = "\xEF\xBB\xBF";
+        const std::string body = "data: first\r\n\r\nevent: update\ndata: a\ndata: b\n\n: comment\rid: 7\rdata: last\r\r";
+        const std::vector<std::string> expected = { "message:first", "update:a\nb", "message:last" };
+
+        for( std::string const &stream: { body, bom + body } )
+        {
+            for( size_t split = 0; split <= stream.size(); ++split )
+            {
+                std::vector<std::string> events;
+                curlite::EventStreamFramer framer( [&events] ( curlite::ServerSentEvent const &event ) {
+                    events.push_back( std::string( event.type ) + ":" + std::string( event.data ) );
+                    return true;
+                } );
+
+                std::string where = "event stream " + std::string( stream.size() > body.size() ? "with" : "without" ) +
+                                    " BOM split at " + std::to_string( split );
+
+                check( feedSplit( framer, stream, split ), where + " is complete" );
+                check( events == expected, where + " has the events" );
+                check( framer.lastEventId() == "7", where + " has the last event ID" );
+            }
+        }
+
+        // bytes which look like the beginning of BOM belong to the first field
+        const std::string stream = "\xEF\xBBx: y\ndata: z\n\n";
+        for( size_t split = 0; split <= stream.size(); ++split )
+        {
+            std::vector<std::string> events;
+            curlite::EventStreamFramer framer( [&events] ( curlite::ServerSentEvent const &event ) {
+                events.push_back( std::string( event.data ) );
+                return true;
+            } );
+
+            check( feedSplit( framer, stream, split ) && events == std::vector<std::string> { "z" },
+                   "incomplete BOM split at " + std::to_string( split ) );
+        }
+    }
+
+    std::string prefixed( std::string const &record )
+    {
+        size_t size = record.size();
+        std::string prefix = { char( size >> 24 ), char( size >> 16 ), char( size >> 8 ), char( size ) };
+
+        return prefix + record;
+    }
+
+    void testLengthPrefix()
+    {
+        const std::vector<std::string> expected = { "one", "", "three", std::string( 300, 'x' ), "" };
+
+        std::string stream;
+        for( auto &record: expected ) {
+            stream += prefixed( record );
+        }
+
+        for( size_t split = 0; split <= stream.size(); ++split )
+        {
+            std::vector<std::string> records;
+            curlite::LengthPrefixFramer framer( [&records] ( std::string_view record ) {
+                records.push_back( std::string( record ) );
+                return true;
+            } );
+
+            std::string where = "length-prefixed stream split at " + std::to_string( split );
+
+            check( feedSplit( framer, stream, split ), where + " is complete" );
+            check( records == expected, where + " has the records" );
+        }
+
+        // the stream ends in the middle of the prefix and of the record
+        for( size_t end: { size_t( 2 ), size_t( 5 ) } )
+        {
+            curlite::LengthPrefixFramer framer( [] ( std::string_view ) { return true; } );
+            check( !feedSplit( framer, stream.substr( 0, end ), end / 2 ),
+                   "stream truncated at " + std::to_string( end ) + " is incomplete" );
+        }
+    }
+}
+
+int main()
+{
+    testEventStream();
+    testLengthPrefix();
+
+    if( failures > 0 ) {
+        return 1;
+    }
+
+    std::cout << "framers: ok" << std::endl;
+    return 0;
+}
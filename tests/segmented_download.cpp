@@ -0,0 +1,143 @@
+/*
+ * tests/segmented_download.cpp
+ *
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2014 Ivan Grynko
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/* curlite::segmentedDownload() against the loopback server
+ *
+ * Usage: segmented_download
+ *
+ * A complete download has to produce the same bytes as the server sends, a download with
+ * a broken segment has to fail and leave the destination file as it was. POSIX only.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdio>
+#include <unistd.h>
+#include <curlite.hpp>
+
+#include "../tools/loopback_server.hpp"
+
+namespace
+{
+    using curlite::tools::LoopbackServer;
+
+    const size_t kBytes = 4 << 20;
+
+    int failures = 0;
+
+    void check( bool condition, char const *what )
+    {
+        if( !condition ) {
+            std::cerr << "FAILED: " << what << std::endl;
+            failures++;
+        }
+    }
+
+    std::string readFile( std::string const &path )
+    {
+        std::ifstream file( path, std::ios::binary );
+        std::stringstream content;
+        content << file.rdbuf();
+
+        return content.str();
+    }
+
+    std::string expectedBody( size_t bytes )
+    {
+        std::string body( bytes, '\0' );
+        for( size_t i = 0; i < bytes; ++i ) {
+            body[i] = char( 'a' + i % 26 );
+        }
+
+        return body;
+    }
+
+    void testComplete( LoopbackServer &server, std::string const &path )
+    {
+        std::remove( path.c_str() );
+
+        bool ok = curlite::segmentedDownload( server.url( kBytes ), path, 4, false );
+
+        check( ok, "complete download succeeds" );
+        check( readFile( path ) == expectedBody( kBytes ), "complete download has the served bytes" );
+    }
+
+    void testBrokenSegment( LoopbackServer &server, std::string const &path )
+    {
+        {
+            std::ofstream previous( path, std::ios::binary | std::ios::trunc );
+            previous << "previous";
+        }
+
+        // the connection of the third segment is closed in its middle
+        std::string url = server.url( kBytes ) + "?cut=" + std::to_string( kBytes / 2 + kBytes / 8 );
+
+        bool ok = curlite::segmentedDownload( url, path, 4, false );
+
+        check( !ok, "download with a broken segment fails" );
+        check( readFile( path ) == "previous", "destination is kept after a broken segment" );
+
+        bool thrown = false;
+        try {
+            curlite::segmentedDownload( url, path, 4, true );
+        }
+        catch( curlite::Exception & ) {
+            thrown = true;
+        }
+
+        check( thrown, "broken segment throws in exception mode" );
+        check( readFile( path ) == "previous", "destination is kept after the exception" );
+    }
+}
+
+int main()
+{
+    std::string path = "/tmp/curlite_segmented_" + std::to_string( getpid() );
+
+    try
+    {
+        LoopbackServer server;
+
+        testComplete( server, path );
+        testBrokenSegment( server, path );
+    }
+    catch( std::exception &e ) {
+        std::cerr << "Got an exception: " << e.what() << std::endl;
+        failures++;
+    }
+
+    std::remove( path.c_str() );
+
+    if( failures > 0 ) {
+        return 1;
+    }
+
+    std::cout << "segmented_download: ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,383 @@
+/*
+ * tools/curlite_load.cpp
+ *
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2014 Ivan Grynko
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/* HTTP load generator on top of curlite's own transfer engine (in the spirit of wrk2)
+ *
+ * Usage: curlite_load [options] [url]
+ *
+ *     -c <n>        concurrent connections (default 10)
+ *     -d <seconds>  duration of the test (default 10)
+ *     -R <rate>     total requests per second (open loop), without it the test is closed loop:
+ *                   every connection sends the next request as soon as the previous one is done
+ *     -H <header>   extra request header, may be repeated
+ *     -t <seconds>  request timeout (default 10)
+ *     -S <bytes>    run the stand-in server in the process and target its /bytes/<bytes>
+ *                   (unless the url is given)
+ *     -L <ms>       service delay of the stand-in server
+ *     -P <port>     port of the stand-in server (default: any free one)
+ *     -h, --help    print the usage
+ *
+ * The transfers run through curlite::Scheduler (EventLoop on Linux) with one reused Easy
+ * per connection, the way curlite clients run them in production.
+ *
+ * In the open loop every request has its intended start time on the fixed schedule. Its latency
+ * is measured from that time, so a request which waited for a free connection (because the
+ * server stalled) is charged with the wait. Without the correction (coordinated omission)
+ * a stall would hide behind the few requests which were in flight during it. Service time,
+ * measured from the actual start, is reported next to it. The requests still waiting for
+ * a connection when the test ends are counted too, with the latency from their intended
+ * start to the end of the test.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <curlite.hpp>
+
+#include "loopback_server.hpp"
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct Options
+    {
+        std::string url;
+        size_t connections = 10;
+        double duration = 10;
+        double rate = 0;
+        std::vector<std::string> headers;
+        double timeout = 10;
+        long standInBytes = -1;
+        long standInDelayMs = 0;
+        int standInPort = 0;
+    };
+
+    // state of the request, which runs on the connection
+    struct Connection
+    {
+        Clock::time_point intended;
+        Clock::time_point started;
+    };
+
+    struct Totals
+    {
+        std::vector<double> latencies;      // from the intended start, microseconds
+        std::vector<double> serviceTimes;   // from the actual start, microseconds
+        uint64_t unsent = 0;                // scheduled, but never sent, included in latencies
+        uint64_t bytes = 0;
+        uint64_t failed = 0;
+        uint64_t httpErrors = 0;
+    };
+
+    // the usage goes to stdout when it is asked for (status 0), and to stderr otherwise
+    void usage( const char *program, int status = 2 )
+    {
+        ( status == 0 ? std::cout : std::cerr )
+            << "Usage: " << program << " [-c connections] [-d seconds] [-R rate] [-H header] [-t timeout]"
+            << " [-S bytes [-L ms] [-P port]] [url]" << std::endl;
+        std::exit( status );
+    }
+
+    Options parseOptions( int argc, char *argv[] )
+    {
+        Options options;
+
+        for( int i = 1; i < argc; ++i )
+        {
+            std::string arg = argv[i];
+
+            if( arg == "-h" || arg == "--help" ) {
+                usage( argv[0], 0 );
+            }
+            else if( arg.size() == 2 && arg[0] == '-' )
+            {
+                if( i + 1 >= argc ) {
+                    usage( argv[0] );
+                }
+
+                const char *value = argv[++i];
+
+                switch( arg[1] )
+                {
+                case 'c': options.connections = std::max( std::strtoul( value, nullptr, 10 ), 1ul ); break;
+                case 'd': options.duration = std::atof( value ); break;
+                case 'R': options.rate = std::atof( value ); break;
+                case 'H': options.headers.push_back( value ); break;
+                case 't': options.timeout = std::atof( value ); break;
+                case 'S': options.standInBytes = std::atol( value ); break;
+                case 'L': options.standInDelayMs = std::atol( value ); break;
+                case 'P': options.standInPort = std::atoi( value ); break;
+                default:
+                    std::cerr << "unknown option: " << arg << std::endl;
+                    usage( argv[0] );
+                }
+            }
+            else if( arg[0] == '-' ) {
+                std::cerr << "unknown option: " << arg << std::endl;
+                usage( argv[0] );
+            }
+            else if( options.url.empty() ) {
+                options.url = arg;
+            }
+            else {
+                usage( argv[0] );
+            }
+        }
+
+        if( options.url.empty() && options.standInBytes < 0 ) {
+            usage( argv[0] );
+        }
+
+        return options;
+    }
+
+    // values must be sorted
+    double percentile( std::vector<double> const &values, double q )
+    {
+        if( values.empty() ) {
+            return 0;
+        }
+
+        size_t rank = size_t( std::ceil( q * double( values.size() ) ) );
+        return values[std::min( std::max<size_t>( rank, 1 ), values.size() ) - 1];
+    }
+
+    std::string formatDuration( double us )
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision( 2 );
+
+        if( us < 1000 ) {
+            out << us << "us";
+        } else if( us < 1000000 ) {
+            out << us / 1000 << "ms";
+        } else {
+            out << us / 1000000 << "s";
+        }
+
+        return out.str();
+    }
+
+    void report( Options const &options, Totals &totals, curlite::Metrics const &metrics, double elapsed )
+    {
+        std::sort( totals.latencies.begin(), totals.latencies.end() );
+        std::sort( totals.serviceTimes.begin(), totals.serviceTimes.end() );
+
+        bool openLoop = options.rate > 0;
+        size_t completed = totals.serviceTimes.size();
+
+        std::cout << "  " << std::setw( 10 ) << "percentile"
+                  << std::setw( 14 ) << ( openLoop ? "latency" : "" )
+                  << std::setw( 14 ) << "service time" << std::endl;
+
+        for( double q: { 0.5, 0.75, 0.9, 0.99, 0.999, 0.9999, 1.0 } )
+        {
+            std::ostringstream label;
+            label << q * 100 << "%";
+
+            std::cout << "  " << std::setw( 10 ) << label.str()
+                      << std::setw( 14 ) << ( openLoop ? formatDuration( percentile( totals.latencies, q ) ) : "" )
+                      << std::setw( 14 ) << formatDuration( percentile( totals.serviceTimes, q ) ) << std::endl;
+        }
+
+        std::cout << std::endl << std::fixed << std::setprecision( 2 );
+        std::cout << "  " << completed << " requests in " << elapsed << "s, "
+                  << double( totals.bytes ) / ( 1 << 20 ) << " MiB read" << std::endl;
+        std::cout << "  Requests/sec: " << double( completed ) / elapsed << std::endl;
+        std::cout << "  Transfer/sec: " << double( totals.bytes ) / ( 1 << 20 ) / elapsed << " MiB" << std::endl;
+        std::cout << "  Errors: " << totals.failed << " transfers failed, " << totals.httpErrors << " HTTP status >= 400" << std::endl;
+        std::cout << "  Connections: " << metrics.connections() << " opened, "
+                  << metrics.reusedConnections() << " requests reused one" << std::endl;
+
+        if( totals.unsent > 0 ) {
+            std::cout << "  " << totals.unsent << " scheduled requests weren't sent before the end of the test,"
+                      << " their latency is counted up to it" << std::endl;
+        }
+
+        static const char *const names[] = {
+            "namelookup", "connect", "appconnect", "pretransfer", "starttransfer", "total"
+        };
+
+        std::cout << std::endl << "  Phases (from the start of the transfer)   p50          p99" << std::endl;
+        for( int timing = curlite::Metrics::NameLookup; timing <= curlite::Metrics::Total; ++timing )
+        {
+            auto phase = curlite::Metrics::Timing( timing );
+            std::cout << "  " << std::left << std::setw( 40 ) << names[timing] << std::right
+                      << std::setw( 10 ) << formatDuration( metrics.quantile( phase, 0.5 ) * 1e6 )
+                      << std::setw( 13 ) << formatDuration( metrics.quantile( phase, 0.99 ) * 1e6 ) << std::endl;
+        }
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    Options options = parseOptions( argc, argv );
+
+    try
+    {
+        std::unique_ptr<curlite::tools::LoopbackServer> standIn;
+        if( options.standInBytes >= 0 )
+        {
+            standIn.reset( new curlite::tools::LoopbackServer(
+                options.standInPort, std::chrono::milliseconds( options.standInDelayMs ) ) );
+
+            if( options.url.empty() ) {
+                options.url = standIn->url( size_t( options.standInBytes ) );
+            }
+        }
+
+        bool openLoop = options.rate > 0;
+
+        std::cout << "Running " << options.duration << "s test @ " << options.url << std::endl;
+        std::cout << "  " << options.connections << " connections, ";
+        if( openLoop ) {
+            std::cout << "open loop at " << options.rate << " requests/sec" << std::endl << std::endl;
+        } else {
+            std::cout << "closed loop" << std::endl << std::endl;
+        }
+
+        curlite::Scheduler scheduler( options.connections, options.connections );
+        curlite::Metrics metrics;
+        curlite::List headers( options.headers );
+
+        std::vector<Connection> connections( options.connections );
+        std::vector<curlite::Easy> idle;
+
+        for( auto &connection: connections )
+        {
+            curlite::Easy easy;
+            easy.setExceptionMode( false );
+            easy.setUserData( &connection );
+
+            easy.set( CURLOPT_URL, options.url );
+            easy.set( CURLOPT_NOSIGNAL, 1L );
+            easy.set( CURLOPT_TIMEOUT_MS, long( options.timeout * 1000 ) );
+            easy.set( CURLOPT_HTTPHEADER, headers.get() );
+            easy.onWrite_( [] ( char *, size_t ) { return true; } );
+            easy.collectMetrics( metrics );
+
+            idle.push_back( std::move( easy ) );
+        }
+
+        Totals totals;
+
+        auto onDone = [&] ( curlite::Easy &easy )
+        {
+            auto now = Clock::now();
+            auto connection = static_cast<Connection*>( easy.userData() );
+
+            totals.latencies.push_back( std::chrono::duration<double, std::micro>( now - connection->intended ).count() );
+            totals.serviceTimes.push_back( std::chrono::duration<double, std::micro>( now - connection->started ).count() );
+
+            if( easy.error() != CURLE_OK ) {
+                totals.failed++;
+            }
+            else
+            {
+                if( easy.getInfo<long>( CURLINFO_RESPONSE_CODE ) >= 400 ) {
+                    totals.httpErrors++;
+                }
+
+#if LIBCURL_VERSION_NUM >= 0x073700
+                totals.bytes += uint64_t( easy.getInfo<curl_off_t>( CURLINFO_SIZE_DOWNLOAD_T ) );
+#else
+                totals.bytes += uint64_t( easy.getInfo<double>( CURLINFO_SIZE_DOWNLOAD ) );
+#endif
+            }
+
+            idle.push_back( scheduler.remove( &easy ) );
+        };
+
+        auto start = Clock::now();
+        auto end = start + std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( options.duration ) );
+        auto interval = openLoop ? std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( 1 / options.rate ) )
+                                 : Clock::duration::zero();
+
+        auto next = start;
+        auto last = start;
+
+        while( true )
+        {
+            auto now = Clock::now();
+            bool issuing = now < end;
+
+            while( issuing && !idle.empty() && ( !openLoop || next <= now ) )
+            {
+                curlite::Easy easy = std::move( idle.back() );
+                idle.pop_back();
+
+                auto connection = static_cast<Connection*>( easy.userData() );
+                connection->intended = openLoop ? next : now;
+                connection->started = now;
+                next += interval;
+
+                scheduler.submit( std::move( easy ) );
+            }
+
+            if( !issuing && scheduler.running() == 0 && scheduler.queued() == 0 ) {
+                break;
+            }
+
+            // wake up for the next scheduled request or the end of the test
+            auto until = !issuing ? now + std::chrono::milliseconds( 100 )
+                       : openLoop && !idle.empty() ? std::min( next, end ) : end;
+
+            int timeoutMs = int( std::chrono::duration_cast<std::chrono::milliseconds>( until - now ).count() );
+            if( !scheduler.runOnce( std::max( timeoutMs, 0 ), onDone ) ) {
+                std::cerr << "transfer engine error: " << curl_multi_strerror( scheduler.multi().error() ) << std::endl;
+                return 1;
+            }
+
+            last = Clock::now();
+        }
+
+        // the requests which never got a connection waited at least until the end of the test,
+        // leaving them out would hide the stall which held them back (coordinated omission)
+        for( ; openLoop && next < end; next += interval )
+        {
+            totals.latencies.push_back( std::chrono::duration<double, std::micro>( last - next ).count() );
+            totals.unsent++;
+        }
+
+        double elapsed = std::chrono::duration<double>( last - start ).count();
+        report( options, totals, metrics, elapsed );
+    }
+    catch( std::exception &e ) {
+        std::cerr << "Got an exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,384 @@
+/*
+ * tools/loopback_server.hpp
+ *
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2014 Ivan Grynko
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef loopback_server_hpp_9454cad7_3f60_4c7a_88d2_4fca53292db7
+#define loopback_server_hpp_9454cad7_3f60_4c7a_88d2_4fca53292db7
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+
+namespace curlite
+{
+namespace tools
+{
+    /* Stand-in HTTP/1.1 server on 127.0.0.1 for the benchmarks and the load generator (POSIX only)
+     *
+     * Every connection is served by its own thread with keep-alive. "GET /bytes/N" is answered
+     * with N bytes from memory after the service delay, anything else with 404. HEAD and single
+     * byte ranges ("Range: bytes=first-last") are supported. "/bytes/N?cut=M" sends the first M
+     * bytes of the body and closes the connection, for tests of broken transfers. "/bytes/N?chunk=K"
+     * sends the whole body with "Transfer-Encoding: chunked" in chunks of K bytes, so the client
+     * gets many small pieces out of every read of the socket.
+     */
+
+    class LoopbackServer
+    {
+        struct Connection
+        {
+            int fd;                 // -1 once the connection is closed
+            std::thread thread;
+        };
+
+        int _listenFd;
+        int _port;
+        std::chrono::microseconds _delay;
+        std::vector<char> _pattern;
+
+        std::thread _acceptor;
+        std::mutex _mutex;
+        std::list<Connection> _connections;
+
+        static bool sendAll( int fd, const char *data, size_t size )
+        {
+            while( size > 0 )
+            {
+                ssize_t sent = ::send( fd, data, size, MSG_NOSIGNAL );
+                if( sent <= 0 ) {
+                    return false;
+                }
+
+                data += sent;
+                size -= size_t( sent );
+            }
+
+            return true;
+        }
+
+        // the chunked encoding of the first bytes of the pattern
+        std::string encodeChunked( size_t bytes, size_t chunk ) const
+        {
+            std::string encoded;
+            char size[32];
+
+            for( size_t position = 0; position < bytes; position += chunk )
+            {
+                size_t length = std::min( chunk, bytes - position );
+                size_t offset = position % 26;
+
+                encoded.append( size, size_t( std::snprintf( size, sizeof( size ), "%zx\r\n", length ) ) );
+                encoded.append( _pattern.data() + offset, length );
+                encoded += "\r\n";
+            }
+
+            return encoded + "0\r\n\r\n";
+        }
+
+        void serve( int fd )
+        {
+            std::string request;
+            char buffer[4096];
+
+            // the connection usually asks for the same chunked body again
+            std::string chunked;
+            size_t chunkedBytes = 0, chunkedChunk = 0;
+
+            while( true )
+            {
+                size_t end;
+                while( ( end = request.find( "\r\n\r\n" ) ) == std::string::npos )
+                {
+                    ssize_t received = ::recv( fd, buffer, sizeof( buffer ), 0 );
+                    if( received <= 0 ) {
+                        return;
+                    }
+
+                    request.append( buffer, size_t( received ) );
+                }
+
+                std::string head( request, 0, end );
+                request.erase( 0, end + 4 );
+
+                bool headOnly = head.compare( 0, 5, "HEAD " ) == 0;
+                size_t target = headOnly ? 5 : 4;
+
+                size_t bytes = 0;
+                bool found = ( headOnly || head.compare( 0, 4, "GET " ) == 0 ) &&
+                             head.compare( target, 7, "/bytes/" ) == 0;
+                size_t cut = size_t( -1 );
+                size_t chunk = 0;
+
+                if( found )
+                {
+                    char *query = nullptr;
+                    bytes = std::strtoull( head.c_str() + target + 7, &query, 10 );
+
+                    if( std::strncmp( query, "?cut=", 5 ) == 0 ) {
+                        cut = std::strtoull( query + 5, nullptr, 10 );
+                    } else if( std::strncmp( query, "?chunk=", 7 ) == 0 ) {
+                        chunk = std::strtoull( query + 7, nullptr, 10 );
+                    }
+                }
+
+                // the body is [first, last)
+                size_t first = 0, last = bytes;
+                bool partial = false;
+
+                size_t range = head.find( "\r\nRange: bytes=" );
+                if( found && range != std::string::npos )
+                {
+                    char *dash = nullptr;
+                    first = std::strtoull( head.c_str() + range + 16, &dash, 10 );
+                    last = std::min<size_t>( std::strtoull( dash + 1, nullptr, 10 ) + 1, bytes );
+                    partial = first < last && chunk == 0;
+                }
+
+                if( _delay.count() > 0 ) {
+                    std::this_thread::sleep_for( _delay );
+                }
+
+                std::string response;
+                if( !found ) {
+                    response = "HTTP/1.1 404 Not Found\r\n";
+                    first = last = 0;
+                } else if( partial ) {
+                    response = "HTTP/1.1 206 Partial Content\r\nContent-Type: application/octet-stream\r\n"
+                               "Content-Range: bytes " + std::to_string( first ) + "-" + std::to_string( last - 1 ) +
+                               "/" + std::to_string( bytes ) + "\r\n";
+                } else {
+                    response = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nAccept-Ranges: bytes\r\n";
+                    first = 0;
+                    last = bytes;
+                }
+
+                if( found && chunk > 0 ) {
+                    response += "Transfer-Encoding: chunked\r\n\r\n";
+                } else {
+                    response += "Content-Length: " + std::to_string( last - first ) + "\r\n\r\n";
+                }
+
+                if( !sendAll( fd, response.data(), response.size() ) ) {
+                    return;
+                }
+
+                if( headOnly ) {
+                    continue;
+                }
+
+                if( found && chunk > 0 )
+                {
+                    if( chunked.empty() || chunkedBytes != bytes || chunkedChunk != chunk ) {
+                        chunked = encodeChunked( bytes, chunk );
+                        chunkedBytes = bytes;
+                        chunkedChunk = chunk;
+                    }
+
+                    if( !sendAll( fd, chunked.data(), chunked.size() ) ) {
+                        return;
+                    }
+
+                    continue;
+                }
+
+                // the pattern repeats every 26 bytes, so any offset of it can be sent from the buffer
+                for( size_t position = first; position < last; )
+                {
+                    if( position >= cut ) {
+                        return;
+                    }
+
+                    size_t offset = position % 26;
+                    size_t chunk = std::min( { last - position, _pattern.size() - offset, cut - position } );
+                    if( !sendAll( fd, _pattern.data() + offset, chunk ) ) {
+                        return;
+                    }
+
+                    position += chunk;
+                }
+            }
+        }
+
+        void run( std::list<Connection>::iterator connection )
+        {
+            serve( connection->fd );
+
+            std::lock_guard<std::mutex> lock( _mutex );
+            ::close( connection->fd );
+            connection->fd = -1;
+        }
+
+        // join the threads of the closed connections
+        void reap()
+        {
+            std::list<Connection> closed;
+
+            {
+                std::lock_guard<std::mutex> lock( _mutex );
+                for( auto it = _connections.begin(); it != _connections.end(); )
+                {
+                    auto next = std::next( it );
+                    if( it->fd < 0 ) {
+                        closed.splice( closed.end(), _connections, it );
+                    }
+
+                    it = next;
+                }
+            }
+
+            for( auto &connection: closed ) {
+                connection.thread.join();
+            }
+        }
+
+        void acceptLoop()
+        {
+            while( true )
+            {
+                int fd = ::accept( _listenFd, nullptr, nullptr );
+                if( fd < 0 )
+                {
+                    if( errno == EINTR || errno == ECONNABORTED ) {
+                        continue;
+                    }
+
+                    // out of descriptors or memory, wait for some connections to close
+                    if( errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM ) {
+                        reap();
+                        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+                        continue;
+                    }
+
+                    // the server is stopped
+                    return;
+                }
+
+                int one = 1;
+                ::setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+
+                reap();
+
+                std::lock_guard<std::mutex> lock( _mutex );
+                auto connection = _connections.insert( _connections.end(), Connection { fd, std::thread() } );
+                connection->thread = std::thread( [this, connection] { run( connection ); } );
+            }
+        }
+
+        LoopbackServer( LoopbackServer const &other );
+        void operator = ( LoopbackServer const &other );
+
+    public:
+        /* Port 0 picks a free one
+         */
+
+        LoopbackServer( int port = 0, std::chrono::microseconds delay = std::chrono::microseconds( 0 ) )
+            : _delay( delay ), _pattern( 1 << 20 )
+        {
+            for( size_t i = 0; i < _pattern.size(); ++i ) {
+                _pattern[i] = char( 'a' + i % 26 );
+            }
+
+            _listenFd = ::socket( AF_INET, SOCK_STREAM, 0 );
+
+            int one = 1;
+            ::setsockopt( _listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+
+            sockaddr_in address;
+            std::memset( &address, 0, sizeof( address ) );
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+            address.sin_port = htons( uint16_t( port ) );
+
+            socklen_t length = sizeof( address );
+            if( _listenFd < 0 ||
+                ::bind( _listenFd, reinterpret_cast<sockaddr*>( &address ), sizeof( address ) ) != 0 ||
+                ::listen( _listenFd, 4096 ) != 0 ||
+                ::getsockname( _listenFd, reinterpret_cast<sockaddr*>( &address ), &length ) != 0 )
+            {
+                std::cerr << "can't start the loopback server" << std::endl;
+                std::exit( 1 );
+            }
+
+            _port = ntohs( address.sin_port );
+            _acceptor = std::thread( [this] { acceptLoop(); } );
+        }
+
+        ~LoopbackServer()
+        {
+            // wakes up accept() and recv() of the threads
+            ::shutdown( _listenFd, SHUT_RDWR );
+            ::close( _listenFd );
+            _acceptor.join();
+
+            std::list<Connection> connections;
+
+            {
+                std::lock_guard<std::mutex> lock( _mutex );
+                for( auto &connection: _connections ) {
+                    if( connection.fd >= 0 ) {
+                        ::shutdown( connection.fd, SHUT_RDWR );
+                    }
+                }
+
+                connections.splice( connections.end(), _connections );
+            }
+
+            // the threads close their descriptors
+            for( auto &connection: connections ) {
+                connection.thread.join();
+            }
+        }
+
+        int port() const
+        {
+            return _port;
+        }
+
+        std::string url( size_t bytes ) const
+        {
+            return "http://127.0.0.1:" + std::to_string( _port ) + "/bytes/" + std::to_string( bytes );
+        }
+    };
+
+} // end of namespace tools
+} // end of namespace curlite
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ * tools/wire_decode.cpp
+ *
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2014 Ivan Grynko
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/* Prints a dump of curlite::WireCapture
+ *
+ * Usage: wire_decode <dump file> [transfer]
+ *
+ * Every event is printed on one line: seconds since the capture was created, transfer number,
+ * event type, original size and the recorded bytes (escaped). Only the events of the given
+ * transfer are printed, if it's set.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <ctime>
+#include <cstdint>
+#include <cstdlib>
+
+namespace
+{
+    // in the order of curl_infotype
+    const char *const typeNames[] = {
+        "text", "header-in", "header-out", "data-in", "data-out", "ssl-in", "ssl-out"
+    };
+
+    template <class T>
+    bool readLittleEndian( std::istream &stream, T &value )
+    {
+        unsigned char bytes[sizeof( T )];
+        if( !stream.read( reinterpret_cast<char*>( bytes ), sizeof( T ) ) ) {
+            return false;
+        }
+
+        uint64_t result = 0;
+        for( size_t i = 0; i < sizeof( T ); ++i ) {
+            result |= uint64_t( bytes[i] ) << ( 8 * i );
+        }
+
+        value = T( result );
+        return true;
+    }
+
+    std::string escape( std::vector<char> const &data )
+    {
+        static const char hex[] = "0123456789abcdef";
+        std::string result;
+
+        for( char c: data )
+        {
+            unsigned char u = static_cast<unsigned char>( c );
+
+            switch( c )
+            {
+            case '\r': result += "\\r"; break;
+            case '\n': result += "\\n"; break;
+            case '\t': result += "\\t"; break;
+            case '\\': result += "\\\\"; break;
+            case '"':  result += "\\\""; break;
+            default:
+                if( u >= 0x20 && u < 0x7f ) {
+                    result += c;
+                } else {
+                    result += "\\x";
+                    result += hex[u >> 4];
+                    result += hex[u & 15];
+                }
+            }
+        }
+
+        return result;
+    }
+}
+
+int main( int argc, char **argv )
+{
+    if( argc < 2 ) {
+        std::cerr << "Usage: " << argv[0] << " <dump file> [transfer]" << std::endl;
+        return 2;
+    }
+
+    long long onlyTransfer = argc > 2 ? std::atoll( argv[2] ) : -1;
+
+    std::ifstream file( argv[1], std::ios::binary );
+    if( !file ) {
+        std::cerr << "Can't open " << argv[1] << std::endl;
+        return 1;
+    }
+
+    char magic[8];
+    uint32_t version = 0;
+    uint32_t maxPayload = 0;
+    int64_t startTime = 0;
+    uint64_t count = 0;
+
+    if( !file.read( magic, sizeof( magic ) ) || std::string( magic, sizeof( magic ) ) != "CURLWIRE" ||
+        !readLittleEndian( file, version ) || version != 1 ||
+        !readLittleEndian( file, maxPayload ) ||
+        !readLittleEndian( file, startTime ) ||
+        !readLittleEndian( file, count ) )
+    {
+        std::cerr << argv[1] << " isn't a wire capture dump" << std::endl;
+        return 1;
+    }
+
+    std::time_t startSeconds = std::time_t( startTime / 1000000000 );
+    char started[32];
+    std::strftime( started, sizeof( started ), "%Y-%m-%d %H:%M:%S", std::gmtime( &startSeconds ) );
+
+    std::cout << "# started " << started << "." << std::setw( 9 ) << std::setfill( '0' ) << startTime % 1000000000
+              << " UTC, " << count << " events, up to " << maxPayload << " bytes each" << std::endl;
+    std::cout << std::setfill( ' ' );
+
+    for( uint64_t i = 0; i < count; ++i )
+    {
+        uint64_t time = 0;
+        uint32_t transfer = 0;
+        uint8_t type = 0;
+        uint8_t reserved = 0;
+        uint16_t stored = 0;
+        uint64_t size = 0;
+
+        if( !readLittleEndian( file, time ) || !readLittleEndian( file, transfer ) ||
+            !readLittleEndian( file, type ) || !readLittleEndian( file, reserved ) ||
+            !readLittleEndian( file, stored ) || !readLittleEndian( file, size ) )
+        {
+            std::cerr << "Truncated dump after " << i << " events" << std::endl;
+            return 1;
+        }
+
+        std::vector<char> data( stored );
+        if( stored && !file.read( data.data(), stored ) ) {
+            std::cerr << "Truncated dump after " << i << " events" << std::endl;
+            return 1;
+        }
+
+        if( onlyTransfer >= 0 && transfer != uint64_t( onlyTransfer ) ) {
+            continue;
+        }
+
+        std::cout << std::fixed << std::setprecision( 9 ) << std::setw( 14 ) << double( time ) / 1e9
+                  << "  #" << std::left << std::setw( 5 ) << transfer
+                  << std::setw( 11 ) << ( type < sizeof( typeNames ) / sizeof( typeNames[0] ) ? typeNames[type] : "unknown" )
+                  << std::right << std::setw( 8 ) << size << "  \"" << escape( data ) << "\"";
+
+        if( size > stored ) {
+            std::cout << "...";
+        }
+
+        std::cout << std::endl;
+    }
+
+    return 0;
+}